@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+
+namespace hnswlib {
+
+/*
+* Conjunction of conditions on the attribute columns of HierarchicalNSW, see addAttributeColumn. Built by chaining:
+* AttributePredicate().equal(tenant, 7).anyBits(categories, 0x14).range(timestamp, from, to)
+* An empty predicate allows every element.
+*/
+class AttributePredicate {
+ public:
+    enum class Op {
+        EQUAL,     // value == low
+        RANGE,     // low <= value <= high
+        ANY_BITS   // value & low != 0
+    };
+
+    struct Term {
+        size_t column;
+        Op op;
+        uint64_t low, high;
+    };
+
+    AttributePredicate &equal(size_t column, uint64_t value) {
+        terms_.push_back(Term{column, Op::EQUAL, value, value});
+        return *this;
+    }
+
+    AttributePredicate &range(size_t column, uint64_t low, uint64_t high) {
+        terms_.push_back(Term{column, Op::RANGE, low, high});
+        return *this;
+    }
+
+    AttributePredicate &anyBits(size_t column, uint64_t mask) {
+        terms_.push_back(Term{column, Op::ANY_BITS, mask, 0});
+        return *this;
+    }
+
+    const std::vector<Term> &terms() const {
+        return terms_;
+    }
+
+ private:
+    std::vector<Term> terms_;
+};
+
+
+// A term of an AttributePredicate with the place of its column in the rows of AttributeColumns
+struct AttributeCondition {
+    size_t offset;
+    size_t width;
+    AttributePredicate::Op op;
+    uint64_t low, high;
+};
+
+
+/*
+* Columns of unsigned integers 1, 2, 4 or 8 bytes wide, indexed by internal id. They are stored row by row,
+* so that a predicate on several columns reads a single place per element. Values of new rows are 0.
+*/
+class AttributeColumns {
+ public:
+    size_t numColumns() const {
+        return widths_.size();
+    }
+
+    size_t rowSize() const {
+        return row_size_;
+    }
+
+    size_t width(size_t column) const {
+        return widths_[column];
+    }
+
+    // Adds a column to rows for max_elements elements, keeping the values of the other columns
+    size_t addColumn(size_t width, size_t max_elements) {
+        if (width != 1 && width != 2 && width != 4 && width != 8)
+            throw std::runtime_error("Attribute columns must be 1, 2, 4 or 8 bytes wide");
+        size_t row_size = row_size_ + width;
+        std::vector<char> rows(max_elements * row_size, 0);
+        for (size_t i = 0; i < max_elements && row_size_ > 0; i++)
+            memcpy(&rows[i * row_size], &rows_[i * row_size_], row_size_);
+        rows_.swap(rows);
+        offsets_.push_back(row_size_);
+        widths_.push_back(width);
+        row_size_ = row_size;
+        return widths_.size() - 1;
+    }
+
+    void resize(size_t max_elements) {
+        rows_.resize(max_elements * row_size_, 0);
+    }
+
+    const char *row(size_t id) const {
+        return rows_.data() + id * row_size_;
+    }
+
+    char *row(size_t id) {
+        return rows_.data() + id * row_size_;
+    }
+
+    uint64_t get(size_t id, size_t column) const {
+        checkColumn(column);
+        return load(row(id) + offsets_[column], widths_[column]);
+    }
+
+    void set(size_t id, size_t column, uint64_t value) {
+        checkColumn(column);
+        size_t width = widths_[column];
+        if (width < 8 && (value >> (8 * width)) != 0)
+            throw std::runtime_error("Attribute value does not fit its column");
+        store(row(id) + offsets_[column], width, value);
+    }
+
+    void clearRow(size_t id) {
+        memset(row(id), 0, row_size_);
+    }
+
+    // Rows of the ids new_to_old[0], new_to_old[1], ... become the rows 0, 1, ...
+    template<typename id_t>
+    void permute(const std::vector<id_t> &new_to_old) {
+        std::vector<char> rows(rows_.size(), 0);
+        for (size_t i = 0; i < new_to_old.size(); i++)
+            memcpy(&rows[i * row_size_], row(new_to_old[i]), row_size_);
+        rows_.swap(rows);
+    }
+
+    std::vector<AttributeCondition> compile(const AttributePredicate &predicate) const {
+        std::vector<AttributeCondition> conditions;
+        for (const AttributePredicate::Term &term : predicate.terms()) {
+            checkColumn(term.column);
+            conditions.push_back(AttributeCondition{offsets_[term.column], widths_[term.column], term.op,
+                                                    term.low, term.high});
+        }
+        return conditions;
+    }
+
+    static bool matches(const char *row, const std::vector<AttributeCondition> &conditions) {
+        for (const AttributeCondition &condition : conditions) {
+            uint64_t value = load(row + condition.offset, condition.width);
+            switch (condition.op) {
+                case AttributePredicate::Op::EQUAL:
+                    if (value != condition.low) return false;
+                    break;
+                case AttributePredicate::Op::RANGE:
+                    if (value < condition.low || value > condition.high) return false;
+                    break;
+                case AttributePredicate::Op::ANY_BITS:
+                    if ((value & condition.low) == 0) return false;
+                    break;
+            }
+        }
+        return true;
+    }
+
+ private:
+    size_t row_size_{0};
+    std::vector<size_t> offsets_;
+    std::vector<size_t> widths_;
+    std::vector<char> rows_;
+
+    void checkColumn(size_t column) const {
+        if (column >= widths_.size())
+            throw std::runtime_error("Unknown attribute column");
+    }
+
+    static void store(char *p, size_t width, uint64_t value) {
+        switch (width) {
+            case 1: *(uint8_t *) p = (uint8_t) value; break;
+            case 2: { uint16_t v = (uint16_t) value; memcpy(p, &v, 2); break; }
+            case 4: { uint32_t v = (uint32_t) value; memcpy(p, &v, 4); break; }
+            default: memcpy(p, &value, 8);
+        }
+    }
+
+    static uint64_t load(const char *p, size_t width) {
+        switch (width) {
+            case 1: return *(const uint8_t *) p;
+            case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+            case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+            default: { uint64_t v; memcpy(&v, p, 8); return v; }
+        }
+    }
+};
+
+}  // namespace hnswlib
@@ -16,6 +16,7 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
 
     size_t data_size_;
     DISTFUNC <dist_t> fstdistfunc_;
+    DISTFUNC <dist_t> fstquerydistfunc_;
     void *dist_func_param_;
     std::mutex index_lock;
 
@@ -47,6 +48,7 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         maxelements_ = maxElements;
         data_size_ = s->get_data_size();
         fstdistfunc_ = s->get_dist_func();
+        fstquerydistfunc_ = s->get_query_dist_func();
         dist_func_param_ = s->get_dist_func_param();
         size_per_element_ = data_size_ + sizeof(labeltype);
         data_ = (char *) malloc(maxElements * size_per_element_);
@@ -105,11 +107,20 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
 
     std::priority_queue<std::pair<dist_t, labeltype >>
     searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        return searchKnn(query_data, k, isIdAllowed, nullptr);
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats* stats) const {
         assert(k <= cur_element_count);
         std::priority_queue<std::pair<dist_t, labeltype >> topResults;
         if (cur_element_count == 0) return topResults;
+        // the scan computes the distance to every element and makes no hops
+        if (stats)
+            stats->distance_computations += cur_element_count;
         for (int i = 0; i < k; i++) {
-            dist_t dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
+            dist_t dist = fstquerydistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
             labeltype label = *((labeltype*) (data_ + size_per_element_ * i + data_size_));
             if ((!isIdAllowed) || (*isIdAllowed)(label)) {
                 topResults.emplace(dist, label);
@@ -117,8 +128,9 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         }
         dist_t lastdist = topResults.empty() ? std::numeric_limits<dist_t>::max() : topResults.top().first;
         for (int i = k; i < cur_element_count; i++) {
-            dist_t dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-            if (dist <= lastdist) {
+            dist_t dist = fstquerydistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
+            // the results may still miss elements when the filter rejected some of the first k
+            if (dist <= lastdist || topResults.size() < k) {
                 labeltype label = *((labeltype *) (data_ + size_per_element_ * i + data_size_));
                 if ((!isIdAllowed) || (*isIdAllowed)(label)) {
                     topResults.emplace(dist, label);
@@ -159,6 +171,7 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
 
         data_size_ = s->get_data_size();
         fstdistfunc_ = s->get_dist_func();
+        fstquerydistfunc_ = s->get_query_dist_func();
         dist_func_param_ = s->get_dist_func_param();
         size_per_element_ = data_size_ + sizeof(labeltype);
         data_ = (char *) malloc(maxelements_ * size_per_element_);
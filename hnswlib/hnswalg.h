@@ -1,7 +1,12 @@
 #pragma once
 
 #include "visited_list_pool.h"
+#include "mapped_file.h"
+#include "index_memory.h"
 #include "hnswlib.h"
+#include "label_lookup.h"
+#include "attributes.h"
+#include "parallel.h"
 #include <atomic>
 #include <random>
 #include <stdlib.h>
@@ -9,22 +14,71 @@
 #include <unordered_set>
 #include <list>
 #include <memory>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <type_traits>
 
 namespace hnswlib {
-typedef unsigned int tableint;
 typedef unsigned int linklistsizeint;
 
+// Orderings of internal ids computed by HierarchicalNSW::reorderGraph
+enum class GraphOrder {
+    BFS,  // breadth-first traversal of the base layer from the entry point
+    RCM   // reverse Cuthill-McKee: breadth-first from a low degree node, neighbors by increasing degree
+};
+
+// Layouts of the base layer in memory
+enum class Level0Layout {
+    INTERLEAVED,  // one row per element holding its links, vector and label
+    SPLIT         // links, vectors and labels in three separate huge page aligned arrays
+};
+
+/*
+* Distance computations of HierarchicalNSW<dist_t, Space>. With Space = void, the default, the index calls the
+* function pointers of its space. Otherwise Space is a static functor like L2StaticDistance, whose distance
+* function the compiler can inline into the search and construction loops. Both forms share the same file format.
+*/
+template<typename dist_t, typename Space>
+struct IndexDistance {
+    static dist_t compute(DISTFUNC<dist_t> dist_func, const void *a, const void *b, const void *param) {
+        return Space::distance(a, b, param);
+    }
+
+    // The functor computes float distances of Space::dimension, or of any dimension when it is 0
+    static void checkSpace(size_t data_size, const void *param) {
+        size_t dim = *((const size_t *) param);
+        if ((Space::dimension != 0 && Space::dimension != dim) || data_size != dim * sizeof(float))
+            throw std::runtime_error("The static distance does not match the space");
+    }
+};
+
 template<typename dist_t>
+struct IndexDistance<dist_t, void> {
+    static dist_t compute(DISTFUNC<dist_t> dist_func, const void *a, const void *b, const void *param) {
+        return dist_func(a, b, param);
+    }
+
+    static void checkSpace(size_t, const void *) {}
+};
+
+template<typename dist_t, typename Space = void>
 class HierarchicalNSW : public AlgorithmInterface<dist_t> {
  public:
     static const tableint MAX_LABEL_OPERATION_LOCKS = 65536;
+    static const tableint LINK_LIST_SEQ_STRIPES = 65536;  // power of 2, see getLinkListSeq
+    static const uint64_t EMPTY_ENTRY_POINT = 0xffffffffffffffffULL;  // entry point -1 at level -1
     static const unsigned char DELETE_MARK = 0x01;
 
     size_t max_elements_{0};
     mutable std::atomic<size_t> cur_element_count{0};  // current number of elements
+    std::atomic<size_t> published_element_count_{0};  // the elements below it are fully written, see insertPoint
     size_t size_data_per_element_{0};
     size_t size_links_per_element_{0};
     mutable std::atomic<size_t> num_deleted_{0};  // number of deleted elements
+    std::atomic<size_t> deletion_epoch_{0};  // incremented by every deletion and undeletion
     size_t M_{0};
     size_t maxM_{0};
     size_t maxM0_{0};
@@ -32,36 +86,55 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     size_t ef_{ 0 };
 
     double mult_{0.0}, revSize_{0.0};
-    int maxlevel_{0};
 
     std::unique_ptr<VisitedListPool> visited_list_pool_{nullptr};
+    std::unique_ptr<VisitedHashSetPool> visited_hash_set_pool_{new VisitedHashSetPool(0, 0)};
+    size_t compact_visited_max_ef_{0};  // searches with ef up to this value use a hash set instead of a visited list
+    double two_hop_max_selectivity_{0};  // filtered searches allowing at most this fraction use searchBaseLayerTwoHop
+    bool filter_planning_{false};  // filtered searches choose between the graph and a scan, see preferExactSearch
 
     // Locks operations with element by label value
     mutable std::vector<std::mutex> label_op_locks_;
 
-    std::mutex global;
-    std::vector<std::mutex> link_list_locks_;
+    std::mutex global;  // held by the insertions of elements above the top level
 
-    tableint enterpoint_node_{0};
+    // Entry point of the searches and the top level, see getEntryPoint
+    std::atomic<uint64_t> entry_point_{EMPTY_ENTRY_POINT};
 
     size_t size_links_level0_{0};
     size_t offsetData_{0}, offsetLevel0_{0}, label_offset_{ 0 };
 
-    char *data_level0_memory_{nullptr};
+    Level0Layout level0_layout_{Level0Layout::INTERLEAVED};
+    char *data_level0_memory_{nullptr};  // the rows of the interleaved layout, the links of the split layout
+    char *vectors_level0_memory_{nullptr};  // split layout only
+    char *labels_level0_memory_{nullptr};  // split layout only
+
+    // in both layouts a field of element i is at base + i * stride
+    char *level0_links_{nullptr}, *level0_data_{nullptr}, *level0_labels_{nullptr};
+    size_t level0_links_stride_{0}, level0_data_stride_{0}, level0_labels_stride_{0};
     char **linkLists_{nullptr};
     std::vector<int> element_levels_;  // keeps level of each element
+    std::unique_ptr<std::atomic<uint32_t>[]> link_list_seqs_;  // LINK_LIST_SEQ_STRIPES, nullptr for read-only indexes
 
     size_t data_size_{0};
+    size_t query_data_size_{0};  // size of a search query, see SpaceInterface::get_query_data_size
 
     DISTFUNC<dist_t> fstdistfunc_;
+    DISTFUNC<dist_t> fstquerydistfunc_;  // distance from a search query, used by the search paths only
+    DISTBATCHFUNC<dist_t> fstdistbatchfunc_{nullptr};  // nullptr when the space has no batch kernel
+    DISTBATCHFUNC<dist_t> fstquerydistbatchfunc_{nullptr};
+    DISTBOUNDEDBATCHFUNC<dist_t> fstdistboundedbatchfunc_{nullptr};  // nullptr when the distance has no bounded kernel
+    DISTBOUNDEDBATCHFUNC<dist_t> fstquerydistboundedbatchfunc_{nullptr};
     void *dist_func_param_{nullptr};
 
-    mutable std::mutex label_lookup_lock;  // lock for label_lookup_
-    std::unordered_map<labeltype, tableint> label_lookup_;
+    LabelLookup<labeltype, tableint> label_lookup_;
+
+    AttributeColumns attributes_;  // see addAttributeColumn
 
     std::default_random_engine level_generator_;
     std::default_random_engine update_probability_generator_;
 
+    // Deprecated, use SearchStats: shared counters of the greedy hops above level 0, kept for existing readers
     mutable std::atomic<long> metric_distance_computations{0};
     mutable std::atomic<long> metric_hops{0};
 
@@ -70,6 +143,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     std::mutex deleted_elements_lock;  // lock for deleted_elements
     std::unordered_set<tableint> deleted_elements;  // contains internal ids of deleted elements
 
+    std::unique_ptr<MappedFile> mapped_file_{nullptr};  // backing file of an index opened with loadIndexMapped
+    IndexAllocator *allocator_{nullptr};  // allocates the base layer, nullptr for malloc
+
 
     HierarchicalNSW(SpaceInterface<dist_t> *s) {
     }
@@ -80,8 +156,10 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         const std::string &location,
         bool nmslib = false,
         size_t max_elements = 0,
-        bool allow_replace_deleted = false)
-        : allow_replace_deleted_(allow_replace_deleted) {
+        bool allow_replace_deleted = false,
+        IndexAllocator *allocator = nullptr)
+        : allow_replace_deleted_(allow_replace_deleted),
+            allocator_(allocator) {
         loadIndex(location, s, max_elements);
     }
 
@@ -92,16 +170,26 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         size_t M = 16,
         size_t ef_construction = 200,
         size_t random_seed = 100,
-        bool allow_replace_deleted = false)
+        bool allow_replace_deleted = false,
+        Level0Layout level0_layout = Level0Layout::INTERLEAVED,
+        IndexAllocator *allocator = nullptr)
         : label_op_locks_(MAX_LABEL_OPERATION_LOCKS),
-            link_list_locks_(max_elements),
+            level0_layout_(level0_layout),
             element_levels_(max_elements),
-            allow_replace_deleted_(allow_replace_deleted) {
+            allow_replace_deleted_(allow_replace_deleted),
+            allocator_(allocator) {
         max_elements_ = max_elements;
         num_deleted_ = 0;
         data_size_ = s->get_data_size();
+        query_data_size_ = s->get_query_data_size();
         fstdistfunc_ = s->get_dist_func();
+        fstquerydistfunc_ = s->get_query_dist_func();
+        fstdistbatchfunc_ = s->get_dist_batch_func();
+        fstquerydistbatchfunc_ = s->get_query_dist_batch_func();
+        fstdistboundedbatchfunc_ = s->get_dist_bounded_batch_func();
+        fstquerydistboundedbatchfunc_ = s->get_query_dist_bounded_batch_func();
         dist_func_param_ = s->get_dist_func_param();
+        IndexDistance<dist_t, Space>::checkSpace(data_size_, dist_func_param_);
         if ( M <= 10000 ) {
             M_ = M;
         } else {
@@ -123,17 +211,16 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         label_offset_ = size_links_level0_ + data_size_;
         offsetLevel0_ = 0;
 
-        data_level0_memory_ = (char *) malloc(max_elements_ * size_data_per_element_);
-        if (data_level0_memory_ == nullptr)
-            throw std::runtime_error("Not enough memory");
+        allocateLevel0(max_elements_);
+        label_lookup_.resize(max_elements_);
+        link_list_seqs_.reset(new std::atomic<uint32_t>[LINK_LIST_SEQ_STRIPES]());
 
         cur_element_count = 0;
 
         visited_list_pool_ = std::unique_ptr<VisitedListPool>(new VisitedListPool(1, max_elements));
 
         // initializations for special treatment of the first node
-        enterpoint_node_ = -1;
-        maxlevel_ = -1;
+        setEntryPoint(-1, -1);
 
         linkLists_ = (char **) malloc(sizeof(void *) * max_elements_);
         if (linkLists_ == nullptr)
@@ -149,16 +236,102 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
     void clear() {
-        free(data_level0_memory_);
-        data_level0_memory_ = nullptr;
-        for (tableint i = 0; i < cur_element_count; i++) {
-            if (element_levels_[i] > 0)
-                free(linkLists_[i]);
+        // a mapped index keeps level 0 and the link lists inside the file mapping
+        if (!mapped_file_) {
+            freeLevel0(data_level0_memory_, vectors_level0_memory_, labels_level0_memory_);
+            for (tableint i = 0; i < cur_element_count; i++) {
+                if (element_levels_[i] > 0)
+                    free(linkLists_[i]);
+            }
         }
+        data_level0_memory_ = nullptr;
+        vectors_level0_memory_ = nullptr;
+        labels_level0_memory_ = nullptr;
+        level0_links_ = level0_data_ = level0_labels_ = nullptr;
         free(linkLists_);
         linkLists_ = nullptr;
+        link_list_seqs_.reset();
         cur_element_count = 0;
+        published_element_count_ = 0;
+        setEntryPoint(-1, -1);
+        label_lookup_.clear();
+        attributes_ = AttributeColumns();
+        deleted_elements.clear();
+        num_deleted_ = 0;
         visited_list_pool_.reset(nullptr);
+        mapped_file_.reset(nullptr);
+    }
+
+
+    bool isReadOnly() const {
+        return mapped_file_ != nullptr;
+    }
+
+
+    // Points the field accessors at the base layer memory of the current layout
+    void setLevel0Fields() {
+        if (level0_layout_ == Level0Layout::INTERLEAVED) {
+            level0_links_ = data_level0_memory_ + offsetLevel0_;
+            level0_data_ = data_level0_memory_ + offsetData_;
+            level0_labels_ = data_level0_memory_ + label_offset_;
+            level0_links_stride_ = level0_data_stride_ = level0_labels_stride_ = size_data_per_element_;
+        } else {
+            level0_links_ = data_level0_memory_;
+            level0_data_ = vectors_level0_memory_;
+            level0_labels_ = labels_level0_memory_;
+            level0_links_stride_ = size_links_level0_;
+            level0_data_stride_ = data_size_;
+            level0_labels_stride_ = sizeof(labeltype);
+        }
+    }
+
+
+    // Without an allocator the split layout uses huge page aligned arrays
+    char *allocateLevel0Array(size_t size) const {
+        if (allocator_)
+            return (char *) allocator_->allocate(size);
+        if (level0_layout_ == Level0Layout::INTERLEAVED)
+            return (char *) malloc(size);
+        return (char *) mallocHugePageAligned(size);
+    }
+
+
+    void freeLevel0Array(char *ptr) const {
+        if (ptr == nullptr)
+            return;
+        if (allocator_)
+            allocator_->deallocate(ptr);
+        else if (level0_layout_ == Level0Layout::INTERLEAVED)
+            free(ptr);
+        else
+            freeHugePageAligned(ptr);
+    }
+
+
+    void allocateLevel0(size_t max_elements) {
+        if (level0_layout_ == Level0Layout::INTERLEAVED) {
+            data_level0_memory_ = allocateLevel0Array(max_elements * size_data_per_element_);
+            if (data_level0_memory_ == nullptr)
+                throw std::runtime_error("Not enough memory: failed to allocate base layer");
+        } else {
+            data_level0_memory_ = allocateLevel0Array(max_elements * size_links_level0_);
+            vectors_level0_memory_ = allocateLevel0Array(max_elements * data_size_);
+            labels_level0_memory_ = allocateLevel0Array(max_elements * sizeof(labeltype));
+            if (!data_level0_memory_ || !vectors_level0_memory_ || !labels_level0_memory_) {
+                freeLevel0(data_level0_memory_, vectors_level0_memory_, labels_level0_memory_);
+                data_level0_memory_ = vectors_level0_memory_ = labels_level0_memory_ = nullptr;
+                throw std::runtime_error("Not enough memory: failed to allocate base layer");
+            }
+        }
+        setLevel0Fields();
+    }
+
+
+    // Releases base layer memory allocated by allocateLevel0
+    void freeLevel0(char *data_level0_memory, char *vectors_level0_memory, char *labels_level0_memory) const {
+        freeLevel0Array(data_level0_memory);
+        freeLevel0Array(vectors_level0_memory);
+        freeLevel0Array(labels_level0_memory);
     }
 
 
@@ -170,11 +343,120 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     };
 
 
+    // Heaps of a search, kept by each thread and reused by its next searches
+    struct SearchScratch {
+        std::vector<std::pair<dist_t, tableint>> candidate_set;  // heap of (-distance, id)
+        std::vector<std::pair<dist_t, tableint>> top_candidates;  // heap of (distance, id)
+        std::vector<tableint> links;  // copy of the links being expanded, see readLinkList
+        std::vector<tableint> hop_links;  // links of a link, see searchBaseLayerTwoHop
+        std::vector<tableint> neighbors;  // elements reached in one or two hops, see searchBaseLayerTwoHop
+        std::vector<dist_t> dists;  // distances to the unvisited links, see distanceBatch
+        bool in_use{false};
+    };
+
+    /*
+    * Gives the calling thread its scratch, emptied. A search started while the thread's scratch is taken,
+    * e.g. from a filter or a stop condition callback, gets a scratch of its own.
+    */
+    class SearchScratchLease {
+        SearchScratch own_scratch_;
+        SearchScratch *scratch_;
+
+     public:
+        SearchScratchLease() {
+            static thread_local SearchScratch thread_scratch;
+            scratch_ = thread_scratch.in_use ? &own_scratch_ : &thread_scratch;
+            scratch_->in_use = true;
+            scratch_->candidate_set.clear();
+            scratch_->top_candidates.clear();
+        }
+
+        SearchScratchLease(const SearchScratchLease &) = delete;
+        SearchScratchLease &operator=(const SearchScratchLease &) = delete;
+
+        ~SearchScratchLease() {
+            scratch_->in_use = false;
+        }
+
+        SearchScratch &operator*() const { return *scratch_; }
+        SearchScratch *operator->() const { return scratch_; }
+    };
+
+
+    // Number of queries whose graph walks are interleaved by searchKnnBatch
+    static const size_t BATCH_SEARCH_INTERLEAVE = 4;
+
+    // State of a query in flight in searchKnnBatch
+    template <typename visited_t>
+    struct BatchQueryState {
+        size_t query_id{0};
+        const char *query{nullptr};  // nullptr if the slot is idle
+        int level{0};  // layer being traversed, the search is in the base layer once it reaches 0
+        tableint cur_obj{0};
+        dist_t cur_dist{0};
+        dist_t lower_bound{0};
+        SearchScratch scratch;  // heaps and link copies of the query
+        visited_t *visited{nullptr};
+        SearchStats *stats{nullptr};  // nullptr unless the work of the query is counted
+    };
+
+
     void setEf(size_t ef) {
         ef_ = ef;
     }
 
 
+    /*
+    * Searches with ef up to max_ef track visited elements in a hash set sized by the number of visited elements
+    * instead of a list over all elements, which is cheaper to reset and to cache on huge indexes. 0 disables it.
+    * The sets are sized for the neighbors of max_ef expanded elements, so this must not run during searches.
+    */
+    void setCompactVisitedMaxEf(size_t max_ef) {
+        if (max_ef == compact_visited_max_ef_)
+            return;
+        size_t expected_visits = std::min(max_ef * maxM0_, max_elements_);
+        expected_visits = std::min(expected_visits, (size_t) std::numeric_limits<int>::max());
+        visited_hash_set_pool_.reset(new VisitedHashSetPool(max_ef > 0 ? 1 : 0, (int) expected_visits));
+        compact_visited_max_ef_ = max_ef;
+    }
+
+
+    /*
+    * Filtered searches whose filter allows at most max_selectivity of the elements walk through allowed elements
+    * only and reach past the others in two hops, which keeps their recall when few elements are allowed.
+    * The selectivity of an IdBitset is its count, the one of a BaseFilterFunctor is estimated on a sample.
+    * 0 disables it.
+    */
+    void setTwoHopMaxSelectivity(double max_selectivity) {
+        two_hop_max_selectivity_ = max_selectivity;
+    }
+
+
+    /*
+    * With filter planning, filtered searches estimate how many elements their filter allows and scan these
+    * elements exactly, see searchKnnExact, when that costs less than the graph search, see preferExactSearch.
+    */
+    void setFilterPlanning(bool enable) {
+        filter_planning_ = enable;
+    }
+
+
+    /*
+    * With dense labels, every label must be below max_elements and the label lookup is an array indexed by label
+    * instead of a hash map: 4 bytes per element and no hashing. Suits labels numbered from 0.
+    * The mode is not saved with the index. Must not run concurrently with any other operation on the index.
+    */
+    void setDenseLabels(bool dense) {
+        for (size_t i = 0; dense && i < cur_element_count; i++) {
+            if (getExternalLabel(i) >= max_elements_)
+                throw std::runtime_error("Cannot use dense labels, a label is not less than max_elements");
+        }
+        label_lookup_.setDense(dense);
+        for (size_t i = 0; i < cur_element_count; i++)
+            label_lookup_.set(getExternalLabel(i), i);
+    }
+
+
     inline std::mutex& getLabelOpMutex(labeltype label) const {
         // calculate hash
         size_t lock_id = label & (MAX_LABEL_OPERATION_LOCKS - 1);
@@ -184,23 +466,65 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
     inline labeltype getExternalLabel(tableint internal_id) const {
         labeltype return_label;
-        memcpy(&return_label, (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), sizeof(labeltype));
+        memcpy(&return_label, (level0_labels_ + internal_id * level0_labels_stride_), sizeof(labeltype));
         return return_label;
     }
 
 
     inline void setExternalLabel(tableint internal_id, labeltype label) const {
-        memcpy((data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), &label, sizeof(labeltype));
+        memcpy((level0_labels_ + internal_id * level0_labels_stride_), &label, sizeof(labeltype));
     }
 
 
     inline labeltype *getExternalLabeLp(tableint internal_id) const {
-        return (labeltype *) (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_);
+        return (labeltype *) (level0_labels_ + internal_id * level0_labels_stride_);
     }
 
 
     inline char *getDataByInternalId(tableint internal_id) const {
-        return (data_level0_memory_ + internal_id * size_data_per_element_ + offsetData_);
+        return (level0_data_ + internal_id * level0_data_stride_);
+    }
+
+
+    // Distance between a point being inserted or a stored element and a stored element, see IndexDistance
+    inline dist_t computeDistance(const void *data_point, const void *element_data) const {
+        return IndexDistance<dist_t, Space>::compute(fstdistfunc_, data_point, element_data, dist_func_param_);
+    }
+
+
+    // Distance between a search query and a stored element
+    inline dist_t computeQueryDistance(const void *query_data, const void *element_data) const {
+        return IndexDistance<dist_t, Space>::compute(fstquerydistfunc_, query_data, element_data, dist_func_param_);
+    }
+
+
+    /*
+    * Distances from a point to the elements ids[0..n) written to dists, with one call of the batch kernel
+    * of the space, or one by one with dist_func when the space has none or the index has a static functor.
+    * Callers keeping only the elements closer than bound pass it with the bounded kernel of the space,
+    * which may leave the distances not below bound as partial sums.
+    */
+    void distanceBatch(DISTBATCHFUNC<dist_t> batch_func, DISTBOUNDEDBATCHFUNC<dist_t> bounded_batch_func,
+                       DISTFUNC<dist_t> dist_func, const void *data_point, const tableint *ids, size_t n,
+                       dist_t bound, std::vector<dist_t> &dists) const {
+        if (dists.size() < n)
+            dists.resize(std::max(n, maxM0_));
+        if (bounded_batch_func != nullptr && bound < std::numeric_limits<dist_t>::max() && std::is_void<Space>::value) {
+            bounded_batch_func(data_point, level0_data_, level0_data_stride_, ids, n, dist_func_param_, bound,
+                               dists.data());
+            return;
+        }
+        if (batch_func != nullptr && std::is_void<Space>::value) {
+            batch_func(data_point, level0_data_, level0_data_stride_, ids, n, dist_func_param_, dists.data());
+            return;
+        }
+        for (size_t j = 0; j < n; j++) {
+#ifdef USE_SSE
+            if (j + 1 < n)
+                _mm_prefetch(getDataByInternalId(ids[j + 1]), _MM_HINT_T0);
+#endif
+            dists[j] = IndexDistance<dist_t, Space>::compute(dist_func, data_point, getDataByInternalId(ids[j]), dist_func_param_);
+        }
     }
 
 
@@ -210,6 +534,31 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         return (int) r;
     }
 
+    struct EntryPoint {
+        tableint node;
+        int level;  // -1 for an empty index
+    };
+
+
+    /*
+    * The entry point and the top level are packed in one word, so they are always read together without locking.
+    * The top level in the high half, the entry point in the low half.
+    */
+    EntryPoint getEntryPoint() const {
+        uint64_t packed = entry_point_.load(std::memory_order_acquire);
+        EntryPoint entry_point;
+        entry_point.node = (tableint) packed;
+        entry_point.level = (int) (uint32_t) (packed >> 32);
+        return entry_point;
+    }
+
+
+    // Publishes a new entry point once its links are in place
+    void setEntryPoint(tableint node, int level) {
+        entry_point_.store(((uint64_t) (uint32_t) level << 32) | node, std::memory_order_release);
+    }
+
+
     size_t getMaxElements() {
         return max_elements_;
     }
@@ -228,64 +577,71 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         vl_type *visited_array = vl->mass;
         vl_type visited_array_tag = vl->curV;
 
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidateSet;
+        std::vector<std::pair<dist_t, tableint>> top_candidates_container;
+        top_candidates_container.reserve(ef_construction_ + 1);
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates(
+            CompareByFirst(), std::move(top_candidates_container));
+        SearchScratchLease scratch;
+        std::vector<std::pair<dist_t, tableint>> &candidateSet = scratch->candidate_set;
 
         dist_t lowerBound;
         if (!isMarkedDeleted(ep_id)) {
-            dist_t dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
+            dist_t dist = computeDistance(data_point, getDataByInternalId(ep_id));
             top_candidates.emplace(dist, ep_id);
             lowerBound = dist;
-            candidateSet.emplace(-dist, ep_id);
+            candidateSet.emplace_back(-dist, ep_id);
         } else {
             lowerBound = std::numeric_limits<dist_t>::max();
-            candidateSet.emplace(-lowerBound, ep_id);
+            candidateSet.emplace_back(-lowerBound, ep_id);
         }
         visited_array[ep_id] = visited_array_tag;
 
         while (!candidateSet.empty()) {
-            std::pair<dist_t, tableint> curr_el_pair = candidateSet.top();
+            std::pair<dist_t, tableint> curr_el_pair = candidateSet.front();
             if ((-curr_el_pair.first) > lowerBound && top_candidates.size() == ef_construction_) {
                 break;
             }
-            candidateSet.pop();
+            std::pop_heap(candidateSet.begin(), candidateSet.end(), CompareByFirst());
+            candidateSet.pop_back();
 
             tableint curNodeNum = curr_el_pair.second;
 
-            std::unique_lock <std::mutex> lock(link_list_locks_[curNodeNum]);
-
-            int *data;  // = (int *)(linkList0_ + curNodeNum * size_links_per_element0_);
-            if (layer == 0) {
-                data = (int*)get_linklist0(curNodeNum);
-            } else {
-                data = (int*)get_linklist(curNodeNum, layer);
-//                    data = (int *) (linkLists_[curNodeNum] + (layer - 1) * size_links_per_element_);
-            }
-            size_t size = getListCount((linklistsizeint*)data);
-            tableint *datal = (tableint *) (data + 1);
+            size_t size = readLinkList(curNodeNum, layer, scratch->links);
+            tableint *datal = scratch->links.data();
 #ifdef USE_SSE
-            _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
-            _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
+            _mm_prefetch((char *) (visited_array + *datal), _MM_HINT_T0);
+            _mm_prefetch((char *) (visited_array + *datal + 64), _MM_HINT_T0);
             _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
             _mm_prefetch(getDataByInternalId(*(datal + 1)), _MM_HINT_T0);
 #endif
 
+            // the unvisited links are moved to the front of the copy and scored with one batch call
+            size_t num_unvisited = 0;
             for (size_t j = 0; j < size; j++) {
                 tableint candidate_id = *(datal + j);
-//                    if (candidate_id == 0) continue;
 #ifdef USE_SSE
                 _mm_prefetch((char *) (visited_array + *(datal + j + 1)), _MM_HINT_T0);
-                _mm_prefetch(getDataByInternalId(*(datal + j + 1)), _MM_HINT_T0);
 #endif
                 if (visited_array[candidate_id] == visited_array_tag) continue;
                 visited_array[candidate_id] = visited_array_tag;
-                char *currObj1 = (getDataByInternalId(candidate_id));
-
-                dist_t dist1 = fstdistfunc_(data_point, currObj1, dist_func_param_);
+#ifdef USE_SSE
+                _mm_prefetch(getDataByInternalId(candidate_id), _MM_HINT_T0);
+#endif
+                datal[num_unvisited++] = candidate_id;
+            }
+            // once the candidates are full, the elements not closer than the worst of them are rejected below
+            dist_t bound = top_candidates.size() >= ef_construction_ ? lowerBound : std::numeric_limits<dist_t>::max();
+            distanceBatch(fstdistbatchfunc_, fstdistboundedbatchfunc_, fstdistfunc_, data_point, datal, num_unvisited,
+                          bound, scratch->dists);
+
+            for (size_t j = 0; j < num_unvisited; j++) {
+                tableint candidate_id = datal[j];
+                dist_t dist1 = scratch->dists[j];
                 if (top_candidates.size() < ef_construction_ || lowerBound > dist1) {
-                    candidateSet.emplace(-dist1, candidate_id);
+                    candidateSet.emplace_back(-dist1, candidate_id);
+                    std::push_heap(candidateSet.begin(), candidateSet.end(), CompareByFirst());
 #ifdef USE_SSE
-                    _mm_prefetch(getDataByInternalId(candidateSet.top().second), _MM_HINT_T0);
+                    _mm_prefetch(getDataByInternalId(candidateSet.front().second), _MM_HINT_T0);
 #endif
 
                     if (!isMarkedDeleted(candidate_id))
@@ -305,6 +661,63 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    // Decides which elements the searches return: not deleted and allowed by the functor, which sees labels
+    struct LabelFilter {
+        const HierarchicalNSW *index;
+        BaseFilterFunctor *isIdAllowed;
+
+        bool operator()(tableint id) const {
+            return !index->isMarkedDeleted(id) && (!isIdAllowed || (*isIdAllowed)(index->getExternalLabel(id)));
+        }
+
+        // First allowed id from id on, end if there is none
+        tableint next(tableint id, tableint end) const {
+            while (id < end && !(*this)(id))
+                id++;
+            return id;
+        }
+    };
+
+
+    // Same for a set of internal ids, check_deleted when deletions may have changed since it was built
+    template <bool check_deleted>
+    struct BitsetFilter {
+        const HierarchicalNSW *index;
+        const IdBitset *allowed_ids;
+
+        bool operator()(tableint id) const {
+            return allowed_ids->test(id) && (!check_deleted || !index->isMarkedDeleted(id));
+        }
+
+        // First allowed id from id on, end if there is none. Skips the ids out of the set a word at a time
+        tableint next(tableint id, tableint end) const {
+            size_t next_id = allowed_ids->next(id);
+            while (check_deleted && next_id < end && index->isMarkedDeleted((tableint) next_id))
+                next_id = allowed_ids->next(next_id + 1);
+            return (tableint) std::min(next_id, (size_t) end);
+        }
+    };
+
+
+    // Same for a predicate on the attribute columns, tested in place on the row of each candidate
+    template <bool check_deleted>
+    struct AttributeFilter {
+        const HierarchicalNSW *index;
+        const std::vector<AttributeCondition> *conditions;
+
+        bool operator()(tableint id) const {
+            return (!check_deleted || !index->isMarkedDeleted(id)) &&
+                   AttributeColumns::matches(index->attributes_.row(id), *conditions);
+        }
+
+        tableint next(tableint id, tableint end) const {
+            while (id < end && !(*this)(id))
+                id++;
+            return id;
+        }
+    };
+
+
     // bare_bone_search means there is no check for deletions and stop condition is ignored in return of extra performance
     template <bool bare_bone_search = true, bool collect_metrics = false>
     std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
@@ -313,130 +726,403 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         const void *data_point,
         size_t ef,
         BaseFilterFunctor* isIdAllowed = nullptr,
-        BaseSearchStopCondition<dist_t>* stop_condition = nullptr) const {
+        BaseSearchStopCondition<dist_t>* stop_condition = nullptr,
+        SearchStats* stats = nullptr) const {
+        SearchScratchLease scratch;
+        searchBaseLayerST<bare_bone_search, collect_metrics>(
+            *scratch, ep_id, data_point, ef, LabelFilter{this, isIdAllowed}, stop_condition, stats);
+        return std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>(
+            CompareByFirst(), scratch->top_candidates);
+    }
+
+
+    /*
+    * Leaves the found elements in scratch.top_candidates, a heap of (distance, id).
+    * Unless bare_bone_search, only the elements passing is_allowed, a LabelFilter or a BitsetFilter, are kept.
+    * With collect_metrics the work of the search is added to stats, otherwise stats is not used.
+    */
+    template <bool bare_bone_search, bool collect_metrics, typename filter_t>
+    void searchBaseLayerST(
+        SearchScratch &scratch,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        BaseSearchStopCondition<dist_t>* stop_condition,
+        SearchStats* stats = nullptr) const {
+        if (ef <= compact_visited_max_ef_) {
+            VisitedHashSet *vs = visited_hash_set_pool_->getFreeVisitedList();
+            searchBaseLayerST<bare_bone_search, collect_metrics>(
+                *vs, scratch, ep_id, data_point, ef, is_allowed, stop_condition, stats);
+            visited_hash_set_pool_->releaseVisitedList(vs);
+            return;
+        }
         VisitedList *vl = visited_list_pool_->getFreeVisitedList();
-        vl_type *visited_array = vl->mass;
-        vl_type visited_array_tag = vl->curV;
+        searchBaseLayerST<bare_bone_search, collect_metrics>(
+            *vl, scratch, ep_id, data_point, ef, is_allowed, stop_condition, stats);
+        visited_list_pool_->releaseVisitedList(vl);
+    }
+
 
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t, typename filter_t>
+    void searchBaseLayerST(
+        visited_t &visited,
+        SearchScratch &scratch,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        BaseSearchStopCondition<dist_t>* stop_condition,
+        SearchStats* stats) const {
+        dist_t lowerBound = startBaseLayerSearch<bare_bone_search, collect_metrics>(
+            visited, scratch, ep_id, data_point, ef, is_allowed, stop_condition, stats);
+        while (expandBaseLayerCandidate<bare_bone_search, collect_metrics>(
+                   visited, scratch, data_point, ef, is_allowed, stop_condition, lowerBound, stats)) {}
+    }
+
+
+    // Puts the entry point into the heaps of scratch and returns the first bound of the search
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t, typename filter_t>
+    dist_t startBaseLayerSearch(
+        visited_t &visited,
+        SearchScratch &scratch,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        BaseSearchStopCondition<dist_t>* stop_condition,
+        SearchStats* stats) const {
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch.top_candidates;
+        std::vector<std::pair<dist_t, tableint>> &candidate_set = scratch.candidate_set;
+        top_candidates.clear();
+        candidate_set.clear();
+        top_candidates.reserve(ef + 1);
+        candidate_set.reserve(maxM0_ + ef);
 
         dist_t lowerBound;
-        if (bare_bone_search || 
-            (!isMarkedDeleted(ep_id) && ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(ep_id))))) {
+        if (bare_bone_search || is_allowed(ep_id)) {
             char* ep_data = getDataByInternalId(ep_id);
-            dist_t dist = fstdistfunc_(data_point, ep_data, dist_func_param_);
+            dist_t dist = computeQueryDistance(data_point, ep_data);
             lowerBound = dist;
-            top_candidates.emplace(dist, ep_id);
+            top_candidates.emplace_back(dist, ep_id);
             if (!bare_bone_search && stop_condition) {
                 stop_condition->add_point_to_result(getExternalLabel(ep_id), ep_data, dist);
             }
-            candidate_set.emplace(-dist, ep_id);
+            candidate_set.emplace_back(-dist, ep_id);
+            if (collect_metrics) {
+                stats->distance_computations++;
+                stats->heap_operations += 2;
+            }
         } else {
             lowerBound = std::numeric_limits<dist_t>::max();
-            candidate_set.emplace(-lowerBound, ep_id);
+            candidate_set.emplace_back(-lowerBound, ep_id);
+            if (collect_metrics)
+                stats->heap_operations++;
         }
 
-        visited_array[ep_id] = visited_array_tag;
+        visited.visit(ep_id);
+        if (collect_metrics)
+            stats->visited_nodes++;
+        return lowerBound;
+    }
 
-        while (!candidate_set.empty()) {
-            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
-            dist_t candidate_dist = -current_node_pair.first;
 
-            bool flag_stop_search;
-            if (bare_bone_search) {
-                flag_stop_search = candidate_dist > lowerBound;
+    /*
+    * One hop of searchBaseLayerST: expands the closest candidate and updates the heaps of scratch and lowerBound.
+    * Returns false, without expanding, when the search is finished. searchKnnBatch interleaves the hops of queries.
+    */
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t, typename filter_t>
+    bool expandBaseLayerCandidate(
+        visited_t &visited,
+        SearchScratch &scratch,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        BaseSearchStopCondition<dist_t>* stop_condition,
+        dist_t &lowerBound,
+        SearchStats* stats) const {
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch.top_candidates;
+        std::vector<std::pair<dist_t, tableint>> &candidate_set = scratch.candidate_set;
+        if (candidate_set.empty())
+            return false;
+
+        std::pair<dist_t, tableint> current_node_pair = candidate_set.front();
+        dist_t candidate_dist = -current_node_pair.first;
+
+        bool flag_stop_search;
+        if (bare_bone_search) {
+            flag_stop_search = candidate_dist > lowerBound;
+        } else {
+            if (stop_condition) {
+                flag_stop_search = stop_condition->should_stop_search(candidate_dist, lowerBound);
             } else {
-                if (stop_condition) {
-                    flag_stop_search = stop_condition->should_stop_search(candidate_dist, lowerBound);
-                } else {
-                    flag_stop_search = candidate_dist > lowerBound && top_candidates.size() == ef;
-                }
-            }
-            if (flag_stop_search) {
-                break;
-            }
-            candidate_set.pop();
-
-            tableint current_node_id = current_node_pair.second;
-            int *data = (int *) get_linklist0(current_node_id);
-            size_t size = getListCount((linklistsizeint*)data);
-//                bool cur_node_deleted = isMarkedDeleted(current_node_id);
-            if (collect_metrics) {
-                metric_hops++;
-                metric_distance_computations+=size;
+                flag_stop_search = candidate_dist > lowerBound && top_candidates.size() == ef;
             }
+        }
+        if (flag_stop_search) {
+            return false;
+        }
+        std::pop_heap(candidate_set.begin(), candidate_set.end(), CompareByFirst());
+        candidate_set.pop_back();
+
+        tableint current_node_id = current_node_pair.second;
+        size_t size = readLinkList(current_node_id, 0, scratch.links);
+        tableint *data = scratch.links.data();
+        if (collect_metrics) {
+            stats->addHop(0);
+            stats->heap_operations++;
+        }
 
 #ifdef USE_SSE
-            _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
-            _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-            _mm_prefetch(data_level0_memory_ + (*(data + 1)) * size_data_per_element_ + offsetData_, _MM_HINT_T0);
-            _mm_prefetch((char *) (data + 2), _MM_HINT_T0);
+        _mm_prefetch((char *) visited.address(*data), _MM_HINT_T0);
+        _mm_prefetch((char *) visited.address(*data) + 64 * sizeof(vl_type), _MM_HINT_T0);
+        _mm_prefetch(getDataByInternalId(*data), _MM_HINT_T0);
 #endif
 
-            for (size_t j = 1; j <= size; j++) {
-                int candidate_id = *(data + j);
-//                    if (candidate_id == 0) continue;
+        // the unvisited links are moved to the front of the copy and scored with one batch call
+        size_t num_unvisited = 0;
+        for (size_t j = 0; j < size; j++) {
+            tableint candidate_id = *(data + j);
 #ifdef USE_SSE
-                _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
-                _mm_prefetch(data_level0_memory_ + (*(data + j + 1)) * size_data_per_element_ + offsetData_,
-                                _MM_HINT_T0);  ////////////
+            _mm_prefetch((char *) visited.address(*(data + j + 1)), _MM_HINT_T0);
 #endif
-                if (!(visited_array[candidate_id] == visited_array_tag)) {
-                    visited_array[candidate_id] = visited_array_tag;
+            if (visited.visit(candidate_id)) {
+#ifdef USE_SSE
+                _mm_prefetch(getDataByInternalId(candidate_id), _MM_HINT_T0);
+#endif
+                data[num_unvisited++] = candidate_id;
+            }
+        }
+        // a stop condition decides itself which candidates it considers, so only plain searches bound the distances
+        dist_t bound = std::numeric_limits<dist_t>::max();
+        if ((bare_bone_search || !stop_condition) && top_candidates.size() >= ef)
+            bound = lowerBound;
+        distanceBatch(fstquerydistbatchfunc_, fstquerydistboundedbatchfunc_, fstquerydistfunc_, data_point, data,
+                      num_unvisited, bound, scratch.dists);
+        if (collect_metrics) {
+            stats->visited_nodes += num_unvisited;
+            stats->distance_computations += num_unvisited;
+        }
 
-                    char *currObj1 = (getDataByInternalId(candidate_id));
-                    dist_t dist = fstdistfunc_(data_point, currObj1, dist_func_param_);
+        for (size_t j = 0; j < num_unvisited; j++) {
+            tableint candidate_id = data[j];
+            char *currObj1 = (getDataByInternalId(candidate_id));
+            dist_t dist = scratch.dists[j];
 
-                    bool flag_consider_candidate;
-                    if (!bare_bone_search && stop_condition) {
-                        flag_consider_candidate = stop_condition->should_consider_candidate(dist, lowerBound);
-                    } else {
-                        flag_consider_candidate = top_candidates.size() < ef || lowerBound > dist;
-                    }
+            bool flag_consider_candidate;
+            if (!bare_bone_search && stop_condition) {
+                flag_consider_candidate = stop_condition->should_consider_candidate(dist, lowerBound);
+            } else {
+                flag_consider_candidate = top_candidates.size() < ef || lowerBound > dist;
+            }
 
-                    if (flag_consider_candidate) {
-                        candidate_set.emplace(-dist, candidate_id);
+            if (flag_consider_candidate) {
+                candidate_set.emplace_back(-dist, candidate_id);
+                std::push_heap(candidate_set.begin(), candidate_set.end(), CompareByFirst());
+                if (collect_metrics)
+                    stats->heap_operations++;
 #ifdef USE_SSE
-                        _mm_prefetch(data_level0_memory_ + candidate_set.top().second * size_data_per_element_ +
-                                        offsetLevel0_,  ///////////
-                                        _MM_HINT_T0);  ////////////////////////
+                _mm_prefetch((char *) get_linklist0(candidate_set.front().second),  ///////////
+                                _MM_HINT_T0);  ////////////////////////
 #endif
 
-                        if (bare_bone_search || 
-                            (!isMarkedDeleted(candidate_id) && ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(candidate_id))))) {
-                            top_candidates.emplace(dist, candidate_id);
-                            if (!bare_bone_search && stop_condition) {
-                                stop_condition->add_point_to_result(getExternalLabel(candidate_id), currObj1, dist);
-                            }
-                        }
-
-                        bool flag_remove_extra = false;
-                        if (!bare_bone_search && stop_condition) {
-                            flag_remove_extra = stop_condition->should_remove_extra();
-                        } else {
-                            flag_remove_extra = top_candidates.size() > ef;
-                        }
-                        while (flag_remove_extra) {
-                            tableint id = top_candidates.top().second;
-                            top_candidates.pop();
-                            if (!bare_bone_search && stop_condition) {
-                                stop_condition->remove_point_from_result(getExternalLabel(id), getDataByInternalId(id), dist);
-                                flag_remove_extra = stop_condition->should_remove_extra();
-                            } else {
-                                flag_remove_extra = top_candidates.size() > ef;
-                            }
-                        }
+                if (bare_bone_search || is_allowed(candidate_id)) {
+                    top_candidates.emplace_back(dist, candidate_id);
+                    std::push_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+                    if (collect_metrics)
+                        stats->heap_operations++;
+                    if (!bare_bone_search && stop_condition) {
+                        stop_condition->add_point_to_result(getExternalLabel(candidate_id), currObj1, dist);
+                    }
+                }
 
-                        if (!top_candidates.empty())
-                            lowerBound = top_candidates.top().first;
+                bool flag_remove_extra = false;
+                if (!bare_bone_search && stop_condition) {
+                    flag_remove_extra = stop_condition->should_remove_extra();
+                } else {
+                    flag_remove_extra = top_candidates.size() > ef;
+                }
+                while (flag_remove_extra) {
+                    tableint id = top_candidates.front().second;
+                    std::pop_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+                    top_candidates.pop_back();
+                    if (collect_metrics)
+                        stats->heap_operations++;
+                    if (!bare_bone_search && stop_condition) {
+                        stop_condition->remove_point_from_result(getExternalLabel(id), getDataByInternalId(id), dist);
+                        flag_remove_extra = stop_condition->should_remove_extra();
+                    } else {
+                        flag_remove_extra = top_candidates.size() > ef;
                     }
                 }
+
+                if (!top_candidates.empty())
+                    lowerBound = top_candidates.front().first;
             }
         }
+        return true;
+    }
+
 
+    /*
+    * Base layer search for the filters allowing few elements, in the spirit of ACORN-1: the walk goes through
+    * allowed elements only and computes no distance to the others. The neighbors of an expanded element are its
+    * allowed links, then the allowed links of its other links, until there are maxM0_ of them.
+    * Leaves the found elements in scratch.top_candidates, like searchBaseLayerST.
+    */
+    template <bool collect_metrics, typename filter_t>
+    void searchBaseLayerTwoHop(
+        SearchScratch &scratch,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        SearchStats* stats) const {
+        if (ef <= compact_visited_max_ef_) {
+            VisitedHashSet *vs = visited_hash_set_pool_->getFreeVisitedList();
+            searchBaseLayerTwoHop<collect_metrics>(*vs, scratch, ep_id, data_point, ef, is_allowed, stats);
+            visited_hash_set_pool_->releaseVisitedList(vs);
+            return;
+        }
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        searchBaseLayerTwoHop<collect_metrics>(*vl, scratch, ep_id, data_point, ef, is_allowed, stats);
         visited_list_pool_->releaseVisitedList(vl);
-        return top_candidates;
+    }
+
+
+    template <bool collect_metrics, typename visited_t, typename filter_t>
+    void searchBaseLayerTwoHop(
+        visited_t &visited,
+        SearchScratch &scratch,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        SearchStats* stats) const {
+        dist_t lowerBound = startTwoHopSearch<collect_metrics>(visited, scratch, ep_id, data_point, ef, is_allowed, stats);
+        while (expandTwoHopCandidate<collect_metrics>(visited, scratch, data_point, ef, is_allowed, lowerBound, stats)) {}
+    }
+
+
+    // Same as startBaseLayerSearch for searchBaseLayerTwoHop
+    template <bool collect_metrics, typename visited_t, typename filter_t>
+    dist_t startTwoHopSearch(
+        visited_t &visited,
+        SearchScratch &scratch,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        SearchStats* stats) const {
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch.top_candidates;
+        std::vector<std::pair<dist_t, tableint>> &candidate_set = scratch.candidate_set;
+        std::vector<tableint> &neighbors = scratch.neighbors;
+        top_candidates.clear();
+        candidate_set.clear();
+        top_candidates.reserve(ef + 1);
+        candidate_set.reserve(maxM0_ + ef);
+        // the links of the last disallowed link may overshoot the limit
+        if (neighbors.size() < 2 * maxM0_)
+            neighbors.resize(2 * maxM0_);
+
+        // the walk starts from the entry point even when it is not allowed
+        dist_t dist = computeQueryDistance(data_point, getDataByInternalId(ep_id));
+        dist_t lowerBound = std::numeric_limits<dist_t>::max();
+        if (is_allowed(ep_id)) {
+            lowerBound = dist;
+            top_candidates.emplace_back(dist, ep_id);
+        }
+        candidate_set.emplace_back(-dist, ep_id);
+        visited.visit(ep_id);
+        if (collect_metrics) {
+            stats->distance_computations++;
+            stats->visited_nodes++;
+            stats->heap_operations += top_candidates.size() + 1;
+        }
+        return lowerBound;
+    }
+
+
+    // Same as expandBaseLayerCandidate for searchBaseLayerTwoHop
+    template <bool collect_metrics, typename visited_t, typename filter_t>
+    bool expandTwoHopCandidate(
+        visited_t &visited,
+        SearchScratch &scratch,
+        const void *data_point,
+        size_t ef,
+        const filter_t &is_allowed,
+        dist_t &lowerBound,
+        SearchStats* stats) const {
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch.top_candidates;
+        std::vector<std::pair<dist_t, tableint>> &candidate_set = scratch.candidate_set;
+        std::vector<tableint> &neighbors = scratch.neighbors;
+        if (candidate_set.empty())
+            return false;
+
+        std::pair<dist_t, tableint> current_node_pair = candidate_set.front();
+        if (-current_node_pair.first > lowerBound && top_candidates.size() == ef)
+            return false;
+        std::pop_heap(candidate_set.begin(), candidate_set.end(), CompareByFirst());
+        candidate_set.pop_back();
+
+        size_t size = readLinkList(current_node_pair.second, 0, scratch.links);
+        tableint *data = scratch.links.data();
+        if (collect_metrics) {
+            stats->addHop(0);
+            stats->heap_operations++;
+        }
+
+        // the disallowed links are moved to the front of the copy, their links are the second hop
+        size_t num_neighbors = 0;
+        size_t num_disallowed = 0;
+        for (size_t j = 0; j < size; j++) {
+            tableint candidate_id = data[j];
+            if (!is_allowed(candidate_id)) {
+                data[num_disallowed++] = candidate_id;
+            } else if (visited.visit(candidate_id)) {
+                neighbors[num_neighbors++] = candidate_id;
+            }
+        }
+        for (size_t j = 0; j < num_disallowed && num_neighbors < maxM0_; j++) {
+            if (!visited.visit(data[j]))
+                continue;
+            size_t hop_size = readLinkList(data[j], 0, scratch.hop_links);
+            if (collect_metrics)
+                stats->visited_nodes++;
+            for (size_t l = 0; l < hop_size; l++) {
+                tableint candidate_id = scratch.hop_links[l];
+                if (is_allowed(candidate_id) && visited.visit(candidate_id))
+                    neighbors[num_neighbors++] = candidate_id;
+            }
+        }
+
+        dist_t bound = top_candidates.size() >= ef ? lowerBound : std::numeric_limits<dist_t>::max();
+        distanceBatch(fstquerydistbatchfunc_, fstquerydistboundedbatchfunc_, fstquerydistfunc_, data_point,
+                      neighbors.data(), num_neighbors, bound, scratch.dists);
+        if (collect_metrics) {
+            stats->visited_nodes += num_neighbors;
+            stats->distance_computations += num_neighbors;
+        }
+
+        for (size_t j = 0; j < num_neighbors; j++) {
+            dist_t dist = scratch.dists[j];
+            if (top_candidates.size() < ef || lowerBound > dist) {
+                candidate_set.emplace_back(-dist, neighbors[j]);
+                std::push_heap(candidate_set.begin(), candidate_set.end(), CompareByFirst());
+                top_candidates.emplace_back(dist, neighbors[j]);
+                std::push_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+                if (collect_metrics)
+                    stats->heap_operations += 2;
+                if (top_candidates.size() > ef) {
+                    std::pop_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+                    top_candidates.pop_back();
+                    if (collect_metrics)
+                        stats->heap_operations++;
+                }
+                lowerBound = top_candidates.front().first;
+            }
+        }
+        return true;
     }
 
 
@@ -464,9 +1150,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
             for (std::pair<dist_t, tableint> second_pair : return_list) {
                 dist_t curdist =
-                        fstdistfunc_(getDataByInternalId(second_pair.second),
-                                        getDataByInternalId(curent_pair.second),
-                                        dist_func_param_);
+                        computeDistance(getDataByInternalId(second_pair.second), getDataByInternalId(curent_pair.second));
                 if (curdist < dist_to_query) {
                     good = false;
                     break;
@@ -484,12 +1168,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
 
     linklistsizeint *get_linklist0(tableint internal_id) const {
-        return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
-    }
-
-
-    linklistsizeint *get_linklist0(tableint internal_id, char *data_level0_memory_) const {
-        return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
+        return (linklistsizeint *) (level0_links_ + internal_id * level0_links_stride_);
     }
 
 
@@ -524,19 +1203,14 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         tableint next_closest_entry_point = selectedNeighbors.back();
 
         {
-            // lock only during the update
-            // because during the addition the lock for cur_c is already acquired
-            std::unique_lock <std::mutex> lock(link_list_locks_[cur_c], std::defer_lock);
-            if (isUpdate) {
-                lock.lock();
-            }
+            LinkListLock lock(this, cur_c);
             linklistsizeint *ll_cur;
             if (level == 0)
                 ll_cur = get_linklist0(cur_c);
             else
                 ll_cur = get_linklist(cur_c, level);
 
-            if (*ll_cur && !isUpdate) {
+            if (getListCount(ll_cur) && !isUpdate) {
                 throw std::runtime_error("The newly inserted element should have blank link list");
             }
             setListCount(ll_cur, selectedNeighbors.size());
@@ -552,7 +1226,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         }
 
         for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
-            std::unique_lock <std::mutex> lock(link_list_locks_[selectedNeighbors[idx]]);
+            LinkListLock lock(this, selectedNeighbors[idx]);
 
             linklistsizeint *ll_other;
             if (level == 0)
@@ -588,16 +1262,14 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     setListCount(ll_other, sz_link_list_other + 1);
                 } else {
                     // finding the "weakest" element to replace it with the new one
-                    dist_t d_max = fstdistfunc_(getDataByInternalId(cur_c), getDataByInternalId(selectedNeighbors[idx]),
-                                                dist_func_param_);
+                    dist_t d_max = computeDistance(getDataByInternalId(cur_c), getDataByInternalId(selectedNeighbors[idx]));
                     // Heuristic:
                     std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
                     candidates.emplace(d_max, cur_c);
 
                     for (size_t j = 0; j < sz_link_list_other; j++) {
                         candidates.emplace(
-                                fstdistfunc_(getDataByInternalId(data[j]), getDataByInternalId(selectedNeighbors[idx]),
-                                                dist_func_param_), data[j]);
+                                computeDistance(getDataByInternalId(data[j]), getDataByInternalId(selectedNeighbors[idx])), data[j]);
                     }
 
                     getNeighborsByHeuristic2(candidates, Mcurmax);
@@ -631,20 +1303,38 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
 
     void resizeIndex(size_t new_max_elements) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot resize, the index is read-only");
         if (new_max_elements < cur_element_count)
             throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
 
         visited_list_pool_.reset(new VisitedListPool(1, new_max_elements));
 
         element_levels_.resize(new_max_elements);
-
-        std::vector<std::mutex>(new_max_elements).swap(link_list_locks_);
+        label_lookup_.resize(new_max_elements);
+        attributes_.resize(new_max_elements);
 
         // Reallocate base layer
-        char * data_level0_memory_new = (char *) realloc(data_level0_memory_, new_max_elements * size_data_per_element_);
-        if (data_level0_memory_new == nullptr)
-            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate base layer");
-        data_level0_memory_ = data_level0_memory_new;
+        if (level0_layout_ == Level0Layout::INTERLEAVED && allocator_ == nullptr) {
+            char * data_level0_memory_new = (char *) realloc(data_level0_memory_, new_max_elements * size_data_per_element_);
+            if (data_level0_memory_new == nullptr)
+                throw std::runtime_error("Not enough memory: resizeIndex failed to allocate base layer");
+            data_level0_memory_ = data_level0_memory_new;
+            setLevel0Fields();
+        } else {
+            char *data_level0_memory_old = data_level0_memory_;
+            char *vectors_level0_memory_old = vectors_level0_memory_;
+            char *labels_level0_memory_old = labels_level0_memory_;
+            allocateLevel0(new_max_elements);
+            if (level0_layout_ == Level0Layout::INTERLEAVED) {
+                memcpy(data_level0_memory_, data_level0_memory_old, cur_element_count * size_data_per_element_);
+            } else {
+                memcpy(data_level0_memory_, data_level0_memory_old, cur_element_count * size_links_level0_);
+                memcpy(vectors_level0_memory_, vectors_level0_memory_old, cur_element_count * data_size_);
+                memcpy(labels_level0_memory_, labels_level0_memory_old, cur_element_count * sizeof(labeltype));
+            }
+            freeLevel0(data_level0_memory_old, vectors_level0_memory_old, labels_level0_memory_old);
+        }
 
         // Reallocate all other layers
         char ** linkLists_new = (char **) realloc(linkLists_, sizeof(void *) * new_max_elements);
@@ -655,6 +1345,143 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         max_elements_ = new_max_elements;
     }
 
+    /*
+    * Renumbers the internal ids so that neighbors in the graph get close ids, and so close rows of the base layer.
+    * The search returns the same results afterwards, only faster thanks to fewer cache and TLB misses.
+    * The new order is kept by saveIndex. Must not run concurrently with any other operation on the index.
+    */
+    void reorderGraph(GraphOrder order = GraphOrder::BFS) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot reorder, the index is read-only");
+        size_t count = cur_element_count;
+        if (count < 2)
+            return;
+
+        // new_to_old[new_id] = old_id
+        std::vector<tableint> new_to_old = order == GraphOrder::RCM ? getRCMOrder() : getBFSOrder();
+        std::vector<tableint> old_to_new(count);
+        for (tableint i = 0; i < count; i++)
+            old_to_new[new_to_old[i]] = i;
+
+        auto remap_list = [&](linklistsizeint *ll) {
+            tableint *data = (tableint *) (ll + 1);
+            size_t size = getListCount(ll);
+            for (size_t j = 0; j < size; j++)
+                data[j] = old_to_new[data[j]];
+        };
+
+        // the fields of the old base layer keep their strides in the new one
+        char *data_level0_memory_old = data_level0_memory_;
+        char *vectors_level0_memory_old = vectors_level0_memory_;
+        char *labels_level0_memory_old = labels_level0_memory_;
+        char *links_old = level0_links_, *data_old = level0_data_, *labels_old = level0_labels_;
+        allocateLevel0(max_elements_);
+
+        std::vector<char *> link_lists_new(count);
+        std::vector<int> element_levels_new(count);
+        for (tableint i = 0; i < count; i++) {
+            tableint old_id = new_to_old[i];
+            memcpy(get_linklist0(i), links_old + old_id * level0_links_stride_, size_links_level0_);
+            memcpy(getDataByInternalId(i), data_old + old_id * level0_data_stride_, data_size_);
+            memcpy(getExternalLabeLp(i), labels_old + old_id * level0_labels_stride_, sizeof(labeltype));
+            remap_list(get_linklist0(i));
+            link_lists_new[i] = linkLists_[old_id];
+            element_levels_new[i] = element_levels_[old_id];
+            for (int level = 1; level <= element_levels_new[i]; level++)
+                remap_list((linklistsizeint *) (link_lists_new[i] + (level - 1) * size_links_per_element_));
+        }
+
+        freeLevel0(data_level0_memory_old, vectors_level0_memory_old, labels_level0_memory_old);
+        std::copy(link_lists_new.begin(), link_lists_new.end(), linkLists_);
+        std::copy(element_levels_new.begin(), element_levels_new.end(), element_levels_.begin());
+        EntryPoint entry_point = getEntryPoint();
+        setEntryPoint(old_to_new[entry_point.node], entry_point.level);
+
+        for (size_t i = 0; i < count; i++)
+            label_lookup_.set(getExternalLabel(i), i);
+        if (attributes_.numColumns())
+            attributes_.permute(new_to_old);
+        std::unordered_set<tableint> deleted_elements_new;
+        for (tableint id : deleted_elements)
+            deleted_elements_new.insert(old_to_new[id]);
+        deleted_elements.swap(deleted_elements_new);
+    }
+
+
+    std::vector<tableint> getBFSOrder() const {
+        size_t count = cur_element_count;
+        std::vector<tableint> order;
+        order.reserve(count);
+        std::vector<bool> visited(count, false);
+
+        // elements unreachable from the entry point start new traversals in id order
+        tableint next_start = 0;
+        tableint start = getEntryPoint().node;
+        while (order.size() < count) {
+            size_t head = order.size();
+            visited[start] = true;
+            order.push_back(start);
+            while (head < order.size()) {
+                linklistsizeint *ll = get_linklist0(order[head++]);
+                tableint *data = (tableint *) (ll + 1);
+                size_t size = getListCount(ll);
+                for (size_t j = 0; j < size; j++) {
+                    if (!visited[data[j]]) {
+                        visited[data[j]] = true;
+                        order.push_back(data[j]);
+                    }
+                }
+            }
+            while (next_start < count && visited[next_start])
+                next_start++;
+            start = next_start;
+        }
+        return order;
+    }
+
+
+    std::vector<tableint> getRCMOrder() const {
+        size_t count = cur_element_count;
+        std::vector<tableint> order;
+        order.reserve(count);
+        std::vector<bool> visited(count, false);
+
+        std::vector<tableint> by_degree(count);
+        for (tableint i = 0; i < count; i++)
+            by_degree[i] = i;
+        auto degree = [&](tableint id) { return getListCount(get_linklist0(id)); };
+        std::stable_sort(by_degree.begin(), by_degree.end(), [&](tableint a, tableint b) {
+            return degree(a) < degree(b);
+        });
+
+        std::vector<tableint> neighbors;
+        for (tableint start : by_degree) {
+            if (visited[start])
+                continue;
+            size_t head = order.size();
+            visited[start] = true;
+            order.push_back(start);
+            while (head < order.size()) {
+                linklistsizeint *ll = get_linklist0(order[head++]);
+                tableint *data = (tableint *) (ll + 1);
+                neighbors.clear();
+                for (size_t j = 0; j < getListCount(ll); j++) {
+                    if (!visited[data[j]]) {
+                        visited[data[j]] = true;
+                        neighbors.push_back(data[j]);
+                    }
+                }
+                std::stable_sort(neighbors.begin(), neighbors.end(), [&](tableint a, tableint b) {
+                    return degree(a) < degree(b);
+                });
+                order.insert(order.end(), neighbors.begin(), neighbors.end());
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+
     size_t indexFileSize() const {
         size_t size = 0;
         size += sizeof(offsetLevel0_);
@@ -663,8 +1490,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         size += sizeof(size_data_per_element_);
         size += sizeof(label_offset_);
         size += sizeof(offsetData_);
-        size += sizeof(maxlevel_);
-        size += sizeof(enterpoint_node_);
+        size += sizeof(int);  // max level
+        size += sizeof(tableint);  // entry point
         size += sizeof(maxM_);
 
         size += sizeof(maxM0_);
@@ -679,10 +1506,111 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             size += sizeof(linkListSize);
             size += linkListSize;
         }
+        size += extensionsSize();
         return size;
     }
 
+
+    /*
+    * Sections saved after the upper layer link lists: EXTENSIONS_MAGIC, then for each section
+    * its id (uint32_t), the size of its contents (uint64_t) and its contents.
+    * An index that needs no section is saved exactly as before sections existed.
+    */
+    static const uint64_t EXTENSIONS_MAGIC = 0x3154584557534e48ULL;  // "HNSWEXT1"
+    static const uint32_t SECTION_LEVEL0_LAYOUT = 1;  // contents: Level0Layout as uint32_t
+    // contents: the number of columns and their widths as uint32_t, then the rows of the elements
+    static const uint32_t SECTION_ATTRIBUTES = 2;
+
+
+    size_t attributesSectionSize() const {
+        return sizeof(uint32_t) * (1 + attributes_.numColumns()) + cur_element_count * attributes_.rowSize();
+    }
+
+
+    size_t extensionsSize() const {
+        size_t size = 0;
+        if (level0_layout_ != Level0Layout::INTERLEAVED)
+            size += sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+        if (attributes_.numColumns())
+            size += sizeof(uint32_t) + sizeof(uint64_t) + attributesSectionSize();
+        return size ? sizeof(uint64_t) + size : 0;
+    }
+
+
+    void writeExtensions(std::ostream &output) const {
+        if (extensionsSize() == 0)
+            return;
+        writeBinaryPOD(output, (uint64_t) EXTENSIONS_MAGIC);
+        if (level0_layout_ != Level0Layout::INTERLEAVED) {
+            writeBinaryPOD(output, (uint32_t) SECTION_LEVEL0_LAYOUT);
+            writeBinaryPOD(output, (uint64_t) sizeof(uint32_t));
+            writeBinaryPOD(output, (uint32_t) level0_layout_);
+        }
+        if (attributes_.numColumns()) {
+            writeBinaryPOD(output, (uint32_t) SECTION_ATTRIBUTES);
+            writeBinaryPOD(output, (uint64_t) attributesSectionSize());
+            writeBinaryPOD(output, (uint32_t) attributes_.numColumns());
+            for (size_t column = 0; column < attributes_.numColumns(); column++)
+                writeBinaryPOD(output, (uint32_t) attributes_.width(column));
+            output.write(attributes_.row(0), cur_element_count * attributes_.rowSize());
+        }
+    }
+
+
+    // Reads the sections stored between input and input_end, skipping the ones unknown to this version
+    void readExtensions(const char *input, const char *input_end) {
+        if (input == input_end)
+            return;
+        uint64_t magic;
+        readBinaryPOD(input, input_end, magic);
+        if (magic != EXTENSIONS_MAGIC)
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        while (input != input_end) {
+            uint32_t section_id;
+            uint64_t section_size;
+            readBinaryPOD(input, input_end, section_id);
+            readBinaryPOD(input, input_end, section_size);
+            if ((uint64_t) (input_end - input) < section_size)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+            const char *section = input;
+            const char *section_end = input + section_size;
+            input = section_end;
+
+            if (section_id == SECTION_LEVEL0_LAYOUT) {
+                uint32_t layout;
+                readBinaryPOD(section, section_end, layout);
+                if (layout > (uint32_t) Level0Layout::SPLIT)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                level0_layout_ = (Level0Layout) layout;
+            } else if (section_id == SECTION_ATTRIBUTES) {
+                uint32_t num_columns;
+                readBinaryPOD(section, section_end, num_columns);
+                attributes_ = AttributeColumns();
+                for (uint32_t column = 0; column < num_columns; column++) {
+                    uint32_t width;
+                    readBinaryPOD(section, section_end, width);
+                    attributes_.addColumn(width, max_elements_);
+                }
+                if ((size_t) (section_end - section) != cur_element_count * attributes_.rowSize())
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                memcpy(attributes_.row(0), section, cur_element_count * attributes_.rowSize());
+            }
+        }
+    }
+
+
+    // The three arrays of the split layout take the space of the rows of the interleaved layout
+    void checkLevel0Layout() const {
+        if (level0_layout_ == Level0Layout::SPLIT &&
+            size_data_per_element_ != size_links_level0_ + data_size_ + sizeof(labeltype))
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+    }
+
     void saveIndex(const std::string &location) {
+        // truncating the file would invalidate the mapping the index is read from
+        if (mapped_file_ && mapped_file_->location() == location)
+            throw std::runtime_error("Cannot save the index into the file it is mapped from");
+
         std::ofstream output(location, std::ios::binary);
         std::streampos position;
 
@@ -692,8 +1620,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         writeBinaryPOD(output, size_data_per_element_);
         writeBinaryPOD(output, label_offset_);
         writeBinaryPOD(output, offsetData_);
-        writeBinaryPOD(output, maxlevel_);
-        writeBinaryPOD(output, enterpoint_node_);
+        EntryPoint entry_point = getEntryPoint();
+        writeBinaryPOD(output, entry_point.level);
+        writeBinaryPOD(output, entry_point.node);
         writeBinaryPOD(output, maxM_);
 
         writeBinaryPOD(output, maxM0_);
@@ -701,7 +1630,13 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         writeBinaryPOD(output, mult_);
         writeBinaryPOD(output, ef_construction_);
 
-        output.write(data_level0_memory_, cur_element_count * size_data_per_element_);
+        if (level0_layout_ == Level0Layout::INTERLEAVED) {
+            output.write(data_level0_memory_, cur_element_count * size_data_per_element_);
+        } else {
+            output.write(data_level0_memory_, cur_element_count * size_links_level0_);
+            output.write(vectors_level0_memory_, cur_element_count * data_size_);
+            output.write(labels_level0_memory_, cur_element_count * sizeof(labeltype));
+        }
 
         for (size_t i = 0; i < cur_element_count; i++) {
             unsigned int linkListSize = element_levels_[i] > 0 ? size_links_per_element_ * element_levels_[i] : 0;
@@ -709,6 +1644,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             if (linkListSize)
                 output.write(linkLists_[i], linkListSize);
         }
+        writeExtensions(output);
         output.close();
     }
 
@@ -728,6 +1664,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         readBinaryPOD(input, offsetLevel0_);
         readBinaryPOD(input, max_elements_);
         readBinaryPOD(input, cur_element_count);
+        published_element_count_ = cur_element_count.load();
 
         size_t max_elements = max_elements_i;
         if (max_elements < cur_element_count)
@@ -736,8 +1673,10 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         readBinaryPOD(input, size_data_per_element_);
         readBinaryPOD(input, label_offset_);
         readBinaryPOD(input, offsetData_);
-        readBinaryPOD(input, maxlevel_);
-        readBinaryPOD(input, enterpoint_node_);
+        EntryPoint entry_point;
+        readBinaryPOD(input, entry_point.level);
+        readBinaryPOD(input, entry_point.node);
+        setEntryPoint(entry_point.node, entry_point.level);
 
         readBinaryPOD(input, maxM_);
         readBinaryPOD(input, maxM0_);
@@ -746,8 +1685,15 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         readBinaryPOD(input, ef_construction_);
 
         data_size_ = s->get_data_size();
+        query_data_size_ = s->get_query_data_size();
         fstdistfunc_ = s->get_dist_func();
+        fstquerydistfunc_ = s->get_query_dist_func();
+        fstdistbatchfunc_ = s->get_dist_batch_func();
+        fstquerydistbatchfunc_ = s->get_query_dist_batch_func();
+        fstdistboundedbatchfunc_ = s->get_dist_bounded_batch_func();
+        fstquerydistboundedbatchfunc_ = s->get_query_dist_bounded_batch_func();
         dist_func_param_ = s->get_dist_func_param();
+        IndexDistance<dist_t, Space>::checkSpace(data_size_, dist_func_param_);
 
         auto pos = input.tellg();
 
@@ -766,23 +1712,32 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         }
 
         // throw exception if it either corrupted or old index
-        if (input.tellg() != total_filesize)
+        if (input.tellg() < 0 || input.tellg() > total_filesize)
             throw std::runtime_error("Index seems to be corrupted or unsupported");
 
+        std::vector<char> extensions((size_t) (total_filesize - input.tellg()));
+        input.read(extensions.data(), extensions.size());
+        level0_layout_ = Level0Layout::INTERLEAVED;
+        readExtensions(extensions.data(), extensions.data() + extensions.size());
+
         input.clear();
         /// Optional check end
 
         input.seekg(pos, input.beg);
 
-        data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);
-        if (data_level0_memory_ == nullptr)
-            throw std::runtime_error("Not enough memory: loadIndex failed to allocate level0");
-        input.read(data_level0_memory_, cur_element_count * size_data_per_element_);
-
         size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
 
         size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
-        std::vector<std::mutex>(max_elements).swap(link_list_locks_);
+        checkLevel0Layout();
+
+        allocateLevel0(max_elements);
+        if (level0_layout_ == Level0Layout::INTERLEAVED) {
+            input.read(data_level0_memory_, cur_element_count * size_data_per_element_);
+        } else {
+            input.read(data_level0_memory_, cur_element_count * size_links_level0_);
+            input.read(vectors_level0_memory_, cur_element_count * data_size_);
+            input.read(labels_level0_memory_, cur_element_count * sizeof(labeltype));
+        }
         std::vector<std::mutex>(MAX_LABEL_OPERATION_LOCKS).swap(label_op_locks_);
 
         visited_list_pool_.reset(new VisitedListPool(1, max_elements));
@@ -791,10 +1746,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         if (linkLists_ == nullptr)
             throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklists");
         element_levels_ = std::vector<int>(max_elements);
+        label_lookup_.resize(max_elements);
+        link_list_seqs_.reset(new std::atomic<uint32_t>[LINK_LIST_SEQ_STRIPES]());
         revSize_ = 1.0 / mult_;
         ef_ = 10;
         for (size_t i = 0; i < cur_element_count; i++) {
-            label_lookup_[getExternalLabel(i)] = i;
+            label_lookup_.set(getExternalLabel(i), i);
             unsigned int linkListSize;
             readBinaryPOD(input, linkListSize);
             if (linkListSize == 0) {
@@ -822,18 +1779,114 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Opens an index saved by saveIndex without copying it: the file is memory mapped read-only,
+    * and the level 0 block and the upper level link lists point directly into the mapping.
+    * The index can be searched but not modified, and its capacity equals the number of stored elements.
+    */
+    void loadIndexMapped(const std::string &location, SpaceInterface<dist_t> *s) {
+        std::unique_ptr<MappedFile> mapped_file(new MappedFile(location));
+
+        clear();
+        mapped_file_ = std::move(mapped_file);
+
+        const char *input = mapped_file_->data();
+        const char *input_end = input + mapped_file_->size();
+
+        readBinaryPOD(input, input_end, offsetLevel0_);
+        readBinaryPOD(input, input_end, max_elements_);
+        readBinaryPOD(input, input_end, cur_element_count);
+        published_element_count_ = cur_element_count.load();
+        readBinaryPOD(input, input_end, size_data_per_element_);
+        readBinaryPOD(input, input_end, label_offset_);
+        readBinaryPOD(input, input_end, offsetData_);
+        EntryPoint entry_point;
+        readBinaryPOD(input, input_end, entry_point.level);
+        readBinaryPOD(input, input_end, entry_point.node);
+        setEntryPoint(entry_point.node, entry_point.level);
+
+        readBinaryPOD(input, input_end, maxM_);
+        readBinaryPOD(input, input_end, maxM0_);
+        readBinaryPOD(input, input_end, M_);
+        readBinaryPOD(input, input_end, mult_);
+        readBinaryPOD(input, input_end, ef_construction_);
+
+        max_elements_ = cur_element_count;
+
+        data_size_ = s->get_data_size();
+        query_data_size_ = s->get_query_data_size();
+        fstdistfunc_ = s->get_dist_func();
+        fstquerydistfunc_ = s->get_query_dist_func();
+        fstdistbatchfunc_ = s->get_dist_batch_func();
+        fstquerydistbatchfunc_ = s->get_query_dist_batch_func();
+        fstdistboundedbatchfunc_ = s->get_dist_bounded_batch_func();
+        fstquerydistboundedbatchfunc_ = s->get_query_dist_bounded_batch_func();
+        dist_func_param_ = s->get_dist_func_param();
+        IndexDistance<dist_t, Space>::checkSpace(data_size_, dist_func_param_);
+
+        if (size_data_per_element_ == 0 || (size_t) (input_end - input) / size_data_per_element_ < cur_element_count)
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        const char *level0_input = input;
+        input += cur_element_count * size_data_per_element_;
+
+        size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
+
+        size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
+        std::vector<std::mutex>(MAX_LABEL_OPERATION_LOCKS).swap(label_op_locks_);
+
+        visited_list_pool_.reset(new VisitedListPool(1, max_elements_));
+
+        linkLists_ = (char **) malloc(sizeof(void *) * max_elements_);
+        if (linkLists_ == nullptr && max_elements_ > 0)
+            throw std::runtime_error("Not enough memory: loadIndexMapped failed to allocate linklists");
+        element_levels_ = std::vector<int>(max_elements_);
+        revSize_ = 1.0 / mult_;
+        ef_ = 10;
+        for (size_t i = 0; i < cur_element_count; i++) {
+            unsigned int linkListSize;
+            readBinaryPOD(input, input_end, linkListSize);
+            if (linkListSize == 0) {
+                element_levels_[i] = 0;
+                linkLists_[i] = nullptr;
+            } else {
+                if ((size_t) (input_end - input) < linkListSize)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                element_levels_[i] = linkListSize / size_links_per_element_;
+                linkLists_[i] = (char *) input;
+                input += linkListSize;
+            }
+        }
+
+        level0_layout_ = Level0Layout::INTERLEAVED;
+        readExtensions(input, input_end);
+        checkLevel0Layout();
+        data_level0_memory_ = (char *) level0_input;
+        if (level0_layout_ == Level0Layout::SPLIT) {
+            vectors_level0_memory_ = data_level0_memory_ + cur_element_count * size_links_level0_;
+            labels_level0_memory_ = vectors_level0_memory_ + cur_element_count * data_size_;
+        }
+        setLevel0Fields();
+
+        label_lookup_.resize(max_elements_);
+        for (size_t i = 0; i < cur_element_count; i++) {
+            label_lookup_.set(getExternalLabel(i), i);
+            if (isMarkedDeleted(i)) {
+                num_deleted_ += 1;
+                if (allow_replace_deleted_) deleted_elements.insert(i);
+            }
+        }
+    }
+
+
     template<typename data_t>
     std::vector<data_t> getDataByLabel(labeltype label) const {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
         
-        std::unique_lock <std::mutex> lock_table(label_lookup_lock);
-        auto search = label_lookup_.find(label);
-        if (search == label_lookup_.end() || isMarkedDeleted(search->second)) {
+        tableint internalId;
+        if (!label_lookup_.find(label, internalId) || isMarkedDeleted(internalId)) {
             throw std::runtime_error("Label not found");
         }
-        tableint internalId = search->second;
-        lock_table.unlock();
 
         char* data_ptrv = getDataByInternalId(internalId);
         size_t dim = *((size_t *) dist_func_param_);
@@ -854,28 +1907,128 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
 
-        std::unique_lock <std::mutex> lock_table(label_lookup_lock);
-        auto search = label_lookup_.find(label);
-        if (search == label_lookup_.end()) {
+        tableint internalId;
+        if (!label_lookup_.find(label, internalId)) {
             throw std::runtime_error("Label not found");
         }
-        tableint internalId = search->second;
-        lock_table.unlock();
 
         markDeletedInternal(internalId);
     }
 
 
+    // Backs off in a spin loop, giving the core away after a while
+    static void spinWait(size_t spins) {
+        if (spins < 64) {
+#ifdef USE_SSE
+            _mm_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+
+    /*
+    * Sequence number of the link lists of an element at all levels. It is odd while a writer holds the lock
+    * of the lists. The elements whose ids are equal modulo LINK_LIST_SEQ_STRIPES share it, so the table keeps
+    * its size when the index grows; a write to one of them only makes the readers of the others retry.
+    * nullptr for read-only indexes, whose links never change.
+    */
+    std::atomic<uint32_t> *getLinkListSeq(tableint internal_id) const {
+        if (!link_list_seqs_)
+            return nullptr;
+        return &link_list_seqs_[internal_id & (LINK_LIST_SEQ_STRIPES - 1)];
+    }
+
+
+    /*
+    * Copies the links of an element at a level to links and returns their number, without locking.
+    * Seqlock read: the copy is made again when a writer held or took the lock of the element meanwhile,
+    * so it never mixes two versions of a list. The 32-bit sequence would have to wrap during a single copy
+    * to hide a write, which takes 2^31 lock cycles of the stripe.
+    */
+    size_t readLinkList(tableint internal_id, int level, std::vector<tableint> &links) const {
+        if (links.size() <= maxM0_)
+            links.resize(maxM0_ + 1);  // room for the prefetches reading one id past the list
+        linklistsizeint *ll = get_linklist_at_level(internal_id, level);
+        size_t max_size = level == 0 ? maxM0_ : maxM_;
+        std::atomic<uint32_t> *seq = getLinkListSeq(internal_id);
+        for (size_t spins = 0;; spins++) {
+            uint32_t seq_before = seq ? seq->load(std::memory_order_acquire) : 0;
+            if ((seq_before & 1) == 0) {
+                // the count may be torn too, the copy must stay in bounds until it is checked
+                size_t size = std::min((size_t) getListCount(ll), max_size);
+                memcpy(links.data(), ll + 1, size * sizeof(tableint));
+                if (seq == nullptr)
+                    return size;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq->load(std::memory_order_relaxed) == seq_before)
+                    return size;
+            }
+            spinWait(spins);
+        }
+    }
+
+
+    /*
+    * Lock of the link lists of an element at all levels, held while it is in scope by the writers of the lists.
+    * Taking and releasing it increments the sequence number of the element, so readLinkList can detect the writes.
+    * The elements of a stripe share the lock, which cannot deadlock as a writer holds a single lock at a time.
+    * Read-only indexes never modify their links and take no lock.
+    */
+    class LinkListLock {
+        std::atomic<uint32_t> *seq_{nullptr};
+        bool owns_lock_{false};
+
+     public:
+        LinkListLock(const HierarchicalNSW *index, tableint internal_id) : seq_(index->getLinkListSeq(internal_id)) {
+            lock();
+        }
+
+        LinkListLock(const LinkListLock &) = delete;
+        LinkListLock &operator=(const LinkListLock &) = delete;
+
+        void lock() {
+            owns_lock_ = true;
+            if (seq_ == nullptr)
+                return;
+            for (size_t spins = 0;; spins++) {
+                uint32_t seq = seq_->load(std::memory_order_relaxed);
+                if ((seq & 1) == 0 && seq_->compare_exchange_weak(seq, seq + 1, std::memory_order_acquire)) {
+                    // the writes to the lists must not be seen before the odd sequence number
+                    std::atomic_thread_fence(std::memory_order_release);
+                    return;
+                }
+                spinWait(spins);
+            }
+        }
+
+        void unlock() {
+            owns_lock_ = false;
+            if (seq_ != nullptr)
+                seq_->fetch_add(1, std::memory_order_release);
+        }
+
+        ~LinkListLock() {
+            if (owns_lock_)
+                unlock();
+        }
+    };
+
+
     /*
     * Uses the last 16 bits of the memory for the linked list size to store the mark,
     * whereas maxM0_ has to be limited to the lower 16 bits, however, still large enough in almost all cases.
     */
     void markDeletedInternal(tableint internalId) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot delete, the index is read-only");
         assert(internalId < cur_element_count);
         if (!isMarkedDeleted(internalId)) {
             unsigned char *ll_cur = ((unsigned char *)get_linklist0(internalId))+2;
             *ll_cur |= DELETE_MARK;
             num_deleted_ += 1;
+            deletion_epoch_++;
             if (allow_replace_deleted_) {
                 std::unique_lock <std::mutex> lock_deleted_elements(deleted_elements_lock);
                 deleted_elements.insert(internalId);
@@ -896,13 +2049,10 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
 
-        std::unique_lock <std::mutex> lock_table(label_lookup_lock);
-        auto search = label_lookup_.find(label);
-        if (search == label_lookup_.end()) {
+        tableint internalId;
+        if (!label_lookup_.find(label, internalId)) {
             throw std::runtime_error("Label not found");
         }
-        tableint internalId = search->second;
-        lock_table.unlock();
 
         unmarkDeletedInternal(internalId);
     }
@@ -913,11 +2063,14 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     * Remove the deleted mark of the node.
     */
     void unmarkDeletedInternal(tableint internalId) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot undelete, the index is read-only");
         assert(internalId < cur_element_count);
         if (isMarkedDeleted(internalId)) {
             unsigned char *ll_cur = ((unsigned char *)get_linklist0(internalId)) + 2;
             *ll_cur &= ~DELETE_MARK;
             num_deleted_ -= 1;
+            deletion_epoch_++;
             if (allow_replace_deleted_) {
                 std::unique_lock <std::mutex> lock_deleted_elements(deleted_elements_lock);
                 deleted_elements.erase(internalId);
@@ -947,19 +2100,78 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Adds n points, the i-th with the label labels[i] and the data at data + i * data size, with num_threads threads (0 for all the cores).
+    * Points already in the index are updated, as with addPoint.
+    * Levels are drawn up front and the points of the upper levels are inserted first, so the entry point
+    * settles at the start of the build instead of changing under the global lock all along.
+    * progress, if any, is called from the building threads about every percent of the points.
+    */
+    void addPoints(const void *data, const labeltype *labels, size_t n, size_t num_threads = 0,
+                   BaseProgressCallback *progress = nullptr) {
+        if (isReadOnly()) {
+            throw std::runtime_error("Cannot add points, the index is read-only");
+        }
+        std::vector<int> levels(n);
+        for (size_t i = 0; i < n; i++)
+            levels[i] = getRandomLevel(mult_);
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&levels](size_t a, size_t b) {
+            return levels[a] > levels[b];
+        });
+
+        const size_t CHUNK_SIZE = 32;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::atomic<size_t> added{0};
+        size_t reported = 0;
+        std::mutex progress_lock;
+        parallelFor(n, num_threads, CHUNK_SIZE, [&](size_t position, size_t thread_id) {
+            size_t i = order[position];
+            {
+                // lock all operations with element by label
+                std::unique_lock <std::mutex> lock_label(getLabelOpMutex(labels[i]));
+                insertPoint((const char *) data + i * data_size_, labels[i], levels[i], [](tableint) {});
+            }
+            size_t count = ++added;
+            if (progress == nullptr || count * 100 / n == (count - 1) * 100 / n)
+                return;
+            std::unique_lock <std::mutex> lock(progress_lock);
+            if (count > reported) {
+                reported = count;
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                (*progress)(count, n, count / std::max(seconds, 1e-9));
+            }
+        });
+    }
+
+
     /*
     * Adds point. Updates the point if it is already in the index.
     * If replacement of deleted elements is enabled: replaces previously deleted point if any, updating it with new point
     */
     void addPoint(const void *data_point, labeltype label, bool replace_deleted = false) {
+        addPoint(data_point, label, replace_deleted, [](tableint) {});
+    }
+
+
+    /*
+    * Same, calling on_reserved(internal_id) once the element has its id, before a search can return it:
+    * a new element is not linked into the graph yet, a replaced one is still marked deleted.
+    */
+    template<typename reserved_t>
+    void addPoint(const void *data_point, labeltype label, bool replace_deleted, reserved_t on_reserved) {
         if ((allow_replace_deleted_ == false) && (replace_deleted == true)) {
             throw std::runtime_error("Replacement of deleted elements is disabled in constructor");
         }
+        if (isReadOnly()) {
+            throw std::runtime_error("Cannot add point, the index is read-only");
+        }
 
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
         if (!replace_deleted) {
-            addPoint(data_point, label, -1);
+            insertPoint(data_point, label, -1, on_reserved);
             return;
         }
         // check if there is vacant place
@@ -975,16 +2187,17 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         // if there is no vacant place then add or update point
         // else add point to vacant place
         if (!is_vacant_place) {
-            addPoint(data_point, label, -1);
+            insertPoint(data_point, label, -1, on_reserved);
         } else {
             // we assume that there are no concurrent operations on deleted element
             labeltype label_replaced = getExternalLabel(internal_id_replaced);
             setExternalLabel(internal_id_replaced, label);
 
-            std::unique_lock <std::mutex> lock_table(label_lookup_lock);
             label_lookup_.erase(label_replaced);
-            label_lookup_[label] = internal_id_replaced;
-            lock_table.unlock();
+            label_lookup_.set(label, internal_id_replaced);
+            if (attributes_.numColumns())
+                attributes_.clearRow(internal_id_replaced);
+            on_reserved(internal_id_replaced);
 
             unmarkDeletedInternal(internal_id_replaced);
             updatePoint(data_point, internal_id_replaced, 1.0);
@@ -993,11 +2206,15 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
 
     void updatePoint(const void *dataPoint, tableint internalId, float updateNeighborProbability) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot update point, the index is read-only");
+
         // update the feature vector associated with existing point with new vector
         memcpy(getDataByInternalId(internalId), dataPoint, data_size_);
 
-        int maxLevelCopy = maxlevel_;
-        tableint entryPointCopy = enterpoint_node_;
+        EntryPoint entry_point = getEntryPoint();
+        int maxLevelCopy = entry_point.level;
+        tableint entryPointCopy = entry_point.node;
         // If point to be updated is entry point and graph just contains single element then just return.
         if (entryPointCopy == internalId && cur_element_count == 1)
             return;
@@ -1038,7 +2255,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     if (cand == neigh)
                         continue;
 
-                    dist_t distance = fstdistfunc_(getDataByInternalId(neigh), getDataByInternalId(cand), dist_func_param_);
+                    dist_t distance = computeDistance(getDataByInternalId(neigh), getDataByInternalId(cand));
                     if (candidates.size() < elementsToKeep) {
                         candidates.emplace(distance, cand);
                     } else {
@@ -1053,7 +2270,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                 getNeighborsByHeuristic2(candidates, layer == 0 ? maxM0_ : maxM_);
 
                 {
-                    std::unique_lock <std::mutex> lock(link_list_locks_[neigh]);
+                    LinkListLock lock(this, neigh);
                     linklistsizeint *ll_cur;
                     ll_cur = get_linklist_at_level(neigh, layer);
                     size_t candSize = candidates.size();
@@ -1079,16 +2296,14 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         int maxLevel) {
         tableint currObj = entryPointInternalId;
         if (dataPointLevel < maxLevel) {
-            dist_t curdist = fstdistfunc_(dataPoint, getDataByInternalId(currObj), dist_func_param_);
+            dist_t curdist = computeDistance(dataPoint, getDataByInternalId(currObj));
+            SearchScratchLease scratch;
             for (int level = maxLevel; level > dataPointLevel; level--) {
                 bool changed = true;
                 while (changed) {
                     changed = false;
-                    unsigned int *data;
-                    std::unique_lock <std::mutex> lock(link_list_locks_[currObj]);
-                    data = get_linklist_at_level(currObj, level);
-                    int size = getListCount(data);
-                    tableint *datal = (tableint *) (data + 1);
+                    int size = readLinkList(currObj, level, scratch->links);
+                    tableint *datal = scratch->links.data();
 #ifdef USE_SSE
                     _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
 #endif
@@ -1097,7 +2312,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                         _mm_prefetch(getDataByInternalId(*(datal + i + 1)), _MM_HINT_T0);
 #endif
                         tableint cand = datal[i];
-                        dist_t d = fstdistfunc_(dataPoint, getDataByInternalId(cand), dist_func_param_);
+                        dist_t d = computeDistance(dataPoint, getDataByInternalId(cand));
                         if (d < curdist) {
                             curdist = d;
                             currObj = cand;
@@ -1128,7 +2343,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             if (filteredTopCandidates.size() > 0) {
                 bool epDeleted = isMarkedDeleted(entryPointInternalId);
                 if (epDeleted) {
-                    filteredTopCandidates.emplace(fstdistfunc_(dataPoint, getDataByInternalId(entryPointInternalId), dist_func_param_), entryPointInternalId);
+                    filteredTopCandidates.emplace(computeDistance(dataPoint, getDataByInternalId(entryPointInternalId)), entryPointInternalId);
                     if (filteredTopCandidates.size() > ef_construction_)
                         filteredTopCandidates.pop();
                 }
@@ -1139,69 +2354,72 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
-    std::vector<tableint> getConnectionsWithLock(tableint internalId, int level) {
-        std::unique_lock <std::mutex> lock(link_list_locks_[internalId]);
-        unsigned int *data = get_linklist_at_level(internalId, level);
-        int size = getListCount(data);
-        std::vector<tableint> result(size);
-        tableint *ll = (tableint *) (data + 1);
-        memcpy(result.data(), ll, size * sizeof(tableint));
+    // Consistent copy of the links of an element at a level, see readLinkList
+    std::vector<tableint> getConnectionsWithLock(tableint internalId, int level) const {
+        std::vector<tableint> result;
+        result.resize(readLinkList(internalId, level, result));
         return result;
     }
 
 
+    // A level above 0 is the level of a new element, otherwise it is drawn at random
     tableint addPoint(const void *data_point, labeltype label, int level) {
+        return insertPoint(data_point, label, level > 0 ? level : -1, [](tableint) {});
+    }
+
+
+    // Same, with a level of 0 kept and a negative level drawn at random, see addPoint(data_point, label, replace_deleted, on_reserved)
+    template<typename reserved_t>
+    tableint insertPoint(const void *data_point, labeltype label, int level, reserved_t on_reserved) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot add point, the index is read-only");
+
         tableint cur_c = 0;
-        {
-            // Checking if the element with the same label already exists
-            // if so, updating it *instead* of creating a new element.
-            std::unique_lock <std::mutex> lock_table(label_lookup_lock);
-            auto search = label_lookup_.find(label);
-            if (search != label_lookup_.end()) {
-                tableint existingInternalId = search->second;
-                if (allow_replace_deleted_) {
-                    if (isMarkedDeleted(existingInternalId)) {
-                        throw std::runtime_error("Can't use addPoint to update deleted elements if replacement of deleted elements is enabled.");
-                    }
+        // Checking if the element with the same label already exists
+        // if so, updating it *instead* of creating a new element.
+        bool is_new = label_lookup_.findOrInsert(label, cur_c, [this]() {
+            size_t count = cur_element_count;
+            do {
+                if (count >= max_elements_) {
+                    throw std::runtime_error("The number of elements exceeds the specified limit");
                 }
-                lock_table.unlock();
-
+            } while (!cur_element_count.compare_exchange_weak(count, count + 1));
+            return (tableint) count;
+        });
+        if (!is_new) {
+            tableint existingInternalId = cur_c;
+            if (allow_replace_deleted_) {
                 if (isMarkedDeleted(existingInternalId)) {
-                    unmarkDeletedInternal(existingInternalId);
+                    throw std::runtime_error("Can't use addPoint to update deleted elements if replacement of deleted elements is enabled.");
                 }
-                updatePoint(data_point, existingInternalId, 1.0);
-
-                return existingInternalId;
             }
 
-            if (cur_element_count >= max_elements_) {
-                throw std::runtime_error("The number of elements exceeds the specified limit");
+            on_reserved(existingInternalId);
+            if (isMarkedDeleted(existingInternalId)) {
+                unmarkDeletedInternal(existingInternalId);
             }
+            updatePoint(data_point, existingInternalId, 1.0);
 
-            cur_c = cur_element_count;
-            cur_element_count++;
-            label_lookup_[label] = cur_c;
+            return existingInternalId;
         }
 
-        std::unique_lock <std::mutex> lock_el(link_list_locks_[cur_c]);
-        int curlevel = getRandomLevel(mult_);
-        if (level > 0)
-            curlevel = level;
-
-        element_levels_[cur_c] = curlevel;
+        // the header holds garbage in memory never used before
+        memset(get_linklist0(cur_c), 0, size_links_level0_);
 
-        std::unique_lock <std::mutex> templock(global);
-        int maxlevelcopy = maxlevel_;
-        if (curlevel <= maxlevelcopy)
-            templock.unlock();
-        tableint currObj = enterpoint_node_;
-        tableint enterpoint_copy = enterpoint_node_;
+        int curlevel = level >= 0 ? level : getRandomLevel(mult_);
 
-        memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
+        element_levels_[cur_c] = curlevel;
 
         // Initialisation of the data and label
         memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
         memcpy(getDataByInternalId(cur_c), data_point, data_size_);
+        on_reserved(cur_c);
+
+        // the ids are reserved before their rows are written: rows are published in id order, so that the scans
+        // over all elements, which stop at published_element_count_, never read a row being written
+        for (size_t spins = 0; published_element_count_.load(std::memory_order_acquire) != cur_c; spins++)
+            spinWait(spins);
+        published_element_count_.store(cur_c + 1, std::memory_order_release);
 
         if (curlevel) {
             linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
@@ -1210,24 +2428,35 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
         }
 
+        // only the elements above the top level, which become the entry point, take the global lock
+        EntryPoint entry_point = getEntryPoint();
+        std::unique_lock <std::mutex> templock(global, std::defer_lock);
+        if (curlevel > entry_point.level) {
+            templock.lock();
+            entry_point = getEntryPoint();
+            if (curlevel <= entry_point.level)
+                templock.unlock();
+        }
+        int maxlevelcopy = entry_point.level;
+        tableint currObj = entry_point.node;
+        tableint enterpoint_copy = entry_point.node;
+
         if ((signed)currObj != -1) {
             if (curlevel < maxlevelcopy) {
-                dist_t curdist = fstdistfunc_(data_point, getDataByInternalId(currObj), dist_func_param_);
+                dist_t curdist = computeDistance(data_point, getDataByInternalId(currObj));
+                SearchScratchLease scratch;
                 for (int level = maxlevelcopy; level > curlevel; level--) {
                     bool changed = true;
                     while (changed) {
                         changed = false;
-                        unsigned int *data;
-                        std::unique_lock <std::mutex> lock(link_list_locks_[currObj]);
-                        data = get_linklist(currObj, level);
-                        int size = getListCount(data);
+                        int size = readLinkList(currObj, level, scratch->links);
 
-                        tableint *datal = (tableint *) (data + 1);
+                        tableint *datal = scratch->links.data();
                         for (int i = 0; i < size; i++) {
                             tableint cand = datal[i];
                             if (cand < 0 || cand > max_elements_)
                                 throw std::runtime_error("cand error");
-                            dist_t d = fstdistfunc_(data_point, getDataByInternalId(cand), dist_func_param_);
+                            dist_t d = computeDistance(data_point, getDataByInternalId(cand));
                             if (d < curdist) {
                                 curdist = d;
                                 currObj = cand;
@@ -1239,88 +2468,638 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             }
 
             bool epDeleted = isMarkedDeleted(enterpoint_copy);
-            for (int level = std::min(curlevel, maxlevelcopy); level >= 0; level--) {
+            // the neighbors are searched from the top level down, but connected from level 0 up: concurrent
+            // insertions reaching the new element at a level must find its links at the levels below
+            int top_level = std::min(curlevel, maxlevelcopy);
+            std::vector<std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>> level_candidates(top_level + 1);
+            for (int level = top_level; level >= 0; level--) {
                 if (level > maxlevelcopy || level < 0)  // possible?
                     throw std::runtime_error("Level error");
 
-                std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates = searchBaseLayer(
-                        currObj, data_point, level);
+                std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &top_candidates = level_candidates[level];
+                top_candidates = searchBaseLayer(currObj, data_point, level);
                 if (epDeleted) {
-                    top_candidates.emplace(fstdistfunc_(data_point, getDataByInternalId(enterpoint_copy), dist_func_param_), enterpoint_copy);
+                    top_candidates.emplace(computeDistance(data_point, getDataByInternalId(enterpoint_copy)), enterpoint_copy);
                     if (top_candidates.size() > ef_construction_)
                         top_candidates.pop();
                 }
-                currObj = mutuallyConnectNewElement(data_point, cur_c, top_candidates, level, false);
+                // the closest candidate, always kept by the heuristic, is the entry point of the level below
+                std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> closest = top_candidates;
+                while (closest.size() > 1)
+                    closest.pop();
+                currObj = closest.top().second;
             }
-        } else {
-            // Do nothing for the first element
-            enterpoint_node_ = 0;
-            maxlevel_ = curlevel;
+            for (int level = 0; level <= top_level; level++)
+                mutuallyConnectNewElement(data_point, cur_c, level_candidates[level], level, false);
         }
+        // Do nothing else for the first element
 
         // Releasing lock for the maximum level
-        if (curlevel > maxlevelcopy) {
-            enterpoint_node_ = cur_c;
-            maxlevel_ = curlevel;
-        }
+        if (curlevel > maxlevelcopy)
+            setEntryPoint(cur_c, curlevel);
         return cur_c;
     }
 
 
+    // Greedy descent through the upper layers, returns the element of level 1 closest to the query
+    template <bool collect_metrics>
+    tableint searchUpperLayers(
+        const void *query_data,
+        const EntryPoint &entry_point,
+        SearchScratch &scratch,
+        SearchStats* stats) const {
+        tableint currObj = entry_point.node;
+        dist_t curdist = computeQueryDistance(query_data, getDataByInternalId(currObj));
+        if (collect_metrics)
+            stats->distance_computations++;
+
+        for (int level = entry_point.level; level > 0; level--) {
+            while (searchUpperLayerHop<collect_metrics>(query_data, level, currObj, curdist, scratch.links, stats)) {}
+        }
+        return currObj;
+    }
+
+
+    // One greedy step at a level above 0: moves cur_obj to its closest link if that is closer. Returns whether it moved
+    template <bool collect_metrics>
+    bool searchUpperLayerHop(
+        const void *query_data,
+        int level,
+        tableint &cur_obj,
+        dist_t &cur_dist,
+        std::vector<tableint> &links,
+        SearchStats* stats) const {
+        int size = readLinkList(cur_obj, level, links);
+        if (collect_metrics) {
+            stats->addHop(level);
+            stats->distance_computations += size;
+        }
+        metric_hops.fetch_add(1, std::memory_order_relaxed);
+        metric_distance_computations.fetch_add(size, std::memory_order_relaxed);
+
+        tableint *datal = links.data();
+        bool changed = false;
+        for (int i = 0; i < size; i++) {
+            tableint cand = datal[i];
+            if (cand < 0 || cand > max_elements_)
+                throw std::runtime_error("cand error");
+            dist_t d = computeQueryDistance(query_data, getDataByInternalId(cand));
+
+            if (d < cur_dist) {
+                cur_dist = d;
+                cur_obj = cand;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+
     std::priority_queue<std::pair<dist_t, labeltype >>
     searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
-        std::priority_queue<std::pair<dist_t, labeltype >> result;
-        if (cur_element_count == 0) return result;
-
-        tableint currObj = enterpoint_node_;
-        dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
-
-        for (int level = maxlevel_; level > 0; level--) {
-            bool changed = true;
-            while (changed) {
-                changed = false;
-                unsigned int *data;
-
-                data = (unsigned int *) get_linklist(currObj, level);
-                int size = getListCount(data);
-                metric_hops++;
-                metric_distance_computations+=size;
-
-                tableint *datal = (tableint *) (data + 1);
-                for (int i = 0; i < size; i++) {
-                    tableint cand = datal[i];
-                    if (cand < 0 || cand > max_elements_)
-                        throw std::runtime_error("cand error");
-                    dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
-
-                    if (d < curdist) {
-                        curdist = d;
-                        currObj = cand;
-                        changed = true;
+        return searchKnn(query_data, k, isIdAllowed, nullptr);
+    }
+
+
+    /*
+    * When stats is given, the work of the search is added to it. The counting is compiled into separate
+    * instantiations of the search loops, so searches without stats do not pay for it.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats* stats) const {
+        bool bare_bone_search = !num_deleted_ && !isIdAllowed;
+        if (bare_bone_search)
+            return searchKnnWithFilter<true>(query_data, k, LabelFilter{this, isIdAllowed}, false, stats);
+        bool two_hop = false;
+        if (isIdAllowed && (filter_planning_ || two_hop_max_selectivity_ > 0)) {
+            double selectivity = estimateSelectivity(isIdAllowed);
+            if (filter_planning_ && preferExactSearch(k, selectivity, 1))
+                return searchKnnExactWithFilter(query_data, k, LabelFilter{this, isIdAllowed}, stats);
+            two_hop = two_hop_max_selectivity_ > 0 && selectivity <= two_hop_max_selectivity_;
+        }
+        return searchKnnWithFilter<false>(query_data, k, LabelFilter{this, isIdAllowed}, two_hop, stats);
+    }
+
+
+    /*
+    * Returns the k closest elements among allowed_ids, a set of internal ids such as the one built by getAllowedIds.
+    * The search tests a bit per candidate instead of calling a filter on its label. Deleted elements are never
+    * returned, but the marks are only read when deletions changed since the set was built.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, const IdBitset &allowed_ids, SearchStats* stats = nullptr) const {
+        double selectivity = cur_element_count ? (double) allowed_ids.count() / cur_element_count : 1;
+        bool exact = filter_planning_ && preferExactSearch(k, selectivity, 0);
+        bool two_hop = two_hop_max_selectivity_ > 0 && selectivity <= two_hop_max_selectivity_;
+        if (num_deleted_ && allowed_ids.deletion_epoch != deletion_epoch_) {
+            if (exact)
+                return searchKnnExactWithFilter(query_data, k, BitsetFilter<true>{this, &allowed_ids}, stats);
+            return searchKnnWithFilter<false>(query_data, k, BitsetFilter<true>{this, &allowed_ids}, two_hop, stats);
+        }
+        if (exact)
+            return searchKnnExactWithFilter(query_data, k, BitsetFilter<false>{this, &allowed_ids}, stats);
+        return searchKnnWithFilter<false>(query_data, k, BitsetFilter<false>{this, &allowed_ids}, two_hop, stats);
+    }
+
+
+    /*
+    * Returns the k closest elements whose attributes satisfy the predicate, see addAttributeColumn. Planned like
+    * the searches with a BaseFilterFunctor, see setFilterPlanning and setTwoHopMaxSelectivity.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, const AttributePredicate &predicate, SearchStats* stats = nullptr) const {
+        std::vector<AttributeCondition> conditions = attributes_.compile(predicate);
+        if (num_deleted_)
+            return searchKnnPlanned(query_data, k, AttributeFilter<true>{this, &conditions}, stats);
+        return searchKnnPlanned(query_data, k, AttributeFilter<false>{this, &conditions}, stats);
+    }
+
+
+    /*
+    * Exact search: the k closest elements among the ones that are not deleted and pass isIdAllowed, if given.
+    * Scores the allowed elements only, in blocks with the batch kernels of the space, reading the vectors in
+    * place in the base layer. The planned searches use it when few elements are allowed.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnExact(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr,
+                   SearchStats* stats = nullptr) const {
+        return searchKnnExactWithFilter(query_data, k, LabelFilter{this, isIdAllowed}, stats);
+    }
+
+
+    // Same among allowed_ids, whose ids out of the set are skipped a word at a time
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnExact(const void *query_data, size_t k, const IdBitset &allowed_ids, SearchStats* stats = nullptr) const {
+        if (num_deleted_ && allowed_ids.deletion_epoch != deletion_epoch_)
+            return searchKnnExactWithFilter(query_data, k, BitsetFilter<true>{this, &allowed_ids}, stats);
+        return searchKnnExactWithFilter(query_data, k, BitsetFilter<false>{this, &allowed_ids}, stats);
+    }
+
+
+    /*
+    * Whether a filtered search allowing a fraction selectivity of the elements costs fewer distance computations
+    * as an exact scan than as a graph search. The graph search expands about ef / selectivity elements before
+    * it has found ef allowed ones, and scores about half of the links of each; the walk through allowed elements
+    * only, see setTwoHopMaxSelectivity, about ef elements. The scan scores the allowed elements, after testing
+    * the filter on every element filter_passes times. A test weighs a tenth of a distance, as the scan reads
+    * the elements in order where the graph search jumps between them.
+    */
+    bool preferExactSearch(size_t k, double selectivity, double filter_passes) const {
+        double num_elements = (double) cur_element_count;
+        double walk = std::max(ef_, k) * (maxM0_ / 2.0);
+        bool two_hop = two_hop_max_selectivity_ > 0 && selectivity <= two_hop_max_selectivity_;
+        double graph_cost = num_elements;
+        if (two_hop)
+            graph_cost = std::min(walk, num_elements);
+        else if (walk < selectivity * num_elements)
+            graph_cost = walk / selectivity;
+        double exact_cost = selectivity * num_elements + filter_passes * num_elements * 0.1;
+        return exact_cost <= graph_cost;
+    }
+
+
+    // Number of elements whose labels are tested by estimateSelectivity
+    static const size_t SELECTIVITY_SAMPLE_SIZE = 128;
+
+
+    /*
+    * Fraction of the elements allowed by the filter: its get_allowed_count if known, else from a sample of
+    * internal ids. The sample is pseudo-random, so that it does not follow patterns of the labels, but the same
+    * for every call, so that the labels it reads stay in cache.
+    */
+    double estimateSelectivity(BaseFilterFunctor* isIdAllowed) const {
+        size_t count = cur_element_count;
+        if (count == 0)
+            return 1;
+        size_t allowed_count = isIdAllowed ? isIdAllowed->get_allowed_count() : std::numeric_limits<size_t>::max();
+        if (allowed_count != std::numeric_limits<size_t>::max())
+            return std::min((double) allowed_count / count, 1.0);
+        return sampleSelectivity(LabelFilter{this, isIdAllowed});
+    }
+
+
+    // Fraction of the elements whose attributes satisfy the predicate, from the same sample
+    double estimateSelectivity(const AttributePredicate &predicate) const {
+        if (cur_element_count == 0)
+            return 1;
+        std::vector<AttributeCondition> conditions = attributes_.compile(predicate);
+        return sampleSelectivity(AttributeFilter<true>{this, &conditions});
+    }
+
+
+    template <typename filter_t>
+    double sampleSelectivity(const filter_t &is_allowed) const {
+        size_t count = published_element_count_.load(std::memory_order_acquire);
+        if (count == 0)
+            return 1;
+        std::minstd_rand sample_generator;
+        std::uniform_int_distribution<size_t> distribution(0, count - 1);
+        size_t num_allowed = 0;
+        for (size_t i = 0; i < SELECTIVITY_SAMPLE_SIZE; i++) {
+            if (is_allowed((tableint) distribution(sample_generator)))
+                num_allowed++;
+        }
+        return (double) num_allowed / SELECTIVITY_SAMPLE_SIZE;
+    }
+
+
+    /*
+    * Internal ids of the elements that are not deleted and pass isIdAllowed, if given. The set can be reused by
+    * any number of searches until the index is resized or reordered.
+    */
+    IdBitset getAllowedIds(BaseFilterFunctor* isIdAllowed = nullptr) const {
+        IdBitset allowed_ids(max_elements_);
+        allowed_ids.deletion_epoch = deletion_epoch_;
+        size_t count = published_element_count_.load(std::memory_order_acquire);
+        for (tableint id = 0; id < count; id++) {
+            if (LabelFilter{this, isIdAllowed}(id))
+                allowed_ids.set(id);
+        }
+        return allowed_ids;
+    }
+
+
+    // Internal ids of the listed labels that are in the index and not deleted
+    IdBitset getAllowedIds(const std::vector<labeltype> &labels) const {
+        IdBitset allowed_ids(max_elements_);
+        allowed_ids.deletion_epoch = deletion_epoch_;
+        for (labeltype label : labels) {
+            tableint id;
+            if (label_lookup_.find(label, id) && !isMarkedDeleted(id))
+                allowed_ids.set(id);
+        }
+        return allowed_ids;
+    }
+
+
+    // Scans the allowed elements or searches the graph, from a sample of the filter
+    template <typename filter_t>
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnPlanned(const void *query_data, size_t k, const filter_t &is_allowed, SearchStats* stats) const {
+        bool two_hop = false;
+        if (cur_element_count && (filter_planning_ || two_hop_max_selectivity_ > 0)) {
+            double selectivity = sampleSelectivity(is_allowed);
+            if (filter_planning_ && preferExactSearch(k, selectivity, 1))
+                return searchKnnExactWithFilter(query_data, k, is_allowed, stats);
+            two_hop = two_hop_max_selectivity_ > 0 && selectivity <= two_hop_max_selectivity_;
+        }
+        return searchKnnWithFilter<false>(query_data, k, is_allowed, two_hop, stats);
+    }
+
+
+    // Number of allowed elements scored together by searchKnnExact
+    static const size_t EXACT_SEARCH_BLOCK = 64;
+
+
+    // Leaves the k closest allowed elements in scratch.top_candidates, a heap of (distance, id)
+    template <typename filter_t>
+    void searchExact(SearchScratch &scratch, const void *query_data, size_t k, const filter_t &is_allowed,
+                     SearchStats* stats) const {
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch.top_candidates;
+        std::vector<tableint> &ids = scratch.neighbors;
+        if (ids.size() < EXACT_SEARCH_BLOCK)
+            ids.resize(EXACT_SEARCH_BLOCK);
+        tableint end = (tableint) published_element_count_.load(std::memory_order_acquire);
+        tableint id = is_allowed.next(0, end);
+        while (id < end) {
+            size_t num_ids = 0;
+            for (; id < end && num_ids < EXACT_SEARCH_BLOCK; id = is_allowed.next(id + 1, end))
+                ids[num_ids++] = id;
+
+            dist_t bound = top_candidates.size() >= k ? top_candidates.front().first : std::numeric_limits<dist_t>::max();
+            distanceBatch(fstquerydistbatchfunc_, fstquerydistboundedbatchfunc_, fstquerydistfunc_, query_data,
+                          ids.data(), num_ids, bound, scratch.dists);
+            if (stats) {
+                stats->visited_nodes += num_ids;
+                stats->distance_computations += num_ids;
+            }
+
+            for (size_t j = 0; j < num_ids; j++) {
+                dist_t dist = scratch.dists[j];
+                if (top_candidates.size() < k || dist < top_candidates.front().first) {
+                    top_candidates.emplace_back(dist, ids[j]);
+                    std::push_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+                    if (stats)
+                        stats->heap_operations++;
+                    if (top_candidates.size() > k) {
+                        std::pop_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+                        top_candidates.pop_back();
+                        if (stats)
+                            stats->heap_operations++;
                     }
                 }
             }
         }
+    }
+
+
+    template <typename filter_t>
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnExactWithFilter(const void *query_data, size_t k, const filter_t &is_allowed, SearchStats* stats) const {
+        std::vector<std::pair<dist_t, labeltype>> closest;
+        if (k > 0) {
+            SearchScratchLease scratch;
+            searchExact(*scratch, query_data, k, is_allowed, stats);
+            closest.reserve(scratch->top_candidates.size());
+            for (const std::pair<dist_t, tableint> &rez : scratch->top_candidates)
+                closest.emplace_back(rez.first, getExternalLabel(rez.second));
+        }
+        return std::priority_queue<std::pair<dist_t, labeltype>>(std::less<std::pair<dist_t, labeltype>>(), std::move(closest));
+    }
+
+
+    /*
+    * Adds a column of unsigned integers width bytes wide (1, 2, 4 or 8) to the attributes of the elements, such as
+    * a tenant id, a bitmask of categories or a timestamp, and returns its number. The values are 0 until set by
+    * setAttribute, and saved with the index. Searches given an AttributePredicate test them in place, without
+    * calling a filter per candidate. Must not run concurrently with any other operation on the index.
+    */
+    size_t addAttributeColumn(size_t width) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot add an attribute column, the index is read-only");
+        return attributes_.addColumn(width, max_elements_);
+    }
+
+
+    size_t getNumAttributeColumns() const {
+        return attributes_.numColumns();
+    }
+
+
+    // Values that do not fit the width of the column are rejected. A replaced deleted element gets 0 values.
+    void setAttribute(labeltype label, size_t column, uint64_t value) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot set an attribute, the index is read-only");
+        // lock all operations with element by label
+        std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
+        tableint internalId;
+        if (!label_lookup_.find(label, internalId))
+            throw std::runtime_error("Label not found");
+        attributes_.set(internalId, column, value);
+    }
+
+
+    uint64_t getAttribute(labeltype label, size_t column) const {
+        std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
+        tableint internalId;
+        if (!label_lookup_.find(label, internalId))
+            throw std::runtime_error("Label not found");
+        return attributes_.get(internalId, column);
+    }
+
+
+    template <bool bare_bone_search, typename filter_t>
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnnWithFilter(const void *query_data, size_t k, const filter_t &is_allowed, bool two_hop, SearchStats* stats) const {
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        EntryPoint entry_point = getEntryPoint();
+        if (entry_point.level < 0) return result;
+
+        SearchScratchLease scratch;
+        size_t ef = std::max(ef_, k);
+        if (stats) {
+            tableint currObj = searchUpperLayers<true>(query_data, entry_point, *scratch, stats);
+            if (two_hop)
+                searchBaseLayerTwoHop<true>(*scratch, currObj, query_data, ef, is_allowed, stats);
+            else
+                searchBaseLayerST<bare_bone_search, true>(*scratch, currObj, query_data, ef, is_allowed, nullptr, stats);
+        } else {
+            tableint currObj = searchUpperLayers<false>(query_data, entry_point, *scratch, nullptr);
+            if (two_hop)
+                searchBaseLayerTwoHop<false>(*scratch, currObj, query_data, ef, is_allowed, nullptr);
+            else
+                searchBaseLayerST<bare_bone_search, false>(*scratch, currObj, query_data, ef, is_allowed, nullptr);
+        }
+
+        // keep the k closest in front, in any order
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch->top_candidates;
+        if (top_candidates.size() > k) {
+            std::nth_element(top_candidates.begin(), top_candidates.begin() + k, top_candidates.end(), CompareByFirst());
+            top_candidates.resize(k);
+        }
+        std::vector<std::pair<dist_t, labeltype>> closest;
+        closest.reserve(top_candidates.size());
+        for (const std::pair<dist_t, tableint> &rez : top_candidates) {
+            closest.emplace_back(rez.first, getExternalLabel(rez.second));
+        }
+        return std::priority_queue<std::pair<dist_t, labeltype>>(std::less<std::pair<dist_t, labeltype>>(), std::move(closest));
+    }
+
+
+    /*
+    * Searches nq queries stored back to back in `queries` and writes the k closest elements of the i-th query,
+    * closest first, to labels[i * k ... (i + 1) * k - 1] and distances[i * k ... (i + 1) * k - 1].
+    * Slots that cannot be filled get the label std::numeric_limits<labeltype>::max().
+    * If stats is given, it points to nq SearchStats and the work of the i-th query is added to stats[i].
+    *
+    * Makes the same searches as searchKnn, with the filter planned once for the batch. The visited sets and heaps
+    * are acquired once per batch and the walks of BATCH_SEARCH_INTERLEAVE queries are interleaved hop by hop:
+    * the next neighbor list of each query is prefetched while the other queries compute their distances.
+    */
+    void searchKnnBatch(
+        const void *queries,
+        size_t nq,
+        size_t k,
+        labeltype *labels,
+        dist_t *distances,
+        BaseFilterFunctor* isIdAllowed = nullptr,
+        SearchStats* stats = nullptr) const {
+        if (nq == 0 || k == 0) return;
+        if (getEntryPoint().level < 0) {
+            std::fill(labels, labels + nq * k, std::numeric_limits<labeltype>::max());
+            std::fill(distances, distances + nq * k, std::numeric_limits<dist_t>::max());
+            return;
+        }
+
+        // the filter is tested once for the whole batch
+        bool two_hop = false;
+        if (isIdAllowed && (filter_planning_ || two_hop_max_selectivity_ > 0)) {
+            double selectivity = estimateSelectivity(isIdAllowed);
+            if (filter_planning_ && preferExactSearch(k, selectivity, 1.0 / nq)) {
+                IdBitset allowed_ids = getAllowedIds(isIdAllowed);
+                SearchScratchLease scratch;
+                for (size_t i = 0; i < nq; i++) {
+                    scratch->top_candidates.clear();
+                    searchExact(*scratch, (const char *) queries + i * query_data_size_, k,
+                                BitsetFilter<false>{this, &allowed_ids}, stats ? stats + i : nullptr);
+                    writeBatchQueryResult(scratch->top_candidates, i, k, labels, distances);
+                }
+                return;
+            }
+            two_hop = two_hop_max_selectivity_ > 0 && selectivity <= two_hop_max_selectivity_;
+        }
+
+        size_t ef = std::max(ef_, k);
+        if (ef <= compact_visited_max_ef_) {
+            searchKnnBatchWithVisited(*visited_hash_set_pool_, (const char *) queries, nq, k, ef, labels, distances,
+                                      isIdAllowed, two_hop, stats);
+        } else {
+            searchKnnBatchWithVisited(*visited_list_pool_, (const char *) queries, nq, k, ef, labels, distances,
+                                      isIdAllowed, two_hop, stats);
+        }
+    }
+
+
+    template <typename visited_t>
+    void searchKnnBatchWithVisited(
+        VisitedSetPool<visited_t> &pool,
+        const char *queries,
+        size_t nq,
+        size_t k,
+        size_t ef,
+        labeltype *labels,
+        dist_t *distances,
+        BaseFilterFunctor* isIdAllowed,
+        bool two_hop,
+        SearchStats* stats) const {
+        std::vector<BatchQueryState<visited_t>> slots(std::min(nq, BATCH_SEARCH_INTERLEAVE));
+        for (BatchQueryState<visited_t> &slot : slots) {
+            slot.visited = pool.getFreeVisitedList();
+        }
 
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        LabelFilter is_allowed{this, isIdAllowed};
         bool bare_bone_search = !num_deleted_ && !isIdAllowed;
-        if (bare_bone_search) {
-            top_candidates = searchBaseLayerST<true>(
-                    currObj, query_data, std::max(ef_, k), isIdAllowed);
+        if (bare_bone_search && stats) {
+            searchKnnBatchInterleaved<true, true>(slots, queries, nq, k, ef, labels, distances, is_allowed, false, stats);
+        } else if (bare_bone_search) {
+            searchKnnBatchInterleaved<true, false>(slots, queries, nq, k, ef, labels, distances, is_allowed, false, stats);
+        } else if (stats) {
+            searchKnnBatchInterleaved<false, true>(slots, queries, nq, k, ef, labels, distances, is_allowed, two_hop, stats);
         } else {
-            top_candidates = searchBaseLayerST<false>(
-                    currObj, query_data, std::max(ef_, k), isIdAllowed);
+            searchKnnBatchInterleaved<false, false>(slots, queries, nq, k, ef, labels, distances, is_allowed, two_hop, stats);
         }
 
-        while (top_candidates.size() > k) {
-            top_candidates.pop();
+        for (BatchQueryState<visited_t> &slot : slots) {
+            pool.releaseVisitedList(slot.visited);
         }
-        while (top_candidates.size() > 0) {
-            std::pair<dist_t, tableint> rez = top_candidates.top();
-            result.push(std::pair<dist_t, labeltype>(rez.first, getExternalLabel(rez.second)));
-            top_candidates.pop();
+    }
+
+
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t>
+    void searchKnnBatchInterleaved(
+        std::vector<BatchQueryState<visited_t>> &slots,
+        const char *queries,
+        size_t nq,
+        size_t k,
+        size_t ef,
+        labeltype *labels,
+        dist_t *distances,
+        const LabelFilter &is_allowed,
+        bool two_hop,
+        SearchStats* stats) const {
+        size_t next_query = 0;
+        for (BatchQueryState<visited_t> &slot : slots) {
+            startBatchQuery<bare_bone_search, collect_metrics>(slot, next_query, queries + next_query * query_data_size_,
+                                                                ef, is_allowed, two_hop, stats);
+            next_query++;
+        }
+
+        size_t num_active = slots.size();
+        while (num_active > 0) {
+            for (BatchQueryState<visited_t> &slot : slots) {
+                if (slot.query == nullptr) continue;
+
+                if (batchQueryStep<bare_bone_search, collect_metrics>(slot, ef, is_allowed, two_hop)) {
+                    writeBatchQueryResult(slot.scratch.top_candidates, slot.query_id, k, labels, distances);
+                    if (next_query < nq) {
+                        startBatchQuery<bare_bone_search, collect_metrics>(
+                            slot, next_query, queries + next_query * query_data_size_, ef, is_allowed, two_hop, stats);
+                        next_query++;
+                    } else {
+                        slot.query = nullptr;
+                        num_active--;
+                        continue;
+                    }
+                }
+#ifdef USE_SSE
+                // the list is needed only after the other slots made their step
+                if (slot.level > 0) {
+                    _mm_prefetch((char *) get_linklist(slot.cur_obj, slot.level), _MM_HINT_T0);
+                } else if (!slot.scratch.candidate_set.empty()) {
+                    _mm_prefetch((char *) get_linklist0(slot.scratch.candidate_set.front().second), _MM_HINT_T0);
+                }
+#endif
+            }
+        }
+    }
+
+
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t>
+    void startBatchQuery(
+        BatchQueryState<visited_t> &slot,
+        size_t query_id,
+        const char *query,
+        size_t ef,
+        const LabelFilter &is_allowed,
+        bool two_hop,
+        SearchStats* stats) const {
+        slot.query_id = query_id;
+        slot.query = query;
+        slot.stats = collect_metrics ? stats + query_id : nullptr;
+        EntryPoint entry_point = getEntryPoint();
+        slot.level = entry_point.level;
+        slot.cur_obj = entry_point.node;
+        slot.cur_dist = computeQueryDistance(query, getDataByInternalId(entry_point.node));
+        if (collect_metrics)
+            slot.stats->distance_computations++;
+        if (slot.level == 0)
+            startBatchBaseLayer<bare_bone_search, collect_metrics>(slot, ef, is_allowed, two_hop);
+    }
+
+
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t>
+    void startBatchBaseLayer(BatchQueryState<visited_t> &slot, size_t ef, const LabelFilter &is_allowed, bool two_hop) const {
+        slot.visited->reset();
+        if (two_hop) {
+            slot.lower_bound = startTwoHopSearch<collect_metrics>(
+                *slot.visited, slot.scratch, slot.cur_obj, slot.query, ef, is_allowed, slot.stats);
+        } else {
+            slot.lower_bound = startBaseLayerSearch<bare_bone_search, collect_metrics>(
+                *slot.visited, slot.scratch, slot.cur_obj, slot.query, ef, is_allowed, nullptr, slot.stats);
+        }
+    }
+
+
+    /*
+    * Makes one hop of the query with the routines of searchKnn: a greedy step in the upper layers or a candidate
+    * expansion in the base layer. Returns true when the search of the query is finished.
+    */
+    template <bool bare_bone_search, bool collect_metrics, typename visited_t>
+    bool batchQueryStep(BatchQueryState<visited_t> &slot, size_t ef, const LabelFilter &is_allowed, bool two_hop) const {
+        if (slot.level > 0) {
+            if (!searchUpperLayerHop<collect_metrics>(slot.query, slot.level, slot.cur_obj, slot.cur_dist,
+                                                      slot.scratch.links, slot.stats)) {
+                slot.level--;
+                if (slot.level == 0)
+                    startBatchBaseLayer<bare_bone_search, collect_metrics>(slot, ef, is_allowed, two_hop);
+            }
+            return false;
+        }
+        if (two_hop) {
+            return !expandTwoHopCandidate<collect_metrics>(
+                *slot.visited, slot.scratch, slot.query, ef, is_allowed, slot.lower_bound, slot.stats);
+        }
+        return !expandBaseLayerCandidate<bare_bone_search, collect_metrics>(
+            *slot.visited, slot.scratch, slot.query, ef, is_allowed, nullptr, slot.lower_bound, slot.stats);
+    }
+
+
+    void writeBatchQueryResult(std::vector<std::pair<dist_t, tableint>> &top_candidates, size_t query_id, size_t k,
+                               labeltype *labels, dist_t *distances) const {
+        // ascending order of distances
+        std::sort_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+
+        labeltype *query_labels = labels + query_id * k;
+        dist_t *query_distances = distances + query_id * k;
+        size_t num_found = std::min(k, top_candidates.size());
+        for (size_t i = 0; i < num_found; i++) {
+            query_labels[i] = getExternalLabel(top_candidates[i].second);
+            query_distances[i] = top_candidates[i].first;
+        }
+        for (size_t i = num_found; i < k; i++) {
+            query_labels[i] = std::numeric_limits<labeltype>::max();
+            query_distances[i] = std::numeric_limits<dist_t>::max();
         }
-        return result;
     }
 
 
@@ -1328,49 +3107,26 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     searchStopConditionClosest(
         const void *query_data,
         BaseSearchStopCondition<dist_t>& stop_condition,
-        BaseFilterFunctor* isIdAllowed = nullptr) const {
+        BaseFilterFunctor* isIdAllowed = nullptr,
+        SearchStats* stats = nullptr) const {
         std::vector<std::pair<dist_t, labeltype >> result;
-        if (cur_element_count == 0) return result;
-
-        tableint currObj = enterpoint_node_;
-        dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
-
-        for (int level = maxlevel_; level > 0; level--) {
-            bool changed = true;
-            while (changed) {
-                changed = false;
-                unsigned int *data;
-
-                data = (unsigned int *) get_linklist(currObj, level);
-                int size = getListCount(data);
-                metric_hops++;
-                metric_distance_computations+=size;
-
-                tableint *datal = (tableint *) (data + 1);
-                for (int i = 0; i < size; i++) {
-                    tableint cand = datal[i];
-                    if (cand < 0 || cand > max_elements_)
-                        throw std::runtime_error("cand error");
-                    dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
-
-                    if (d < curdist) {
-                        curdist = d;
-                        currObj = cand;
-                        changed = true;
-                    }
-                }
-            }
+        EntryPoint entry_point = getEntryPoint();
+        if (entry_point.level < 0) return result;
+
+        SearchScratchLease scratch;
+        if (stats) {
+            tableint currObj = searchUpperLayers<true>(query_data, entry_point, *scratch, stats);
+            searchBaseLayerST<false, true>(
+                *scratch, currObj, query_data, 0, LabelFilter{this, isIdAllowed}, &stop_condition, stats);
+        } else {
+            tableint currObj = searchUpperLayers<false>(query_data, entry_point, *scratch, nullptr);
+            searchBaseLayerST<false, false>(
+                *scratch, currObj, query_data, 0, LabelFilter{this, isIdAllowed}, &stop_condition);
         }
 
-        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
-        top_candidates = searchBaseLayerST<false>(currObj, query_data, 0, isIdAllowed, &stop_condition);
-
-        size_t sz = top_candidates.size();
-        result.resize(sz);
-        while (!top_candidates.empty()) {
-            result[--sz] = top_candidates.top();
-            top_candidates.pop();
-        }
+        std::vector<std::pair<dist_t, tableint>> &top_candidates = scratch->top_candidates;
+        std::sort_heap(top_candidates.begin(), top_candidates.end(), CompareByFirst());
+        result.assign(top_candidates.begin(), top_candidates.end());
 
         stop_condition.filter_results(result);
 
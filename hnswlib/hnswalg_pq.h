@@ -0,0 +1,201 @@
+#pragma once
+
+#include "hnswalg.h"
+#include "space_pq.h"
+#include "mapped_file.h"
+
+namespace hnswlib {
+
+/*
+* HNSW graph over PQ codes: the level-0 block keeps only getCodeSize() bytes per element instead of the full vector.
+* The graph is traversed with asymmetric distances and the best candidates are reranked
+* against full vectors kept in a separate store, either in memory or memory-mapped from disk.
+*
+* saveIndex(location) writes the graph to location, the quantizer to location + ".pq"
+* and the full vectors to location + ".vectors".
+*/
+class HierarchicalNSWPQ : public AlgorithmInterface<float> {
+ public:
+    ProductQuantizer pq_;
+    std::unique_ptr<PQSpace> pq_space_{nullptr};
+    L2Space full_space_;
+    DISTFUNC<float> full_dist_func_;
+    void *full_dist_func_param_{nullptr};
+    std::unique_ptr<HierarchicalNSW<float>> graph_{nullptr};
+
+    size_t vector_size_{0};
+    size_t max_elements_{0};
+    char *vectors_memory_{nullptr};  // full vectors by internal id of the graph
+    std::unique_ptr<MappedFile> vectors_file_{nullptr};  // set when the full vectors are read from disk
+
+    size_t rerank_k_{0};  // number of graph candidates reranked by a search, 0 means 4 * k
+
+
+    HierarchicalNSWPQ(
+        const ProductQuantizer &pq,
+        size_t max_elements,
+        size_t M = 16,
+        size_t ef_construction = 200,
+        size_t random_seed = 100,
+        bool allow_replace_deleted = false)
+        : pq_(pq), full_space_(pq.dim_) {
+        pq_space_.reset(new PQSpace(pq_));
+        graph_.reset(new HierarchicalNSW<float>(pq_space_.get(), max_elements, M, ef_construction, random_seed,
+                                                allow_replace_deleted));
+        vector_size_ = full_space_.get_data_size();
+        full_dist_func_ = full_space_.get_dist_func();
+        full_dist_func_param_ = full_space_.get_dist_func_param();
+        max_elements_ = max_elements;
+        vectors_memory_ = (char *) malloc(max_elements_ * vector_size_);
+        if (vectors_memory_ == nullptr)
+            throw std::runtime_error("Not enough memory: HierarchicalNSWPQ failed to allocate full vectors");
+    }
+
+
+    /*
+    * Loads an index written by saveIndex. With mmap_vectors the full vectors stay on disk
+    * and the index is read-only.
+    */
+    HierarchicalNSWPQ(
+        const std::string &location,
+        bool mmap_vectors = false,
+        size_t max_elements = 0,
+        bool allow_replace_deleted = false)
+        : pq_(location + ".pq"), full_space_(pq_.dim_) {
+        pq_space_.reset(new PQSpace(pq_));
+        graph_.reset(new HierarchicalNSW<float>(pq_space_.get(), location, false, max_elements,
+                                                allow_replace_deleted));
+        vector_size_ = full_space_.get_data_size();
+        full_dist_func_ = full_space_.get_dist_func();
+        full_dist_func_param_ = full_space_.get_dist_func_param();
+        max_elements_ = graph_->getMaxElements();
+
+        size_t stored_size = graph_->cur_element_count * vector_size_;
+        std::string vectors_location = location + ".vectors";
+        if (mmap_vectors) {
+            vectors_file_.reset(new MappedFile(vectors_location));
+            if (vectors_file_->size() != stored_size)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+            return;
+        }
+
+        std::ifstream input(vectors_location, std::ios::binary);
+        if (!input.is_open())
+            throw std::runtime_error("Cannot open file");
+        vectors_memory_ = (char *) malloc(max_elements_ * vector_size_);
+        if (vectors_memory_ == nullptr)
+            throw std::runtime_error("Not enough memory: HierarchicalNSWPQ failed to allocate full vectors");
+        input.read(vectors_memory_, stored_size);
+        if (!input || input.peek() != EOF)
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        input.close();
+    }
+
+
+    ~HierarchicalNSWPQ() {
+        free(vectors_memory_);
+    }
+
+
+    bool isReadOnly() const {
+        return vectors_file_ != nullptr;
+    }
+
+
+    void setEf(size_t ef) {
+        graph_->setEf(ef);
+    }
+
+
+    void setRerankK(size_t rerank_k) {
+        rerank_k_ = rerank_k;
+    }
+
+
+    size_t getCurrentElementCount() {
+        return graph_->getCurrentElementCount();
+    }
+
+
+    const float *getFullVectorByInternalId(tableint internal_id) const {
+        const char *vectors = vectors_file_ ? vectors_file_->data() : vectors_memory_;
+        return (const float *) (vectors + internal_id * vector_size_);
+    }
+
+
+    /*
+    * The full vector is stored as soon as the graph reserves the id of the element, before a concurrent search
+    * can reach it. Like the updates of HierarchicalNSW, an update of an existing label is not atomic for the searches.
+    */
+    void addPoint(const void *data_point, labeltype label, bool replace_deleted = false) {
+        if (isReadOnly())
+            throw std::runtime_error("Cannot modify an index with memory-mapped full vectors");
+
+        std::vector<unsigned char> code(pq_.getCodeSize());
+        pq_.encode((const float *) data_point, code.data());
+        graph_->addPoint(code.data(), label, replace_deleted, [&](tableint internal_id) {
+            memcpy(vectors_memory_ + internal_id * vector_size_, data_point, vector_size_);
+        });
+    }
+
+
+    void markDelete(labeltype label) {
+        graph_->markDelete(label);
+    }
+
+
+    void unmarkDelete(labeltype label) {
+        graph_->unmarkDelete(label);
+    }
+
+
+    std::priority_queue<std::pair<float, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        return searchKnn(query_data, k, isIdAllowed, nullptr);
+    }
+
+
+    std::priority_queue<std::pair<float, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats* stats) const {
+        std::priority_queue<std::pair<float, labeltype >> result;
+        if (k == 0)
+            return result;
+
+        std::vector<float> lut(pq_.getLookupTableSize());
+        pq_.computeLookupTable((const float *) query_data, lut.data());
+        size_t rerank_k = rerank_k_ ? std::max(rerank_k_, k) : 4 * k;
+        std::priority_queue<std::pair<float, labeltype >> candidates = graph_->searchKnn(lut.data(), rerank_k, isIdAllowed, stats);
+        if (stats)
+            stats->distance_computations += candidates.size();
+
+        while (!candidates.empty()) {
+            labeltype label = candidates.top().second;
+            candidates.pop();
+
+            tableint internal_id;
+            if (!graph_->label_lookup_.find(label, internal_id))
+                continue;
+            float dist = full_dist_func_(query_data, getFullVectorByInternalId(internal_id), full_dist_func_param_);
+            if (result.size() < k) {
+                result.emplace(dist, label);
+            } else if (dist < result.top().first) {
+                result.pop();
+                result.emplace(dist, label);
+            }
+        }
+        return result;
+    }
+
+
+    void saveIndex(const std::string &location) {
+        if (vectors_file_ && vectors_file_->location() == location + ".vectors")
+            throw std::runtime_error("Cannot save an index over its own memory-mapped full vectors");
+        graph_->saveIndex(location);
+        pq_.saveQuantizer(location + ".pq");
+
+        std::ofstream output(location + ".vectors", std::ios::binary);
+        output.write((const char *) getFullVectorByInternalId(0), graph_->cur_element_count * vector_size_);
+        output.close();
+    }
+};
+}  // namespace hnswlib
@@ -11,10 +11,25 @@
 #ifndef NO_MANUAL_VECTORIZATION
 #if (defined(__SSE__) || _M_IX86_FP > 0 || defined(_M_AMD64) || defined(_M_X64))
 #define USE_SSE
+#ifdef __SSE4_1__
+#define USE_SSE41
+#endif
 #ifdef __AVX__
 #define USE_AVX
+#ifdef __AVX2__
+#define USE_AVX2
+#endif
+#ifdef __F16C__
+#define USE_F16C
+#endif
 #ifdef __AVX512F__
 #define USE_AVX512
+#ifdef __AVX512BW__
+#define USE_AVX512BW
+#endif
+#ifdef __AVX512VNNI__
+#define USE_AVX512VNNI
+#endif
 #endif
 #endif
 #endif
@@ -48,6 +63,14 @@ static uint64_t xgetbv(unsigned int index) {
 #include <immintrin.h>
 #endif
 
+// GCC and clang compile the kernels of the instruction sets above the build flags with the target attribute,
+// so that a portable build still runs the widest kernels on the CPUs supporting them
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(HNSWLIB_NO_DISPATCH)
+#define HNSWLIB_DISPATCH
+#define HNSWLIB_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
 #if defined(__GNUC__)
 #define PORTABLE_ALIGN32 __attribute__((aligned(32)))
 #define PORTABLE_ALIGN64 __attribute__((aligned(64)))
@@ -114,23 +137,161 @@ static bool AVX512Capable() {
     }
     return HW_AVX512F && avx512Supported;
 }
+
+static bool SSE41Capable() {
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0, 0);
+    if (cpuInfo[0] < 0x00000001)
+        return false;
+    cpuid(cpuInfo, 0x00000001, 0);
+    return (cpuInfo[2] & ((int)1 << 19)) != 0;
+}
+
+// bit of cpuid leaf 7 (extended features), register 1 is ebx and 2 is ecx
+static bool ExtendedFeatureCapable(int reg, int bit) {
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0, 0);
+    if (cpuInfo[0] < 0x00000007)
+        return false;
+    cpuid(cpuInfo, 0x00000007, 0);
+    return (cpuInfo[reg] & ((int)1 << bit)) != 0;
+}
+
+static bool AVX2Capable() {
+    return AVXCapable() && ExtendedFeatureCapable(1, 5);
+}
+
+static bool AVX512BWCapable() {
+    return AVX512Capable() && ExtendedFeatureCapable(1, 30);
+}
+
+static bool AVX512VNNICapable() {
+    return AVX512BWCapable() && ExtendedFeatureCapable(2, 11);
+}
+#endif
+
+#ifndef HNSWLIB_TARGET
+#define HNSWLIB_TARGET(isa)
+#endif
+
+// The kernels compiled for each instruction set, either by the build flags or with HNSWLIB_TARGET
+#if defined(USE_SSE41) || defined(HNSWLIB_DISPATCH)
+#define HNSWLIB_SSE41_KERNELS
+#endif
+#if defined(USE_AVX) || defined(HNSWLIB_DISPATCH)
+#define HNSWLIB_AVX_KERNELS
+#endif
+#if defined(USE_AVX2) || defined(HNSWLIB_DISPATCH)
+#define HNSWLIB_AVX2_KERNELS
+#endif
+#if defined(USE_AVX512) || defined(HNSWLIB_DISPATCH)
+#define HNSWLIB_AVX512_KERNELS
+#endif
+#if defined(USE_AVX512BW) || defined(HNSWLIB_DISPATCH)
+#define HNSWLIB_AVX512BW_KERNELS
+#endif
+#if (defined(USE_AVX512BW) && defined(USE_AVX512VNNI)) || defined(HNSWLIB_DISPATCH)
+#define HNSWLIB_AVX512VNNI_KERNELS
 #endif
 
 #include <queue>
 #include <vector>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <stdint.h>
 #include <string.h>
 
 namespace hnswlib {
 typedef size_t labeltype;
+typedef unsigned int tableint;
 
 // This can be extended to store state for filtering (e.g. from a std::set)
 class BaseFilterFunctor {
  public:
     virtual bool operator()(hnswlib::labeltype id) { return true; }
+    // Number of elements the filter allows when the caller knows it, which spares the planned searches
+    // of HierarchicalNSW sampling the filter. std::numeric_limits<size_t>::max() when unknown.
+    virtual size_t get_allowed_count() { return std::numeric_limits<size_t>::max(); }
     virtual ~BaseFilterFunctor() {};
 };
 
+// Index of the lowest set bit, x must not be 0
+static inline unsigned int CountTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    unsigned int n = 0;
+    for (; !(x & 1); x >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+/*
+* Set of internal ids, a filter that the searches test with a bit lookup instead of calling a BaseFilterFunctor
+* on the label of each candidate. HierarchicalNSW::getAllowedIds builds one without the deleted elements.
+*/
+class IdBitset {
+ public:
+    // deletion epoch of the index whose deleted elements are left out, the searches check the deletions
+    // themselves when it is not the current one
+    size_t deletion_epoch{std::numeric_limits<size_t>::max()};
+
+    IdBitset() {}
+
+    explicit IdBitset(size_t size) : size_(size), words_((size + 63) / 64, 0) {}
+
+    size_t size() const {
+        return size_;
+    }
+
+    void set(tableint id) {
+        count_ += !test(id);
+        words_[id >> 6] |= (uint64_t) 1 << (id & 63);
+    }
+
+    void reset(tableint id) {
+        count_ -= test(id);
+        words_[id >> 6] &= ~((uint64_t) 1 << (id & 63));
+    }
+
+    // ids past the size are not in the set
+    bool test(tableint id) const {
+        return id < size_ && ((words_[id >> 6] >> (id & 63)) & 1);
+    }
+
+    size_t count() const {
+        return count_;
+    }
+
+    // Smallest id of the set not below id, size() if there is none
+    size_t next(size_t id) const {
+        if (id >= size_)
+            return size_;
+        size_t w = id >> 6;
+        uint64_t word = words_[w] & (~(uint64_t) 0 << (id & 63));
+        while (word == 0) {
+            if (++w == words_.size())
+                return size_;
+            word = words_[w];
+        }
+        return w * 64 + CountTrailingZeros(word);
+    }
+
+ private:
+    size_t size_{0};
+    size_t count_{0};
+    std::vector<uint64_t> words_;
+};
+
+// Receives the progress of HierarchicalNSW::addPoints
+class BaseProgressCallback {
+ public:
+    virtual void operator()(size_t added, size_t total, double points_per_second) = 0;
+    virtual ~BaseProgressCallback() {};
+};
+
 template<typename dist_t>
 class BaseSearchStopCondition {
  public:
@@ -149,6 +310,45 @@ class BaseSearchStopCondition {
     virtual ~BaseSearchStopCondition() {}
 };
 
+/*
+* Counts the work of the searches it is passed to. A search adds to the SearchStats it was given and nothing else,
+* so concurrent searches use one each and merge them with +=. Searches given none count nothing.
+*/
+struct SearchStats {
+    std::vector<size_t> hops_per_level;  // neighbor lists read, indexed by level
+    size_t distance_computations{0};
+    size_t visited_nodes{0};             // elements marked visited in the base layer
+    size_t heap_operations{0};           // pushes and pops of the candidate and result heaps
+
+    size_t hops() const {
+        size_t sum = 0;
+        for (size_t hops : hops_per_level)
+            sum += hops;
+        return sum;
+    }
+
+    void addHop(int level) {
+        if (hops_per_level.size() <= (size_t) level)
+            hops_per_level.resize(level + 1, 0);
+        hops_per_level[level]++;
+    }
+
+    SearchStats &operator+=(const SearchStats &other) {
+        if (hops_per_level.size() < other.hops_per_level.size())
+            hops_per_level.resize(other.hops_per_level.size(), 0);
+        for (size_t level = 0; level < other.hops_per_level.size(); level++)
+            hops_per_level[level] += other.hops_per_level[level];
+        distance_computations += other.distance_computations;
+        visited_nodes += other.visited_nodes;
+        heap_operations += other.heap_operations;
+        return *this;
+    }
+
+    void reset() {
+        *this = SearchStats();
+    }
+};
+
 template <typename T>
 class pairGreater {
  public:
@@ -167,19 +367,158 @@ static void readBinaryPOD(std::istream &in, T &podRef) {
     in.read((char *) &podRef, sizeof(T));
 }
 
+template<typename T>
+static void readBinaryPOD(const char *&in, const char *end, T &podRef) {
+    if ((size_t) (end - in) < sizeof(T))
+        throw std::runtime_error("Index seems to be corrupted or unsupported");
+    memcpy((char *) &podRef, in, sizeof(T));
+    in += sizeof(T);
+}
+
 template<typename MTYPE>
 using DISTFUNC = MTYPE(*)(const void *, const void *, const void *);
 
+// Distances from a query to the n vectors at base + ids[j] * stride, written to out[j]
+template<typename MTYPE>
+using DISTBATCHFUNC = void(*)(const void *, const char *, size_t, const tableint *, size_t, const void *, MTYPE *);
+
+// DISTBATCHFUNC taking a bound after the parameter, the distances not below it may be left as partial sums
+template<typename MTYPE>
+using DISTBOUNDEDBATCHFUNC =
+    void(*)(const void *, const char *, size_t, const tableint *, size_t, const void *, MTYPE, MTYPE *);
+
+// Instruction sets of the distance kernels, from the narrowest to the widest, each one implies the previous ones
+enum class SimdLevel {
+    Scalar,
+    SSE,
+    SSE41,
+    AVX,
+    AVX2,
+    AVX512,
+    AVX512BW,
+    AVX512VNNI,
+};
+
+static const char *SimdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE: return "SSE";
+    case SimdLevel::SSE41: return "SSE4.1";
+    case SimdLevel::AVX: return "AVX";
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::AVX512: return "AVX512";
+    case SimdLevel::AVX512BW: return "AVX512BW";
+    case SimdLevel::AVX512VNNI: return "AVX512VNNI";
+    default: return "scalar";
+    }
+}
+
+static SimdLevel DetectSimdLevel() {
+    SimdLevel level = SimdLevel::Scalar;
+#if defined(USE_SSE)
+    level = SimdLevel::SSE;
+    if (!SSE41Capable()) return level;
+    level = SimdLevel::SSE41;
+    if (!AVXCapable()) return level;
+    level = SimdLevel::AVX;
+    if (!AVX2Capable()) return level;
+    level = SimdLevel::AVX2;
+    if (!AVX512Capable()) return level;
+    level = SimdLevel::AVX512;
+    if (!AVX512BWCapable()) return level;
+    level = SimdLevel::AVX512BW;
+    if (!AVX512VNNICapable()) return level;
+    level = SimdLevel::AVX512VNNI;
+#endif
+    return level;
+}
+
+/*
+* Widest instruction set supported by the CPU. It is detected once, the spaces pick their kernels from it
+* without writing any shared state, so they can be created concurrently.
+*/
+static SimdLevel CpuSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+// Widest instruction set enabled by the build flags, the kernels templated on SIMD lanes are limited to it
+static SimdLevel BuildSimdLevel() {
+#if defined(USE_AVX512BW) && defined(USE_AVX512VNNI)
+    return SimdLevel::AVX512VNNI;
+#elif defined(USE_AVX512BW)
+    return SimdLevel::AVX512BW;
+#elif defined(USE_AVX512)
+    return SimdLevel::AVX512;
+#elif defined(USE_AVX2)
+    return SimdLevel::AVX2;
+#elif defined(USE_AVX)
+    return SimdLevel::AVX;
+#elif defined(USE_SSE41)
+    return SimdLevel::SSE41;
+#elif defined(USE_SSE)
+    return SimdLevel::SSE;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// A distance function picked by the dispatch, with the instruction set it runs
+template<typename MTYPE>
+struct DistanceKernel {
+    DISTFUNC<MTYPE> func;
+    SimdLevel level;
+    const char *name;
+};
+
 template<typename MTYPE>
 class SpaceInterface {
  public:
     // virtual void search(void *);
     virtual size_t get_data_size() = 0;
 
+    // size of a search query, spaces whose queries are encoded differently from the stored data override it
+    virtual size_t get_query_data_size() {
+        return get_data_size();
+    }
+
     virtual DISTFUNC<MTYPE> get_dist_func() = 0;
 
+    // distance between a search query and a stored element,
+    // spaces whose queries are encoded differently from the stored data override it
+    virtual DISTFUNC<MTYPE> get_query_dist_func() {
+        return get_dist_func();
+    }
+
+    // one-to-many kernel scoring the neighbors of an element in one call, nullptr for spaces without one
+    virtual DISTBATCHFUNC<MTYPE> get_dist_batch_func() {
+        return nullptr;
+    }
+
+    // batch counterpart of get_query_dist_func, spaces overriding both with a batch kernel override it too
+    virtual DISTBATCHFUNC<MTYPE> get_query_dist_batch_func() {
+        return get_dist_batch_func();
+    }
+
+    // batch kernel stopping early at the elements reaching a bound, for distances summing non-negative terms
+    virtual DISTBOUNDEDBATCHFUNC<MTYPE> get_dist_bounded_batch_func() {
+        return nullptr;
+    }
+
+    virtual DISTBOUNDEDBATCHFUNC<MTYPE> get_query_dist_bounded_batch_func() {
+        return get_dist_bounded_batch_func();
+    }
+
     virtual void *get_dist_func_param() = 0;
 
+    // name and instruction set of the kernel behind get_dist_func, for the spaces dispatching on the CPU
+    virtual const char *get_dist_func_name() {
+        return "custom";
+    }
+
+    virtual SimdLevel get_dist_func_simd_level() {
+        return SimdLevel::Scalar;
+    }
+
     virtual ~SpaceInterface() {}
 };
 
@@ -191,10 +530,19 @@ class AlgorithmInterface {
     virtual std::priority_queue<std::pair<dist_t, labeltype>>
         searchKnn(const void*, size_t, BaseFilterFunctor* isIdAllowed = nullptr) const = 0;
 
+    // Same search, adding its work to stats if given. Algorithms that do not count their work only search
+    virtual std::priority_queue<std::pair<dist_t, labeltype>>
+        searchKnn(const void* query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats*) const {
+        return searchKnn(query_data, k, isIdAllowed);
+    }
+
     // Return k nearest neighbor in the order of closer fist
     virtual std::vector<std::pair<dist_t, labeltype>>
         searchKnnCloserFirst(const void* query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const;
 
+    std::vector<std::pair<dist_t, labeltype>>
+        searchKnnCloserFirst(const void* query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats* stats) const;
+
     virtual void saveIndex(const std::string &location) = 0;
     virtual ~AlgorithmInterface(){
     }
@@ -204,10 +552,17 @@ template<typename dist_t>
 std::vector<std::pair<dist_t, labeltype>>
 AlgorithmInterface<dist_t>::searchKnnCloserFirst(const void* query_data, size_t k,
                                                  BaseFilterFunctor* isIdAllowed) const {
+    return searchKnnCloserFirst(query_data, k, isIdAllowed, nullptr);
+}
+
+template<typename dist_t>
+std::vector<std::pair<dist_t, labeltype>>
+AlgorithmInterface<dist_t>::searchKnnCloserFirst(const void* query_data, size_t k,
+                                                 BaseFilterFunctor* isIdAllowed, SearchStats* stats) const {
     std::vector<std::pair<dist_t, labeltype>> result;
 
     // here searchKnn returns the result in the order of further first
-    auto ret = searchKnn(query_data, k, isIdAllowed);
+    auto ret = searchKnn(query_data, k, isIdAllowed, stats);
     {
         size_t sz = ret.size();
         result.resize(sz);
@@ -221,8 +576,15 @@ AlgorithmInterface<dist_t>::searchKnnCloserFirst(const void* query_data, size_t
 }
 }  // namespace hnswlib
 
+#include "space_int8.h"
+#include "space_batch.h"
+#include "space_fixed_dim.h"
 #include "space_l2.h"
 #include "space_ip.h"
+#include "space_fp16.h"
+#include "space_sq8.h"
+#include "space_pq.h"
 #include "stop_condition.h"
 #include "bruteforce.h"
 #include "hnswalg.h"
+#include "hnswalg_pq.h"
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace hnswlib {
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/*
+* Allocates size bytes starting at a 2MB boundary, and asks the kernel to back them with
+* transparent huge pages where it supports it. Returns nullptr on failure.
+* The memory must be released with freeHugePageAligned.
+*/
+static void *mallocHugePageAligned(size_t size) {
+    if (size == 0)
+        size = 1;
+#if defined(_WIN32)
+    return _aligned_malloc(size, HUGE_PAGE_SIZE);
+#else
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, HUGE_PAGE_SIZE, size) != 0)
+        return nullptr;
+#if defined(MADV_HUGEPAGE)
+    madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return ptr;
+#endif
+}
+
+
+static void freeHugePageAligned(void *ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+
+/*
+* Allocator of the large arrays of an index (the base layer).
+* allocate returns nullptr on failure, deallocate is never called with nullptr.
+* An allocator must outlive the indexes using it.
+*/
+class IndexAllocator {
+ public:
+    virtual void *allocate(size_t size) = 0;
+
+    virtual void deallocate(void *ptr) = 0;
+
+    virtual ~IndexAllocator() {}
+};
+
+
+enum class HugePages {
+    NONE,         // regular pages
+    TRANSPARENT,  // regular mapping advised for transparent huge pages
+    EXPLICIT      // MAP_HUGETLB pages from the reserved pool, TRANSPARENT when the pool is empty
+};
+
+enum class NumaPolicy {
+    DEFAULT,     // pages land on the node of the thread touching them first
+    INTERLEAVE,  // pages are spread round-robin over all online nodes
+    BIND         // pages are placed on one node, e.g. for one replica of the index per node
+};
+
+
+/*
+* Allocates anonymous memory mappings with the given huge page and NUMA placement.
+* Placement is best effort: when the system does not support it the memory is still allocated, with default placement.
+* On Windows the memory comes from _aligned_malloc.
+*/
+class PageAllocator : public IndexAllocator {
+    HugePages huge_pages_;
+    NumaPolicy numa_policy_;
+    int numa_node_;
+
+    std::mutex sizes_lock_;
+    std::unordered_map<void *, size_t> sizes_;  // size of each mapping
+
+ public:
+    PageAllocator(HugePages huge_pages = HugePages::TRANSPARENT, NumaPolicy numa_policy = NumaPolicy::DEFAULT, int numa_node = 0)
+        : huge_pages_(huge_pages), numa_policy_(numa_policy), numa_node_(numa_node) {
+    }
+
+
+    void *allocate(size_t size) {
+#if defined(_WIN32)
+        return mallocHugePageAligned(size);
+#else
+        size_t page_size = huge_pages_ == HugePages::NONE ? (size_t) sysconf(_SC_PAGESIZE) : HUGE_PAGE_SIZE;
+        size = (std::max(size, (size_t) 1) + page_size - 1) / page_size * page_size;
+
+        void *ptr = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+        if (huge_pages_ == HugePages::EXPLICIT)
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (ptr == MAP_FAILED) {
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                return nullptr;
+#if defined(MADV_HUGEPAGE)
+            if (huge_pages_ != HugePages::NONE)
+                madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+        }
+        // the policy applies to the pages touched from now on
+        setNumaPolicy(ptr, size);
+
+        std::unique_lock <std::mutex> lock(sizes_lock_);
+        sizes_[ptr] = size;
+        return ptr;
+#endif
+    }
+
+
+    void deallocate(void *ptr) {
+#if defined(_WIN32)
+        freeHugePageAligned(ptr);
+#else
+        size_t size;
+        {
+            std::unique_lock <std::mutex> lock(sizes_lock_);
+            auto it = sizes_.find(ptr);
+            if (it == sizes_.end())
+                throw std::runtime_error("Cannot deallocate memory that was not allocated by this allocator");
+            size = it->second;
+            sizes_.erase(it);
+        }
+        munmap(ptr, size);
+#endif
+    }
+
+
+    // Online NUMA nodes, as listed by /sys/devices/system/node/online (e.g. "0-1,3")
+    static std::vector<int> getOnlineNumaNodes() {
+        std::vector<int> nodes;
+        std::ifstream input("/sys/devices/system/node/online");
+        std::string range;
+        while (std::getline(input, range, ',')) {
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int node = first; node <= last; node++)
+                    nodes.push_back(node);
+            } catch (std::exception &e) {
+                return std::vector<int>();
+            }
+        }
+        return nodes;
+    }
+
+ private:
+    void setNumaPolicy(void *ptr, size_t size) const {
+#if defined(__linux__) && defined(SYS_mbind)
+        const int MPOL_BIND_MODE = 2;  // MPOL_BIND of <numaif.h>
+        const int MPOL_INTERLEAVE_MODE = 3;  // MPOL_INTERLEAVE of <numaif.h>
+        const int MAX_NODES = 1024;
+        if (numa_policy_ == NumaPolicy::DEFAULT)
+            return;
+
+        std::vector<int> nodes;
+        if (numa_policy_ == NumaPolicy::BIND)
+            nodes.push_back(numa_node_);
+        else
+            nodes = getOnlineNumaNodes();
+        unsigned long node_mask[MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+        bool any_node = false;
+        for (int node : nodes) {
+            if (node < 0 || node >= MAX_NODES)
+                continue;
+            node_mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+            any_node = true;
+        }
+        if (!any_node)
+            return;
+        int mode = numa_policy_ == NumaPolicy::BIND ? MPOL_BIND_MODE : MPOL_INTERLEAVE_MODE;
+        // failures leave the default placement
+        syscall(SYS_mbind, ptr, size, mode, node_mask, (unsigned long) MAX_NODES + 1, 0);
+#endif
+    }
+};
+}  // namespace hnswlib
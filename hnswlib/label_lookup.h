@@ -0,0 +1,306 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace hnswlib {
+
+/*
+* Map from the external labels to the internal ids, safe to use from several threads.
+* Labels are hashed to shards, each an open addressing table with linear probing and a lock of its own,
+* so that insertions of different labels rarely wait on each other.
+* In dense mode labels must be below the capacity and index an array of ids directly: no hashing,
+* 4 bytes per element and lock-free lookups.
+* The id with all bits set marks free slots, so it cannot be stored.
+*/
+template<typename label_t, typename id_t>
+class LabelLookup {
+    static const size_t NUM_SHARDS = 256;
+    static const size_t MIN_SHARD_CAPACITY = 16;
+    static const id_t NO_ID = (id_t) -1;
+
+    struct Shard {
+        std::mutex lock;
+        std::vector<label_t> labels;
+        std::vector<id_t> ids;  // NO_ID for free slots
+        size_t size{0};
+        char padding[64];  // keeps the locks of neighbouring shards on separate cache lines
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<size_t> size_{0};
+
+    bool dense_{false};
+    size_t capacity_{0};
+    std::unique_ptr<std::atomic<id_t>[]> dense_ids_;  // dense mode only, NO_ID for absent labels
+
+    static inline uint64_t hash(label_t label) {
+        // finalizer of MurmurHash3, spreads consecutive labels over shards and slots
+        uint64_t h = (uint64_t) label;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    inline Shard &shardOf(label_t label) const {
+        // the top bits pick the shard, the bottom ones the slot
+        return shards_[hash(label) >> 56];
+    }
+
+    // Slot holding the label, or the free slot ending its probe sequence
+    static size_t findSlot(const Shard &shard, label_t label, bool &found) {
+        size_t mask = shard.ids.size() - 1;
+        for (size_t slot = hash(label) & mask;; slot = (slot + 1) & mask) {
+            if (shard.ids[slot] == NO_ID) {
+                found = false;
+                return slot;
+            }
+            if (shard.labels[slot] == label) {
+                found = true;
+                return slot;
+            }
+        }
+    }
+
+    static void rehash(Shard &shard, size_t capacity) {
+        std::vector<label_t> old_labels(capacity);
+        std::vector<id_t> old_ids(capacity, (id_t) NO_ID);
+        old_labels.swap(shard.labels);
+        old_ids.swap(shard.ids);
+        for (size_t i = 0; i < old_ids.size(); i++) {
+            if (old_ids[i] == NO_ID)
+                continue;
+            bool found;
+            size_t slot = findSlot(shard, old_labels[i], found);
+            shard.labels[slot] = old_labels[i];
+            shard.ids[slot] = old_ids[i];
+        }
+    }
+
+    // Adds a label known to be absent from the shard, whose lock is held
+    void insertNew(Shard &shard, label_t label, id_t id) {
+        if ((shard.size + 1) * 4 > shard.ids.size() * 3)
+            rehash(shard, std::max(shard.ids.size() * 2, (size_t) MIN_SHARD_CAPACITY));
+        bool found;
+        size_t slot = findSlot(shard, label, found);
+        shard.labels[slot] = label;
+        shard.ids[slot] = id;
+        shard.size++;
+        size_++;
+    }
+
+    void checkDenseLabel(label_t label) const {
+        if ((size_t) label >= capacity_)
+            throw std::runtime_error("The label exceeds the capacity of the dense label lookup");
+    }
+
+ public:
+    LabelLookup() : shards_(new Shard[NUM_SHARDS]) {
+    }
+
+
+    bool isDense() const {
+        return dense_;
+    }
+
+
+    /*
+    * Switches between the hashed and the dense mode, removing all the labels.
+    * Must not run concurrently with other operations.
+    */
+    void setDense(bool dense) {
+        clear();
+        dense_ = dense;
+        dense_ids_.reset(nullptr);
+        resize(capacity_);
+    }
+
+
+    // Sets the number of labels of the dense mode, keeping the stored ones
+    void resize(size_t capacity) {
+        if (dense_) {
+            std::unique_ptr<std::atomic<id_t>[]> dense_ids(new std::atomic<id_t>[capacity]);
+            for (size_t i = 0; i < capacity; i++)
+                dense_ids[i].store(i < capacity_ && dense_ids_ ? dense_ids_[i].load() : (id_t) NO_ID);
+            dense_ids_.swap(dense_ids);
+        }
+        capacity_ = capacity;
+    }
+
+
+    size_t size() const {
+        return size_;
+    }
+
+
+    bool find(label_t label, id_t &id) const {
+        if (dense_) {
+            if ((size_t) label >= capacity_)
+                return false;
+            id = dense_ids_[label].load(std::memory_order_acquire);
+            return id != NO_ID;
+        }
+        Shard &shard = shardOf(label);
+        std::unique_lock <std::mutex> lock(shard.lock);
+        if (shard.size == 0)
+            return false;
+        bool found;
+        size_t slot = findSlot(shard, label, found);
+        if (found)
+            id = shard.ids[slot];
+        return found;
+    }
+
+
+    id_t at(label_t label) const {
+        id_t id;
+        if (!find(label, id))
+            throw std::runtime_error("Label not found");
+        return id;
+    }
+
+
+    /*
+    * Returns false with the id of the label if it is present, otherwise stores the id returned by make_id and returns true.
+    * make_id runs while the label is locked, and the label is not added if it throws.
+    */
+    template<typename make_id_t>
+    bool findOrInsert(label_t label, id_t &id, make_id_t make_id) {
+        if (dense_)
+            checkDenseLabel(label);
+        Shard &shard = shardOf(label);
+        std::unique_lock <std::mutex> lock(shard.lock);
+        if (dense_) {
+            id = dense_ids_[label].load(std::memory_order_relaxed);
+            if (id != NO_ID)
+                return false;
+            id = make_id();
+            dense_ids_[label].store(id, std::memory_order_release);
+            size_++;
+            return true;
+        }
+        if (shard.size > 0) {
+            bool found;
+            size_t slot = findSlot(shard, label, found);
+            if (found) {
+                id = shard.ids[slot];
+                return false;
+            }
+        }
+        id = make_id();
+        insertNew(shard, label, id);
+        return true;
+    }
+
+
+    // Maps the label to the id, replacing its previous id if any
+    void set(label_t label, id_t id) {
+        if (dense_)
+            checkDenseLabel(label);
+        Shard &shard = shardOf(label);
+        std::unique_lock <std::mutex> lock(shard.lock);
+        if (dense_) {
+            if (dense_ids_[label].exchange(id, std::memory_order_release) == NO_ID)
+                size_++;
+            return;
+        }
+        if (shard.size > 0) {
+            bool found;
+            size_t slot = findSlot(shard, label, found);
+            if (found) {
+                shard.ids[slot] = id;
+                return;
+            }
+        }
+        insertNew(shard, label, id);
+    }
+
+
+    bool erase(label_t label) {
+        if (dense_ && (size_t) label >= capacity_)
+            return false;
+        Shard &shard = shardOf(label);
+        std::unique_lock <std::mutex> lock(shard.lock);
+        if (dense_) {
+            if (dense_ids_[label].exchange(NO_ID, std::memory_order_release) == NO_ID)
+                return false;
+            size_--;
+            return true;
+        }
+        if (shard.size == 0)
+            return false;
+        bool found;
+        size_t hole = findSlot(shard, label, found);
+        if (!found)
+            return false;
+        // backward shift deletion: moves up the following entries that can no longer be reached past the hole
+        size_t mask = shard.ids.size() - 1;
+        for (size_t slot = (hole + 1) & mask; shard.ids[slot] != NO_ID; slot = (slot + 1) & mask) {
+            size_t home = hash(shard.labels[slot]) & mask;
+            if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+                shard.labels[hole] = shard.labels[slot];
+                shard.ids[hole] = shard.ids[slot];
+                hole = slot;
+            }
+        }
+        shard.ids[hole] = NO_ID;
+        shard.size--;
+        size_--;
+        return true;
+    }
+
+
+    // Must not run concurrently with other operations
+    void clear() {
+        for (size_t i = 0; i < NUM_SHARDS; i++) {
+            std::vector<label_t>().swap(shards_[i].labels);
+            std::vector<id_t>().swap(shards_[i].ids);
+            shards_[i].size = 0;
+        }
+        if (dense_) {
+            for (size_t i = 0; i < capacity_; i++)
+                dense_ids_[i].store(NO_ID);
+        }
+        size_ = 0;
+    }
+
+
+    // Calls f(label, id) for every label, must not run concurrently with modifications
+    template<typename function_t>
+    void forEach(function_t f) const {
+        if (dense_) {
+            for (size_t label = 0; label < capacity_; label++) {
+                id_t id = dense_ids_[label].load(std::memory_order_relaxed);
+                if (id != NO_ID)
+                    f((label_t) label, id);
+            }
+            return;
+        }
+        for (size_t i = 0; i < NUM_SHARDS; i++) {
+            const Shard &shard = shards_[i];
+            for (size_t slot = 0; slot < shard.ids.size(); slot++) {
+                if (shard.ids[slot] != NO_ID)
+                    f(shard.labels[slot], shard.ids[slot]);
+            }
+        }
+    }
+
+
+    // Bytes used by the map
+    size_t memoryUsage() const {
+        size_t bytes = NUM_SHARDS * sizeof(Shard);
+        if (dense_)
+            return bytes + capacity_ * sizeof(std::atomic<id_t>);
+        for (size_t i = 0; i < NUM_SHARDS; i++)
+            bytes += shards_[i].ids.size() * (sizeof(label_t) + sizeof(id_t));
+        return bytes;
+    }
+};
+}  // namespace hnswlib
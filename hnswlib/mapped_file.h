@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hnswlib {
+
+/*
+* Read-only memory mapping of a whole file.
+* The mapping is shared, so several processes opening the same file use one physical copy from the page cache.
+*/
+class MappedFile {
+    const char *data_{nullptr};
+    size_t size_{0};
+    std::string location_;
+#if defined(_WIN32)
+    HANDLE file_{INVALID_HANDLE_VALUE};
+    HANDLE mapping_{nullptr};
+#endif
+
+ public:
+    explicit MappedFile(const std::string &location) : location_(location) {
+#if defined(_WIN32)
+        file_ = CreateFileA(location.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Cannot open file");
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size)) {
+            CloseHandle(file_);
+            throw std::runtime_error("Cannot get size of the file");
+        }
+        size_ = (size_t) file_size.QuadPart;
+        if (size_ == 0) {
+            CloseHandle(file_);
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) {
+            CloseHandle(file_);
+            throw std::runtime_error("Cannot map file");
+        }
+        data_ = (const char *) MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (data_ == nullptr) {
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+            throw std::runtime_error("Cannot map file");
+        }
+#else
+        int fd = open(location.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file");
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot get size of the file");
+        }
+        size_ = (size_t) st.st_size;
+        if (size_ == 0) {
+            close(fd);
+            throw std::runtime_error("Index seems to be corrupted or unsupported");
+        }
+        void *ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+        close(fd);
+        if (ptr == MAP_FAILED)
+            throw std::runtime_error("Cannot map file");
+        data_ = (const char *) ptr;
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+        CloseHandle(mapping_);
+        CloseHandle(file_);
+#else
+        munmap((void *) data_, size_);
+#endif
+    }
+
+    const char *data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    const std::string &location() const {
+        return location_;
+    }
+};
+}  // namespace hnswlib
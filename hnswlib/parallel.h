@@ -0,0 +1,85 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <exception>
+
+namespace hnswlib {
+
+/*
+* Runs fn(i, thread_id) for every i in [0, n) on num_threads threads, 0 for all the cores.
+* The range is cut in chunks dealt round-robin to per-thread queues, so that every thread starts with the lowest indices.
+* A thread takes the chunks of its queue from the front, and when it runs out steals from the back of the other queues.
+* The first exception thrown by fn stops the remaining work and is rethrown once all the threads are done.
+*/
+template<typename function_t>
+void parallelFor(size_t n, size_t num_threads, size_t chunk_size, function_t fn) {
+    if (num_threads == 0)
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    if (chunk_size == 0)
+        chunk_size = 1;
+    size_t num_chunks = (n + chunk_size - 1) / chunk_size;
+    num_threads = std::min(num_threads, std::max(num_chunks, (size_t) 1));
+    if (num_threads == 1) {
+        for (size_t i = 0; i < n; i++)
+            fn(i, 0);
+        return;
+    }
+
+    // queue t holds the chunks t, t + num_threads, ..., from its position front to its position back
+    struct Queue {
+        std::mutex lock;
+        size_t front{0};
+        size_t back{0};
+        char padding[64];  // keeps the queues on separate cache lines
+    };
+    std::unique_ptr<Queue[]> queues(new Queue[num_threads]);
+    for (size_t t = 0; t < num_threads; t++)
+        queues[t].back = (num_chunks - t + num_threads - 1) / num_threads;
+
+    std::atomic<bool> stop{false};
+    std::exception_ptr exception = nullptr;
+    std::mutex exception_lock;
+
+    auto worker = [&](size_t thread_id) {
+        for (size_t victim_offset = 0; victim_offset < num_threads && !stop;) {
+            size_t victim = (thread_id + victim_offset) % num_threads;
+            Queue &queue = queues[victim];
+            size_t position;
+            {
+                std::unique_lock <std::mutex> lock(queue.lock);
+                if (queue.front == queue.back) {
+                    lock.unlock();
+                    victim_offset++;
+                    continue;
+                }
+                position = victim == thread_id ? queue.front++ : --queue.back;
+            }
+            size_t begin = (position * num_threads + victim) * chunk_size;
+            size_t end = std::min(begin + chunk_size, n);
+            try {
+                for (size_t i = begin; i < end && !stop; i++)
+                    fn(i, thread_id);
+            } catch (...) {
+                std::unique_lock <std::mutex> lock(exception_lock);
+                if (!exception)
+                    exception = std::current_exception();
+                stop = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++)
+        threads.push_back(std::thread(worker, t));
+    worker(0);
+    for (auto &thread : threads)
+        thread.join();
+    if (exception)
+        std::rethrow_exception(exception);
+}
+}  // namespace hnswlib
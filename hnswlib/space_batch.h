@@ -0,0 +1,349 @@
+#pragma once
+#include "hnswlib.h"
+#include "space_int8.h"
+#include <algorithm>
+
+namespace hnswlib {
+
+/*
+* One-to-many kernels: distances from a query to the vectors base + ids[j] * stride, see DISTBATCHFUNC.
+* The vectors are scored 4 at a time, so that every block of the query is loaded once for the 4 of them
+* and the 4 sums hide each other's latency, while the vectors of the next group are prefetched.
+* The lanes classes wrap the SIMD registers of an instruction set: float lanes multiply,
+* int8 lanes widen the elements to 16 bits and multiply pairwise into 32-bit sums.
+*/
+struct FloatLanesBase {
+    typedef float elem_t;
+    typedef float result_t;
+
+    // adds the dimensions left over by the registers, and turns the inner product into a distance
+    static float finish(float res, const float *query, const float *vector, size_t begin, size_t qty, bool is_l2) {
+        for (size_t i = begin; i < qty; i++)
+            res += is_l2 ? (query[i] - vector[i]) * (query[i] - vector[i]) : query[i] * vector[i];
+        return is_l2 ? res : 1.0f - res;
+    }
+};
+
+struct FloatLanes : FloatLanesBase {
+    typedef float reg;
+    enum { width = 1 };
+    static reg zero() { return 0; }
+    static reg load(const float *p) { return *p; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg dot(reg a, reg b) { return a * b; }
+    static reg add(reg a, reg b) { return a + b; }
+    static float sum(reg v) { return v; }
+};
+
+#if defined(USE_SSE)
+struct FloatLanesSSE : FloatLanesBase {
+    typedef __m128 reg;
+    enum { width = 4 };
+    static reg zero() { return _mm_setzero_ps(); }
+    static reg load(const float *p) { return _mm_loadu_ps(p); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg dot(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static float sum(reg v) {
+        float PORTABLE_ALIGN32 TmpRes[4];
+        _mm_store_ps(TmpRes, v);
+        return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+    }
+};
+#endif
+
+#if defined(USE_AVX)
+struct FloatLanesAVX : FloatLanesBase {
+    typedef __m256 reg;
+    enum { width = 8 };
+    static reg zero() { return _mm256_setzero_ps(); }
+    static reg load(const float *p) { return _mm256_loadu_ps(p); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg dot(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static float sum(reg v) {
+        float PORTABLE_ALIGN32 TmpRes[8];
+        _mm256_store_ps(TmpRes, v);
+        return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+    }
+};
+#endif
+
+#if defined(USE_AVX512)
+struct FloatLanesAVX512 : FloatLanesBase {
+    typedef __m512 reg;
+    enum { width = 16 };
+    static reg zero() { return _mm512_setzero_ps(); }
+    static reg load(const float *p) { return _mm512_loadu_ps(p); }
+    static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    static reg dot(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    static float sum(reg v) { return _mm512_reduce_add_ps(v); }
+};
+#endif
+
+// The widest float lanes enabled by the build flags, for kernels chosen at compile time
+#if defined(USE_AVX512)
+typedef FloatLanesAVX512 FloatLanesBuild;
+#elif defined(USE_AVX)
+typedef FloatLanesAVX FloatLanesBuild;
+#elif defined(USE_SSE)
+typedef FloatLanesSSE FloatLanesBuild;
+#else
+typedef FloatLanes FloatLanesBuild;
+#endif
+
+template<bool is_signed>
+struct Int8LanesBase {
+    typedef int8_t elem_t;
+    typedef int result_t;
+
+    static int finish(int res, const int8_t *query, const int8_t *vector, size_t begin, size_t qty, bool is_l2) {
+        if (is_l2)
+            return res + DistanceInt8Ref<is_signed, true>(query, vector, begin, qty);
+        return -res + DistanceInt8Ref<is_signed, false>(query, vector, begin, qty);
+    }
+};
+
+template<bool is_signed>
+struct Int8Lanes : Int8LanesBase<is_signed> {
+    typedef int reg;
+    enum { width = 1 };
+    static reg zero() { return 0; }
+    static reg load(const int8_t *p) { return is_signed ? (int) *p : (int) *(const uint8_t *) p; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg dot(reg a, reg b) { return a * b; }
+    static reg add(reg a, reg b) { return a + b; }
+    static int sum(reg v) { return v; }
+};
+
+#if defined(USE_SSE41)
+template<bool is_signed>
+struct Int8LanesSSE41 : Int8LanesBase<is_signed> {
+    typedef __m128i reg;
+    enum { width = 8 };
+    static reg zero() { return _mm_setzero_si128(); }
+    static reg load(const int8_t *p) { return WidenInt8SSE41<is_signed>(_mm_loadl_epi64((const __m128i *) p)); }
+    static reg sub(reg a, reg b) { return _mm_sub_epi16(a, b); }
+    static reg dot(reg a, reg b) { return _mm_madd_epi16(a, b); }
+    static reg add(reg a, reg b) { return _mm_add_epi32(a, b); }
+    static int sum(reg v) {
+        int PORTABLE_ALIGN32 TmpRes[4];
+        _mm_store_si128((__m128i *) TmpRes, v);
+        return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+    }
+};
+#endif
+
+#if defined(USE_AVX2)
+template<bool is_signed>
+struct Int8LanesAVX2 : Int8LanesBase<is_signed> {
+    typedef __m256i reg;
+    enum { width = 16 };
+    static reg zero() { return _mm256_setzero_si256(); }
+    static reg load(const int8_t *p) { return LoadInt8AVX2<is_signed>(p); }
+    static reg sub(reg a, reg b) { return _mm256_sub_epi16(a, b); }
+    static reg dot(reg a, reg b) { return _mm256_madd_epi16(a, b); }
+    static reg add(reg a, reg b) { return _mm256_add_epi32(a, b); }
+    static int sum(reg v) {
+        int PORTABLE_ALIGN32 TmpRes[8];
+        _mm256_store_si256((__m256i *) TmpRes, v);
+        return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+    }
+};
+#endif
+
+#if defined(USE_AVX512BW)
+template<bool is_signed>
+struct Int8LanesAVX512BW : Int8LanesBase<is_signed> {
+    typedef __m512i reg;
+    enum { width = 32 };
+    static reg zero() { return _mm512_setzero_si512(); }
+    static reg load(const int8_t *p) { return LoadInt8AVX512<is_signed>(p); }
+    static reg sub(reg a, reg b) { return _mm512_sub_epi16(a, b); }
+    static reg dot(reg a, reg b) { return _mm512_madd_epi16(a, b); }
+    static reg add(reg a, reg b) { return _mm512_add_epi32(a, b); }
+    static int sum(reg v) { return _mm512_reduce_add_epi32(v); }
+};
+#endif
+
+// Adds the dimensions [begin, end) of 4 vectors to their sums, the query is loaded once per block
+template<typename lanes, bool is_l2>
+static inline void
+DistBatch4(const typename lanes::elem_t *query, const typename lanes::elem_t *const *vectors, size_t begin, size_t end,
+           typename lanes::reg *sums) {
+    typename lanes::reg sum0 = sums[0];
+    typename lanes::reg sum1 = sums[1];
+    typename lanes::reg sum2 = sums[2];
+    typename lanes::reg sum3 = sums[3];
+    for (size_t i = begin; i < end; i += lanes::width) {
+        typename lanes::reg q = lanes::load(query + i);
+        typename lanes::reg v0 = lanes::load(vectors[0] + i);
+        typename lanes::reg v1 = lanes::load(vectors[1] + i);
+        typename lanes::reg v2 = lanes::load(vectors[2] + i);
+        typename lanes::reg v3 = lanes::load(vectors[3] + i);
+        if (is_l2) {
+            v0 = lanes::sub(q, v0);
+            v1 = lanes::sub(q, v1);
+            v2 = lanes::sub(q, v2);
+            v3 = lanes::sub(q, v3);
+            sum0 = lanes::add(sum0, lanes::dot(v0, v0));
+            sum1 = lanes::add(sum1, lanes::dot(v1, v1));
+            sum2 = lanes::add(sum2, lanes::dot(v2, v2));
+            sum3 = lanes::add(sum3, lanes::dot(v3, v3));
+        } else {
+            sum0 = lanes::add(sum0, lanes::dot(q, v0));
+            sum1 = lanes::add(sum1, lanes::dot(q, v1));
+            sum2 = lanes::add(sum2, lanes::dot(q, v2));
+            sum3 = lanes::add(sum3, lanes::dot(q, v3));
+        }
+    }
+    sums[0] = sum0;
+    sums[1] = sum1;
+    sums[2] = sum2;
+    sums[3] = sum3;
+}
+
+// dim > 0 fixes the dimension at compile time, see space_fixed_dim.h
+template<typename lanes, bool is_l2, size_t dim = 0>
+static void
+DistBatch(const void *query, const char *base, size_t stride, const tableint *ids, size_t n, const void *qty_ptr,
+          typename lanes::result_t *out) {
+    typedef typename lanes::elem_t elem_t;
+    const elem_t *q = (const elem_t *) query;
+    size_t qty = dim > 0 ? dim : *((size_t *) qty_ptr);
+    size_t qty_lanes = qty / lanes::width * lanes::width;
+
+    for (size_t j = 0; j < n; j += 4) {
+        // a short last group repeats its last vector
+        const elem_t *vectors[4];
+        for (size_t k = 0; k < 4; k++)
+            vectors[k] = (const elem_t *) (base + ids[j + k < n ? j + k : n - 1] * stride);
+#ifdef USE_SSE
+        for (size_t k = j + 4; k < j + 8 && k < n; k++)
+            _mm_prefetch(base + ids[k] * stride, _MM_HINT_T0);
+#endif
+        typename lanes::reg sums[4] = {lanes::zero(), lanes::zero(), lanes::zero(), lanes::zero()};
+        DistBatch4<lanes, is_l2>(q, vectors, 0, qty_lanes, sums);
+        for (size_t k = 0; k < 4 && j + k < n; k++)
+            out[j + k] = lanes::finish(lanes::sum(sums[k]), q, vectors[k], qty_lanes, qty, is_l2);
+    }
+}
+
+/*
+* Squared L2 batch kernel with a bound, see DISTBOUNDEDBATCHFUNC. The sums of a group are compared with
+* the bound every 64 dimensions, and the group stops once all 4 reached it: a search keeping the elements
+* closer than its current worst candidate then rejects them without reading the rest of their vectors.
+*/
+template<typename lanes, size_t dim = 0>
+static void
+DistBatchBounded(const void *query, const char *base, size_t stride, const tableint *ids, size_t n,
+                 const void *qty_ptr, typename lanes::result_t bound, typename lanes::result_t *out) {
+    typedef typename lanes::elem_t elem_t;
+    const elem_t *q = (const elem_t *) query;
+    size_t qty = dim > 0 ? dim : *((size_t *) qty_ptr);
+    size_t qty_lanes = qty / lanes::width * lanes::width;
+    const size_t block = lanes::width < 64 ? 64 / lanes::width * lanes::width : lanes::width;
+
+    for (size_t j = 0; j < n; j += 4) {
+        const elem_t *vectors[4];
+        for (size_t k = 0; k < 4; k++)
+            vectors[k] = (const elem_t *) (base + ids[j + k < n ? j + k : n - 1] * stride);
+#ifdef USE_SSE
+        for (size_t k = j + 4; k < j + 8 && k < n; k++)
+            _mm_prefetch(base + ids[k] * stride, _MM_HINT_T0);
+#endif
+        typename lanes::reg sums[4] = {lanes::zero(), lanes::zero(), lanes::zero(), lanes::zero()};
+        size_t end = std::min(block, qty_lanes);
+        DistBatch4<lanes, true>(q, vectors, 0, end, sums);
+        // the sums are only reduced up to the first one below the bound
+        while (end < qty_lanes && !(lanes::sum(sums[0]) >= bound && lanes::sum(sums[1]) >= bound &&
+                                    lanes::sum(sums[2]) >= bound && lanes::sum(sums[3]) >= bound)) {
+            size_t begin = end;
+            end = std::min(begin + block, qty_lanes);
+            DistBatch4<lanes, true>(q, vectors, begin, end, sums);
+        }
+        for (size_t k = 0; k < 4 && j + k < n; k++) {
+            typename lanes::result_t res = lanes::sum(sums[k]);
+            out[j + k] = end < qty_lanes ? res : lanes::finish(res, q, vectors[k], qty_lanes, qty, true);
+        }
+    }
+}
+
+// Picks the widest float batch kernel supported by both the build and the CPU
+template<bool is_l2>
+static DISTBATCHFUNC<float>
+SelectFloatBatchKernel() {
+    DISTBATCHFUNC<float> kernel = DistBatch<FloatLanes, is_l2>;
+#if defined(USE_SSE)
+    kernel = DistBatch<FloatLanesSSE, is_l2>;
+#endif
+#if defined(USE_AVX)
+    if (CpuSimdLevel() >= SimdLevel::AVX)
+        kernel = DistBatch<FloatLanesAVX, is_l2>;
+#endif
+#if defined(USE_AVX512)
+    if (CpuSimdLevel() >= SimdLevel::AVX512)
+        kernel = DistBatch<FloatLanesAVX512, is_l2>;
+#endif
+    return kernel;
+}
+
+// Bounded counterpart of SelectFloatBatchKernel<true>
+static DISTBOUNDEDBATCHFUNC<float>
+SelectFloatBoundedBatchKernel() {
+    DISTBOUNDEDBATCHFUNC<float> kernel = DistBatchBounded<FloatLanes>;
+#if defined(USE_SSE)
+    kernel = DistBatchBounded<FloatLanesSSE>;
+#endif
+#if defined(USE_AVX)
+    if (CpuSimdLevel() >= SimdLevel::AVX)
+        kernel = DistBatchBounded<FloatLanesAVX>;
+#endif
+#if defined(USE_AVX512)
+    if (CpuSimdLevel() >= SimdLevel::AVX512)
+        kernel = DistBatchBounded<FloatLanesAVX512>;
+#endif
+    return kernel;
+}
+
+// Picks the widest int8 batch kernel supported by both the build and the CPU
+template<bool is_signed, bool is_l2>
+static DISTBATCHFUNC<int>
+SelectInt8BatchKernel() {
+    DISTBATCHFUNC<int> kernel = DistBatch<Int8Lanes<is_signed>, is_l2>;
+#if defined(USE_SSE41)
+    if (CpuSimdLevel() >= SimdLevel::SSE41)
+        kernel = DistBatch<Int8LanesSSE41<is_signed>, is_l2>;
+#endif
+#if defined(USE_AVX2)
+    if (CpuSimdLevel() >= SimdLevel::AVX2)
+        kernel = DistBatch<Int8LanesAVX2<is_signed>, is_l2>;
+#endif
+#if defined(USE_AVX512BW)
+    if (CpuSimdLevel() >= SimdLevel::AVX512BW)
+        kernel = DistBatch<Int8LanesAVX512BW<is_signed>, is_l2>;
+#endif
+    return kernel;
+}
+
+// Bounded counterpart of SelectInt8BatchKernel<is_signed, true>
+template<bool is_signed>
+static DISTBOUNDEDBATCHFUNC<int>
+SelectInt8BoundedBatchKernel() {
+    DISTBOUNDEDBATCHFUNC<int> kernel = DistBatchBounded<Int8Lanes<is_signed>>;
+#if defined(USE_SSE41)
+    if (CpuSimdLevel() >= SimdLevel::SSE41)
+        kernel = DistBatchBounded<Int8LanesSSE41<is_signed>>;
+#endif
+#if defined(USE_AVX2)
+    if (CpuSimdLevel() >= SimdLevel::AVX2)
+        kernel = DistBatchBounded<Int8LanesAVX2<is_signed>>;
+#endif
+#if defined(USE_AVX512BW)
+    if (CpuSimdLevel() >= SimdLevel::AVX512BW)
+        kernel = DistBatchBounded<Int8LanesAVX512BW<is_signed>>;
+#endif
+    return kernel;
+}
+}  // namespace hnswlib
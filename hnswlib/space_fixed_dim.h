@@ -0,0 +1,109 @@
+#pragma once
+#include "hnswlib.h"
+#include "space_batch.h"
+
+namespace hnswlib {
+
+/*
+* Float kernels specialized for the common embedding dimensions. The dimension is a template parameter,
+* so the kernels never read it from the distance parameter and all their loops have a known length, which the
+* compiler unrolls. The single vector kernels also spread the blocks over 4 independent sums.
+*/
+template<typename lanes, bool is_l2>
+static inline typename lanes::reg
+FixedDimTerm(const float *a, const float *b) {
+    typename lanes::reg va = lanes::load(a);
+    typename lanes::reg vb = lanes::load(b);
+    if (is_l2) {
+        va = lanes::sub(va, vb);
+        vb = va;
+    }
+    return lanes::dot(va, vb);
+}
+
+// dim = 0 reads the dimension from the distance parameter, like the generic kernels
+template<typename lanes, bool is_l2, size_t dim>
+static float
+DistanceFixedDim(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const float *pVect2 = (const float *) pVect2v;
+    const size_t qty = dim > 0 ? dim : *((size_t *) qty_ptr);
+    const size_t qty_lanes = qty / lanes::width * lanes::width;
+    const size_t qty_groups = qty / (4 * lanes::width) * (4 * lanes::width);
+
+    typename lanes::reg sum0 = lanes::zero();
+    typename lanes::reg sum1 = lanes::zero();
+    typename lanes::reg sum2 = lanes::zero();
+    typename lanes::reg sum3 = lanes::zero();
+    for (size_t i = 0; i < qty_groups; i += 4 * lanes::width) {
+        sum0 = lanes::add(sum0, FixedDimTerm<lanes, is_l2>(pVect1 + i, pVect2 + i));
+        sum1 = lanes::add(sum1, FixedDimTerm<lanes, is_l2>(pVect1 + i + lanes::width, pVect2 + i + lanes::width));
+        sum2 = lanes::add(sum2, FixedDimTerm<lanes, is_l2>(pVect1 + i + 2 * lanes::width, pVect2 + i + 2 * lanes::width));
+        sum3 = lanes::add(sum3, FixedDimTerm<lanes, is_l2>(pVect1 + i + 3 * lanes::width, pVect2 + i + 3 * lanes::width));
+    }
+    for (size_t i = qty_groups; i < qty_lanes; i += lanes::width)
+        sum0 = lanes::add(sum0, FixedDimTerm<lanes, is_l2>(pVect1 + i, pVect2 + i));
+    float res = lanes::sum(lanes::add(lanes::add(sum0, sum1), lanes::add(sum2, sum3)));
+    return lanes::finish(res, pVect1, pVect2, qty_lanes, qty, is_l2);
+}
+
+// Single and batch kernels of a space, nullptr when the dimension has no specialized kernels
+struct FixedDimKernels {
+    DISTFUNC<float> dist_func{nullptr};
+    DISTBATCHFUNC<float> dist_batch_func{nullptr};
+    DISTBOUNDEDBATCHFUNC<float> dist_bounded_batch_func{nullptr};  // L2 only
+    SimdLevel level{SimdLevel::Scalar};
+};
+
+template<typename lanes, bool is_l2>
+static FixedDimKernels
+FixedDimKernelsFor(size_t dim) {
+    FixedDimKernels kernels;
+    switch (dim) {
+#define HNSWLIB_FIXED_DIM(D) \
+    case D: \
+        kernels.dist_func = DistanceFixedDim<lanes, is_l2, D>; \
+        kernels.dist_batch_func = DistBatch<lanes, is_l2, D>; \
+        kernels.dist_bounded_batch_func = is_l2 ? DistBatchBounded<lanes, D> : nullptr; \
+        break;
+    HNSWLIB_FIXED_DIM(96)
+    HNSWLIB_FIXED_DIM(100)
+    HNSWLIB_FIXED_DIM(128)
+    HNSWLIB_FIXED_DIM(256)
+    HNSWLIB_FIXED_DIM(384)
+    HNSWLIB_FIXED_DIM(512)
+    HNSWLIB_FIXED_DIM(768)
+    HNSWLIB_FIXED_DIM(960)
+    HNSWLIB_FIXED_DIM(1024)
+    HNSWLIB_FIXED_DIM(1536)
+#undef HNSWLIB_FIXED_DIM
+    default:
+        break;
+    }
+    return kernels;
+}
+
+// Picks the kernels specialized for dim with the widest instruction set supported by both the build and the CPU
+template<bool is_l2>
+static FixedDimKernels
+SelectFixedDimKernels(size_t dim) {
+    FixedDimKernels kernels;
+#if defined(USE_SSE)
+    kernels = FixedDimKernelsFor<FloatLanesSSE, is_l2>(dim);
+    kernels.level = SimdLevel::SSE;
+#endif
+#if defined(USE_AVX)
+    if (CpuSimdLevel() >= SimdLevel::AVX) {
+        kernels = FixedDimKernelsFor<FloatLanesAVX, is_l2>(dim);
+        kernels.level = SimdLevel::AVX;
+    }
+#endif
+#if defined(USE_AVX512)
+    if (CpuSimdLevel() >= SimdLevel::AVX512) {
+        kernels = FixedDimKernelsFor<FloatLanesAVX512, is_l2>(dim);
+        kernels.level = SimdLevel::AVX512;
+    }
+#endif
+    return kernels;
+}
+}  // namespace hnswlib
@@ -0,0 +1,274 @@
+#pragma once
+#include "hnswlib.h"
+#include <stdint.h>
+
+namespace hnswlib {
+
+typedef uint16_t fp16_t;
+
+// IEEE half precision conversions, rounding to nearest even
+static fp16_t
+FloatToHalf(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7fffffff;
+
+    if (abs >= 0x7f800000)  // inf or nan
+        return (fp16_t) (sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+    if (abs >= 0x477ff000)  // rounds above the largest half
+        return (fp16_t) (sign | 0x7c00);
+
+    if (abs < 0x38800000) {  // subnormal half
+        int shift = 126 - (int) (abs >> 23);
+        if (shift > 24)
+            return (fp16_t) sign;
+        uint32_t mant = (abs & 0x7fffff) | 0x800000;
+        uint32_t h = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1)))
+            h++;
+        return (fp16_t) (sign | h);
+    }
+
+    uint32_t h = (abs >> 13) - ((127 - 15) << 10);
+    uint32_t rem = abs & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+    return (fp16_t) (sign | h);
+}
+
+static float
+HalfToFloat(fp16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t x;
+
+    if (exp == 0x1f) {
+        x = sign | 0x7f800000 | (mant << 13);
+    } else if (exp != 0) {
+        x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    } else if (mant == 0) {
+        x = sign;
+    } else {
+        // normalize the subnormal half
+        exp = 127 - 15 + 1;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+
+    float value;
+    memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+// Distance between two stored half precision vectors
+static float
+L2SqrFP16(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const fp16_t *pVect1 = (const fp16_t *) pVect1v;
+    const fp16_t *pVect2 = (const fp16_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+
+    float res = 0;
+    for (size_t i = 0; i < qty; i++) {
+        float t = HalfToFloat(pVect1[i]) - HalfToFloat(pVect2[i]);
+        res += t * t;
+    }
+    return res;
+}
+
+// Distance from a float query to a stored half precision vector
+static float
+L2SqrFP16Query(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const fp16_t *pVect2 = (const fp16_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+
+    float res = 0;
+    for (size_t i = 0; i < qty; i++) {
+        float t = pVect1[i] - HalfToFloat(pVect2[i]);
+        res += t * t;
+    }
+    return res;
+}
+
+#if defined(HNSWLIB_AVX512_KERNELS)
+
+HNSWLIB_TARGET("avx512f") static float
+L2SqrFP16AVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const fp16_t *pVect1 = (const fp16_t *) pVect1v;
+    const fp16_t *pVect2 = (const fp16_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty16 = qty >> 4 << 4;
+
+    __m512 sum = _mm512_set1_ps(0);
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m512 v1 = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *) (pVect1 + i)));
+        __m512 v2 = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *) (pVect2 + i)));
+        __m512 diff = _mm512_sub_ps(v1, v2);
+        sum = _mm512_fmadd_ps(diff, diff, sum);
+    }
+
+    size_t qty_left = qty - qty16;
+    return _mm512_reduce_add_ps(sum) + L2SqrFP16(pVect1 + qty16, pVect2 + qty16, &qty_left);
+}
+
+HNSWLIB_TARGET("avx512f") static float
+L2SqrFP16QueryAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const fp16_t *pVect2 = (const fp16_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty16 = qty >> 4 << 4;
+
+    __m512 sum = _mm512_set1_ps(0);
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m512 v1 = _mm512_loadu_ps(pVect1 + i);
+        __m512 v2 = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *) (pVect2 + i)));
+        __m512 diff = _mm512_sub_ps(v1, v2);
+        sum = _mm512_fmadd_ps(diff, diff, sum);
+    }
+
+    size_t qty_left = qty - qty16;
+    return _mm512_reduce_add_ps(sum) + L2SqrFP16Query(pVect1 + qty16, pVect2 + qty16, &qty_left);
+}
+#endif
+
+// F16C has no SimdLevel of its own, the kernels converting with it are picked from AVX2, which implies it on every CPU
+#if defined(HNSWLIB_AVX2_KERNELS) && (defined(USE_F16C) || defined(HNSWLIB_DISPATCH))
+#define HNSWLIB_FP16_AVX_KERNELS
+
+HNSWLIB_TARGET("avx,f16c") static float
+L2SqrFP16AVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const fp16_t *pVect1 = (const fp16_t *) pVect1v;
+    const fp16_t *pVect2 = (const fp16_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty8 = qty >> 3 << 3;
+    float PORTABLE_ALIGN32 TmpRes[8];
+
+    __m256 sum = _mm256_set1_ps(0);
+    for (size_t i = 0; i < qty8; i += 8) {
+        __m256 v1 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (pVect1 + i)));
+        __m256 v2 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (pVect2 + i)));
+        __m256 diff = _mm256_sub_ps(v1, v2);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+    }
+
+    _mm256_store_ps(TmpRes, sum);
+    size_t qty_left = qty - qty8;
+    return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7] +
+            L2SqrFP16(pVect1 + qty8, pVect2 + qty8, &qty_left);
+}
+
+HNSWLIB_TARGET("avx,f16c") static float
+L2SqrFP16QueryAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const fp16_t *pVect2 = (const fp16_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty8 = qty >> 3 << 3;
+    float PORTABLE_ALIGN32 TmpRes[8];
+
+    __m256 sum = _mm256_set1_ps(0);
+    for (size_t i = 0; i < qty8; i += 8) {
+        __m256 v1 = _mm256_loadu_ps(pVect1 + i);
+        __m256 v2 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (pVect2 + i)));
+        __m256 diff = _mm256_sub_ps(v1, v2);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+    }
+
+    _mm256_store_ps(TmpRes, sum);
+    size_t qty_left = qty - qty8;
+    return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7] +
+            L2SqrFP16Query(pVect1 + qty8, pVect2 + qty8, &qty_left);
+}
+#endif
+
+// Picks the widest kernel up to level, see CpuSimdLevel, between stored vectors or from a float query if is_query
+template<bool is_query>
+static DistanceKernel<float>
+SelectFP16Kernel(SimdLevel level = CpuSimdLevel()) {
+    DistanceKernel<float> kernel = is_query ? DistanceKernel<float>{L2SqrFP16Query, SimdLevel::Scalar, "L2SqrFP16Query"}
+                                            : DistanceKernel<float>{L2SqrFP16, SimdLevel::Scalar, "L2SqrFP16"};
+#if defined(HNSWLIB_FP16_AVX_KERNELS)
+    if (level >= SimdLevel::AVX2) {
+        kernel = is_query ? DistanceKernel<float>{L2SqrFP16QueryAVX, SimdLevel::AVX2, "L2SqrFP16QueryAVX"}
+                          : DistanceKernel<float>{L2SqrFP16AVX, SimdLevel::AVX2, "L2SqrFP16AVX"};
+    }
+#endif
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (level >= SimdLevel::AVX512) {
+        kernel = is_query ? DistanceKernel<float>{L2SqrFP16QueryAVX512, SimdLevel::AVX512, "L2SqrFP16QueryAVX512"}
+                          : DistanceKernel<float>{L2SqrFP16AVX512, SimdLevel::AVX512, "L2SqrFP16AVX512"};
+    }
+#endif
+    return kernel;
+}
+
+/*
+* Vectors are stored in half precision, use encode() to convert them before addPoint.
+* Search queries stay in float.
+*/
+class L2SpaceFP16 : public SpaceInterface<float> {
+    DistanceKernel<float> kernel_;
+    DISTFUNC<float> fstdistfunc_;
+    DISTFUNC<float> fstquerydistfunc_;
+    size_t data_size_;
+    size_t dim_;
+
+ public:
+    L2SpaceFP16(size_t dim) {
+        kernel_ = SelectFP16Kernel<false>();
+        fstdistfunc_ = kernel_.func;
+        fstquerydistfunc_ = SelectFP16Kernel<true>().func;
+        dim_ = dim;
+        data_size_ = dim * sizeof(fp16_t);
+    }
+
+    void encode(const float *vec, void *code) const {
+        fp16_t *out = (fp16_t *) code;
+        for (size_t i = 0; i < dim_; i++)
+            out[i] = FloatToHalf(vec[i]);
+    }
+
+    void decode(const void *code, float *vec) const {
+        const fp16_t *in = (const fp16_t *) code;
+        for (size_t i = 0; i < dim_; i++)
+            vec[i] = HalfToFloat(in[i]);
+    }
+
+    size_t get_data_size() {
+        return data_size_;
+    }
+
+    DISTFUNC<float> get_dist_func() {
+        return fstdistfunc_;
+    }
+
+    // queries are not encoded
+    size_t get_query_data_size() {
+        return dim_ * sizeof(float);
+    }
+
+    DISTFUNC<float> get_query_dist_func() {
+        return fstquerydistfunc_;
+    }
+
+    void *get_dist_func_param() {
+        return &dim_;
+    }
+
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
+    ~L2SpaceFP16() {}
+};
+}  // namespace hnswlib
@@ -0,0 +1,192 @@
+#pragma once
+#include "hnswlib.h"
+#include <stdint.h>
+
+namespace hnswlib {
+
+/*
+* Squared L2 and inner product kernels for vectors of uint8_t (is_signed = false) or int8_t (is_signed = true).
+* The inner product kernels return the negated dot product, so that closer vectors get smaller distances.
+* Elements are widened to 16 bits and multiplied pairwise into 32-bit sums,
+* SIMD kernels finish the remaining dimensions with the scalar loop.
+*/
+template<bool is_signed, bool is_l2>
+static int
+DistanceInt8Ref(const void *pVect1v, const void *pVect2v, size_t begin, size_t qty) {
+    int res = 0;
+    for (size_t i = begin; i < qty; i++) {
+        int a = is_signed ? (int) ((const int8_t *) pVect1v)[i] : (int) ((const uint8_t *) pVect1v)[i];
+        int b = is_signed ? (int) ((const int8_t *) pVect2v)[i] : (int) ((const uint8_t *) pVect2v)[i];
+        res += is_l2 ? (a - b) * (a - b) : -a * b;
+    }
+    return res;
+}
+
+template<bool is_signed, bool is_l2>
+static int
+DistanceInt8(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    return DistanceInt8Ref<is_signed, is_l2>(pVect1v, pVect2v, 0, *((size_t *) qty_ptr));
+}
+
+#if defined(HNSWLIB_SSE41_KERNELS)
+
+template<bool is_signed>
+HNSWLIB_TARGET("sse4.1") static inline __m128i
+WidenInt8SSE41(__m128i v) {
+    return is_signed ? _mm_cvtepi8_epi16(v) : _mm_cvtepu8_epi16(v);
+}
+
+template<bool is_signed, bool is_l2>
+HNSWLIB_TARGET("sse4.1") static int
+DistanceInt8SSE41(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const int8_t *pVect1 = (const int8_t *) pVect1v;
+    const int8_t *pVect2 = (const int8_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty16 = qty >> 4 << 4;
+
+    __m128i sum = _mm_setzero_si128();
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m128i v1 = _mm_loadu_si128((const __m128i *) (pVect1 + i));
+        __m128i v2 = _mm_loadu_si128((const __m128i *) (pVect2 + i));
+        __m128i v1_lo = WidenInt8SSE41<is_signed>(v1);
+        __m128i v2_lo = WidenInt8SSE41<is_signed>(v2);
+        __m128i v1_hi = WidenInt8SSE41<is_signed>(_mm_srli_si128(v1, 8));
+        __m128i v2_hi = WidenInt8SSE41<is_signed>(_mm_srli_si128(v2, 8));
+        if (is_l2) {
+            __m128i diff_lo = _mm_sub_epi16(v1_lo, v2_lo);
+            __m128i diff_hi = _mm_sub_epi16(v1_hi, v2_hi);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(diff_lo, diff_lo));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(diff_hi, diff_hi));
+        } else {
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(v1_lo, v2_lo));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(v1_hi, v2_hi));
+        }
+    }
+
+    int PORTABLE_ALIGN32 TmpRes[4];
+    _mm_store_si128((__m128i *) TmpRes, sum);
+    int res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+    return (is_l2 ? res : -res) + DistanceInt8Ref<is_signed, is_l2>(pVect1v, pVect2v, qty16, qty);
+}
+#endif
+
+#if defined(HNSWLIB_AVX2_KERNELS)
+
+template<bool is_signed>
+HNSWLIB_TARGET("avx2") static inline __m256i
+LoadInt8AVX2(const int8_t *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    return is_signed ? _mm256_cvtepi8_epi16(v) : _mm256_cvtepu8_epi16(v);
+}
+
+template<bool is_signed, bool is_l2>
+HNSWLIB_TARGET("avx2") static int
+DistanceInt8AVX2(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const int8_t *pVect1 = (const int8_t *) pVect1v;
+    const int8_t *pVect2 = (const int8_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty16 = qty >> 4 << 4;
+
+    __m256i sum = _mm256_setzero_si256();
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m256i v1 = LoadInt8AVX2<is_signed>(pVect1 + i);
+        __m256i v2 = LoadInt8AVX2<is_signed>(pVect2 + i);
+        if (is_l2) {
+            __m256i diff = _mm256_sub_epi16(v1, v2);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+        } else {
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v1, v2));
+        }
+    }
+
+    int PORTABLE_ALIGN32 TmpRes[8];
+    _mm256_store_si256((__m256i *) TmpRes, sum);
+    int res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+    return (is_l2 ? res : -res) + DistanceInt8Ref<is_signed, is_l2>(pVect1v, pVect2v, qty16, qty);
+}
+#endif
+
+#if defined(HNSWLIB_AVX512BW_KERNELS)
+
+template<bool is_signed>
+HNSWLIB_TARGET("avx512f,avx512bw") static inline __m512i
+LoadInt8AVX512(const int8_t *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+    return is_signed ? _mm512_cvtepi8_epi16(v) : _mm512_cvtepu8_epi16(v);
+}
+
+template<bool is_signed, bool is_l2>
+HNSWLIB_TARGET("avx512f,avx512bw") static int
+DistanceInt8AVX512BW(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const int8_t *pVect1 = (const int8_t *) pVect1v;
+    const int8_t *pVect2 = (const int8_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty32 = qty >> 5 << 5;
+
+    __m512i sum = _mm512_setzero_si512();
+    for (size_t i = 0; i < qty32; i += 32) {
+        __m512i v1 = LoadInt8AVX512<is_signed>(pVect1 + i);
+        __m512i v2 = LoadInt8AVX512<is_signed>(pVect2 + i);
+        if (is_l2) {
+            __m512i diff = _mm512_sub_epi16(v1, v2);
+            sum = _mm512_add_epi32(sum, _mm512_madd_epi16(diff, diff));
+        } else {
+            sum = _mm512_add_epi32(sum, _mm512_madd_epi16(v1, v2));
+        }
+    }
+    int res = _mm512_reduce_add_epi32(sum);
+    return (is_l2 ? res : -res) + DistanceInt8Ref<is_signed, is_l2>(pVect1v, pVect2v, qty32, qty);
+}
+
+#if defined(HNSWLIB_AVX512VNNI_KERNELS)
+
+// VNNI fuses the pairwise multiply with the accumulation
+template<bool is_signed, bool is_l2>
+HNSWLIB_TARGET("avx512f,avx512bw,avx512vnni") static int
+DistanceInt8AVX512VNNI(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    const int8_t *pVect1 = (const int8_t *) pVect1v;
+    const int8_t *pVect2 = (const int8_t *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty32 = qty >> 5 << 5;
+
+    __m512i sum = _mm512_setzero_si512();
+    for (size_t i = 0; i < qty32; i += 32) {
+        __m512i v1 = LoadInt8AVX512<is_signed>(pVect1 + i);
+        __m512i v2 = LoadInt8AVX512<is_signed>(pVect2 + i);
+        if (is_l2) {
+            __m512i diff = _mm512_sub_epi16(v1, v2);
+            sum = _mm512_dpwssd_epi32(sum, diff, diff);
+        } else {
+            sum = _mm512_dpwssd_epi32(sum, v1, v2);
+        }
+    }
+    int res = _mm512_reduce_add_epi32(sum);
+    return (is_l2 ? res : -res) + DistanceInt8Ref<is_signed, is_l2>(pVect1v, pVect2v, qty32, qty);
+}
+#endif
+#endif
+
+// Picks the widest kernel up to level, see CpuSimdLevel, or the given scalar kernel
+template<bool is_signed, bool is_l2>
+static DistanceKernel<int>
+SelectInt8Kernel(SimdLevel level = CpuSimdLevel(),
+                 DistanceKernel<int> kernel = {DistanceInt8<is_signed, is_l2>, SimdLevel::Scalar, "DistanceInt8"}) {
+#if defined(HNSWLIB_SSE41_KERNELS)
+    if (level >= SimdLevel::SSE41)
+        kernel = {DistanceInt8SSE41<is_signed, is_l2>, SimdLevel::SSE41, "DistanceInt8SSE41"};
+#endif
+#if defined(HNSWLIB_AVX2_KERNELS)
+    if (level >= SimdLevel::AVX2)
+        kernel = {DistanceInt8AVX2<is_signed, is_l2>, SimdLevel::AVX2, "DistanceInt8AVX2"};
+#endif
+#if defined(HNSWLIB_AVX512BW_KERNELS)
+    if (level >= SimdLevel::AVX512BW)
+        kernel = {DistanceInt8AVX512BW<is_signed, is_l2>, SimdLevel::AVX512BW, "DistanceInt8AVX512BW"};
+#endif
+#if defined(HNSWLIB_AVX512VNNI_KERNELS)
+    if (level >= SimdLevel::AVX512VNNI)
+        kernel = {DistanceInt8AVX512VNNI<is_signed, is_l2>, SimdLevel::AVX512VNNI, "DistanceInt8AVX512VNNI"};
+#endif
+    return kernel;
+}
+}  // namespace hnswlib
@@ -1,5 +1,8 @@
 #pragma once
 #include "hnswlib.h"
+#include "space_int8.h"
+#include "space_batch.h"
+#include "space_fixed_dim.h"
 
 namespace hnswlib {
 
@@ -18,10 +21,10 @@ InnerProductDistance(const void *pVect1, const void *pVect2, const void *qty_ptr
     return 1.0f - InnerProduct(pVect1, pVect2, qty_ptr);
 }
 
-#if defined(USE_AVX)
+#if defined(HNSWLIB_AVX_KERNELS)
 
 // Favor using AVX if available.
-static float
+HNSWLIB_TARGET("avx") static float
 InnerProductSIMD4ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float PORTABLE_ALIGN32 TmpRes[8];
     float *pVect1 = (float *) pVect1v;
@@ -68,7 +71,7 @@ InnerProductSIMD4ExtAVX(const void *pVect1v, const void *pVect2v, const void *qt
     return sum;
 }
 
-static float
+HNSWLIB_TARGET("avx") static float
 InnerProductDistanceSIMD4ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     return 1.0f - InnerProductSIMD4ExtAVX(pVect1v, pVect2v, qty_ptr);
 }
@@ -141,9 +144,9 @@ InnerProductDistanceSIMD4ExtSSE(const void *pVect1v, const void *pVect2v, const
 #endif
 
 
-#if defined(USE_AVX512)
+#if defined(HNSWLIB_AVX512_KERNELS)
 
-static float
+HNSWLIB_TARGET("avx512f") static float
 InnerProductSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float PORTABLE_ALIGN64 TmpRes[16];
     float *pVect1 = (float *) pVect1v;
@@ -198,16 +201,16 @@ InnerProductSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void
     return sum;
 }
 
-static float
+HNSWLIB_TARGET("avx512f") static float
 InnerProductDistanceSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     return 1.0f - InnerProductSIMD16ExtAVX512(pVect1v, pVect2v, qty_ptr);
 }
 
 #endif
 
-#if defined(USE_AVX)
+#if defined(HNSWLIB_AVX_KERNELS)
 
-static float
+HNSWLIB_TARGET("avx") static float
 InnerProductSIMD16ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float PORTABLE_ALIGN32 TmpRes[8];
     float *pVect1 = (float *) pVect1v;
@@ -243,7 +246,7 @@ InnerProductSIMD16ExtAVX(const void *pVect1v, const void *pVect2v, const void *q
     return sum;
 }
 
-static float
+HNSWLIB_TARGET("avx") static float
 InnerProductDistanceSIMD16ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     return 1.0f - InnerProductSIMD16ExtAVX(pVect1v, pVect2v, qty_ptr);
 }
@@ -304,12 +307,8 @@ InnerProductDistanceSIMD16ExtSSE(const void *pVect1v, const void *pVect2v, const
 
 #endif
 
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-static DISTFUNC<float> InnerProductSIMD16Ext = InnerProductSIMD16ExtSSE;
-static DISTFUNC<float> InnerProductSIMD4Ext = InnerProductSIMD4ExtSSE;
-static DISTFUNC<float> InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtSSE;
-static DISTFUNC<float> InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtSSE;
-
+#if defined(USE_SSE)
+template<DISTFUNC<float> InnerProductSIMD16Ext>
 static float
 InnerProductDistanceSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
@@ -323,6 +322,7 @@ InnerProductDistanceSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v,
     return 1.0f - (res + res_tail);
 }
 
+template<DISTFUNC<float> InnerProductSIMD4Ext>
 static float
 InnerProductDistanceSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
@@ -339,45 +339,66 @@ InnerProductDistanceSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v,
 }
 #endif
 
+// Picks the inner product kernel for dim with the widest instruction set up to level, see CpuSimdLevel
+static DistanceKernel<float>
+SelectInnerProductKernel(size_t dim, SimdLevel level) {
+    DistanceKernel<float> kernel = {InnerProductDistance, SimdLevel::Scalar, "InnerProductDistance"};
+#if defined(USE_SSE)
+    if (level < SimdLevel::SSE)
+        return kernel;
+    DistanceKernel<float> simd16 = {InnerProductDistanceSIMD16ExtSSE, SimdLevel::SSE, "InnerProductDistanceSIMD16Ext"};
+    DistanceKernel<float> simd4 = {InnerProductDistanceSIMD4ExtSSE, SimdLevel::SSE, "InnerProductDistanceSIMD4Ext"};
+    DISTFUNC<float> simd16_residuals = InnerProductDistanceSIMD16ExtResiduals<InnerProductSIMD16ExtSSE>;
+    DISTFUNC<float> simd4_residuals = InnerProductDistanceSIMD4ExtResiduals<InnerProductSIMD4ExtSSE>;
+#if defined(HNSWLIB_AVX_KERNELS)
+    if (level >= SimdLevel::AVX) {
+        simd16 = {InnerProductDistanceSIMD16ExtAVX, SimdLevel::AVX, "InnerProductDistanceSIMD16Ext"};
+        simd4 = {InnerProductDistanceSIMD4ExtAVX, SimdLevel::AVX, "InnerProductDistanceSIMD4Ext"};
+        simd16_residuals = InnerProductDistanceSIMD16ExtResiduals<InnerProductSIMD16ExtAVX>;
+        simd4_residuals = InnerProductDistanceSIMD4ExtResiduals<InnerProductSIMD4ExtAVX>;
+    }
+#endif
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (level >= SimdLevel::AVX512) {
+        simd16 = {InnerProductDistanceSIMD16ExtAVX512, SimdLevel::AVX512, "InnerProductDistanceSIMD16Ext"};
+        simd16_residuals = InnerProductDistanceSIMD16ExtResiduals<InnerProductSIMD16ExtAVX512>;
+    }
+#endif
+
+    if (dim % 16 == 0)
+        kernel = simd16;
+    else if (dim % 4 == 0)
+        kernel = simd4;
+    else if (dim > 16)
+        kernel = {simd16_residuals, simd16.level, "InnerProductDistanceSIMD16ExtResiduals"};
+    else if (dim > 4)
+        kernel = {simd4_residuals, simd4.level, "InnerProductDistanceSIMD4ExtResiduals"};
+#endif
+    return kernel;
+}
+
 class InnerProductSpace : public SpaceInterface<float> {
+    DistanceKernel<float> kernel_;
     DISTFUNC<float> fstdistfunc_;
+    DISTBATCHFUNC<float> fstdistbatchfunc_;
     size_t data_size_;
     size_t dim_;
 
  public:
     InnerProductSpace(size_t dim) {
-        fstdistfunc_ = InnerProductDistance;
-#if defined(USE_AVX) || defined(USE_SSE) || defined(USE_AVX512)
-    #if defined(USE_AVX512)
-        if (AVX512Capable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX512;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX512;
-        } else if (AVXCapable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
-        }
-    #elif defined(USE_AVX)
-        if (AVXCapable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
-        }
-    #endif
-    #if defined(USE_AVX)
-        if (AVXCapable()) {
-            InnerProductSIMD4Ext = InnerProductSIMD4ExtAVX;
-            InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtAVX;
+        kernel_ = SelectInnerProductKernel(dim, CpuSimdLevel());
+        fstdistbatchfunc_ = nullptr;
+        // the batch and fixed dimension kernels stop at the build flags, a portable build keeps the wider kernel
+        if (kernel_.level <= BuildSimdLevel()) {
+            fstdistbatchfunc_ = SelectFloatBatchKernel<false>();
+            // common dimensions get kernels specialized for them
+            FixedDimKernels fixed_dim_kernels = SelectFixedDimKernels<false>(dim);
+            if (fixed_dim_kernels.dist_func != nullptr) {
+                kernel_ = {fixed_dim_kernels.dist_func, fixed_dim_kernels.level, "DistanceFixedDim"};
+                fstdistbatchfunc_ = fixed_dim_kernels.dist_batch_func;
+            }
         }
-    #endif
-
-        if (dim % 16 == 0)
-            fstdistfunc_ = InnerProductDistanceSIMD16Ext;
-        else if (dim % 4 == 0)
-            fstdistfunc_ = InnerProductDistanceSIMD4Ext;
-        else if (dim > 16)
-            fstdistfunc_ = InnerProductDistanceSIMD16ExtResiduals;
-        else if (dim > 4)
-            fstdistfunc_ = InnerProductDistanceSIMD4ExtResiduals;
-#endif
+        fstdistfunc_ = kernel_.func;
         dim_ = dim;
         data_size_ = dim * sizeof(float);
     }
@@ -390,11 +411,127 @@ class InnerProductSpace : public SpaceInterface<float> {
         return fstdistfunc_;
     }
 
+    DISTBATCHFUNC<float> get_dist_batch_func() {
+        return fstdistbatchfunc_;
+    }
+
     void *get_dist_func_param() {
         return &dim_;
     }
 
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
 ~InnerProductSpace() {}
 };
 
+/*
+* Static functor of InnerProductSpace for HierarchicalNSW<float, InnerProductStaticDistance<dim>>,
+* the kernel is picked at compile time for the widest instruction set enabled by the build flags.
+* dim = 0 reads the dimension from the space.
+*/
+template<size_t dim = 0>
+struct InnerProductStaticDistance {
+    static const size_t dimension = dim;
+
+    static float distance(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+        return DistanceFixedDim<FloatLanesBuild, false, dim>(pVect1v, pVect2v, qty_ptr);
+    }
+};
+
+/*
+* Inner product spaces over vectors of uint8_t and int8_t.
+* The distance is the negated dot product.
+*/
+class InnerProductSpaceI : public SpaceInterface<int> {
+    DistanceKernel<int> kernel_;
+    DISTFUNC<int> fstdistfunc_;
+    DISTBATCHFUNC<int> fstdistbatchfunc_;
+    size_t data_size_;
+    size_t dim_;
+
+ public:
+    InnerProductSpaceI(size_t dim) {
+        kernel_ = SelectInt8Kernel<false, false>();
+        fstdistfunc_ = kernel_.func;
+        fstdistbatchfunc_ = kernel_.level <= BuildSimdLevel() ? SelectInt8BatchKernel<false, false>() : nullptr;
+        dim_ = dim;
+        data_size_ = dim * sizeof(uint8_t);
+    }
+
+    size_t get_data_size() {
+        return data_size_;
+    }
+
+    DISTFUNC<int> get_dist_func() {
+        return fstdistfunc_;
+    }
+
+    DISTBATCHFUNC<int> get_dist_batch_func() {
+        return fstdistbatchfunc_;
+    }
+
+    void *get_dist_func_param() {
+        return &dim_;
+    }
+
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
+    ~InnerProductSpaceI() {}
+};
+
+class InnerProductSpaceI8 : public SpaceInterface<int> {
+    DistanceKernel<int> kernel_;
+    DISTFUNC<int> fstdistfunc_;
+    DISTBATCHFUNC<int> fstdistbatchfunc_;
+    size_t data_size_;
+    size_t dim_;
+
+ public:
+    InnerProductSpaceI8(size_t dim) {
+        kernel_ = SelectInt8Kernel<true, false>();
+        fstdistfunc_ = kernel_.func;
+        fstdistbatchfunc_ = kernel_.level <= BuildSimdLevel() ? SelectInt8BatchKernel<true, false>() : nullptr;
+        dim_ = dim;
+        data_size_ = dim * sizeof(int8_t);
+    }
+
+    size_t get_data_size() {
+        return data_size_;
+    }
+
+    DISTFUNC<int> get_dist_func() {
+        return fstdistfunc_;
+    }
+
+    DISTBATCHFUNC<int> get_dist_batch_func() {
+        return fstdistbatchfunc_;
+    }
+
+    void *get_dist_func_param() {
+        return &dim_;
+    }
+
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
+    ~InnerProductSpaceI8() {}
+};
+
 }  // namespace hnswlib
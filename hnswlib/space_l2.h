@@ -1,5 +1,8 @@
 #pragma once
 #include "hnswlib.h"
+#include "space_int8.h"
+#include "space_batch.h"
+#include "space_fixed_dim.h"
 
 namespace hnswlib {
 
@@ -19,10 +22,10 @@ L2Sqr(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     return (res);
 }
 
-#if defined(USE_AVX512)
+#if defined(HNSWLIB_AVX512_KERNELS)
 
 // Favor using AVX512 if available.
-static float
+HNSWLIB_TARGET("avx512f") static float
 L2SqrSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float *pVect1 = (float *) pVect1v;
     float *pVect2 = (float *) pVect2v;
@@ -54,10 +57,10 @@ L2SqrSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_p
 }
 #endif
 
-#if defined(USE_AVX)
+#if defined(HNSWLIB_AVX_KERNELS)
 
 // Favor using AVX if available.
-static float
+HNSWLIB_TARGET("avx") static float
 L2SqrSIMD16ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float *pVect1 = (float *) pVect1v;
     float *pVect2 = (float *) pVect2v;
@@ -143,9 +146,8 @@ L2SqrSIMD16ExtSSE(const void *pVect1v, const void *pVect2v, const void *qty_ptr)
 }
 #endif
 
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-static DISTFUNC<float> L2SqrSIMD16Ext = L2SqrSIMD16ExtSSE;
-
+#if defined(USE_SSE)
+template<DISTFUNC<float> L2SqrSIMD16Ext>
 static float
 L2SqrSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
@@ -205,34 +207,66 @@ L2SqrSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty
 }
 #endif
 
+// Picks the L2 kernel for dim with the widest instruction set up to level, see CpuSimdLevel
+static DistanceKernel<float>
+SelectL2Kernel(size_t dim, SimdLevel level) {
+    DistanceKernel<float> kernel = {L2Sqr, SimdLevel::Scalar, "L2Sqr"};
+#if defined(USE_SSE)
+    if (level < SimdLevel::SSE)
+        return kernel;
+    DistanceKernel<float> simd16 = {L2SqrSIMD16ExtSSE, SimdLevel::SSE, "L2SqrSIMD16Ext"};
+    DISTFUNC<float> simd16_residuals = L2SqrSIMD16ExtResiduals<L2SqrSIMD16ExtSSE>;
+#if defined(HNSWLIB_AVX_KERNELS)
+    if (level >= SimdLevel::AVX) {
+        simd16 = {L2SqrSIMD16ExtAVX, SimdLevel::AVX, "L2SqrSIMD16Ext"};
+        simd16_residuals = L2SqrSIMD16ExtResiduals<L2SqrSIMD16ExtAVX>;
+    }
+#endif
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (level >= SimdLevel::AVX512) {
+        simd16 = {L2SqrSIMD16ExtAVX512, SimdLevel::AVX512, "L2SqrSIMD16Ext"};
+        simd16_residuals = L2SqrSIMD16ExtResiduals<L2SqrSIMD16ExtAVX512>;
+    }
+#endif
+
+    if (dim % 16 == 0)
+        kernel = simd16;
+    else if (dim % 4 == 0)
+        kernel = {L2SqrSIMD4Ext, SimdLevel::SSE, "L2SqrSIMD4Ext"};
+    else if (dim > 16)
+        kernel = {simd16_residuals, simd16.level, "L2SqrSIMD16ExtResiduals"};
+    else if (dim > 4)
+        kernel = {L2SqrSIMD4ExtResiduals, SimdLevel::SSE, "L2SqrSIMD4ExtResiduals"};
+#endif
+    return kernel;
+}
+
 class L2Space : public SpaceInterface<float> {
+    DistanceKernel<float> kernel_;
     DISTFUNC<float> fstdistfunc_;
+    DISTBATCHFUNC<float> fstdistbatchfunc_;
+    DISTBOUNDEDBATCHFUNC<float> fstdistboundedbatchfunc_;
     size_t data_size_;
     size_t dim_;
 
  public:
     L2Space(size_t dim) {
-        fstdistfunc_ = L2Sqr;
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-    #if defined(USE_AVX512)
-        if (AVX512Capable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX512;
-        else if (AVXCapable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX;
-    #elif defined(USE_AVX)
-        if (AVXCapable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX;
-    #endif
-
-        if (dim % 16 == 0)
-            fstdistfunc_ = L2SqrSIMD16Ext;
-        else if (dim % 4 == 0)
-            fstdistfunc_ = L2SqrSIMD4Ext;
-        else if (dim > 16)
-            fstdistfunc_ = L2SqrSIMD16ExtResiduals;
-        else if (dim > 4)
-            fstdistfunc_ = L2SqrSIMD4ExtResiduals;
-#endif
+        kernel_ = SelectL2Kernel(dim, CpuSimdLevel());
+        fstdistbatchfunc_ = nullptr;
+        fstdistboundedbatchfunc_ = nullptr;
+        // the batch and fixed dimension kernels stop at the build flags, a portable build keeps the wider kernel
+        if (kernel_.level <= BuildSimdLevel()) {
+            fstdistbatchfunc_ = SelectFloatBatchKernel<true>();
+            fstdistboundedbatchfunc_ = SelectFloatBoundedBatchKernel();
+            // common dimensions get kernels specialized for them
+            FixedDimKernels fixed_dim_kernels = SelectFixedDimKernels<true>(dim);
+            if (fixed_dim_kernels.dist_func != nullptr) {
+                kernel_ = {fixed_dim_kernels.dist_func, fixed_dim_kernels.level, "DistanceFixedDim"};
+                fstdistbatchfunc_ = fixed_dim_kernels.dist_batch_func;
+                fstdistboundedbatchfunc_ = fixed_dim_kernels.dist_bounded_batch_func;
+            }
+        }
+        fstdistfunc_ = kernel_.func;
         dim_ = dim;
         data_size_ = dim * sizeof(float);
     }
@@ -245,13 +279,43 @@ class L2Space : public SpaceInterface<float> {
         return fstdistfunc_;
     }
 
+    DISTBATCHFUNC<float> get_dist_batch_func() {
+        return fstdistbatchfunc_;
+    }
+
+    DISTBOUNDEDBATCHFUNC<float> get_dist_bounded_batch_func() {
+        return fstdistboundedbatchfunc_;
+    }
+
     void *get_dist_func_param() {
         return &dim_;
     }
 
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
     ~L2Space() {}
 };
 
+/*
+* Static functor of L2Space for HierarchicalNSW<float, L2StaticDistance<dim>>,
+* the kernel is picked at compile time for the widest instruction set enabled by the build flags.
+* dim = 0 reads the dimension from the space.
+*/
+template<size_t dim = 0>
+struct L2StaticDistance {
+    static const size_t dimension = dim;
+
+    static float distance(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+        return DistanceFixedDim<FloatLanesBuild, true, dim>(pVect1v, pVect2v, qty_ptr);
+    }
+};
+
 static int
 L2SqrI4x(const void *__restrict pVect1, const void *__restrict pVect2, const void *__restrict qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
@@ -292,16 +356,27 @@ static int L2SqrI(const void* __restrict pVect1, const void* __restrict pVect2,
 }
 
 class L2SpaceI : public SpaceInterface<int> {
+    DistanceKernel<int> kernel_;
     DISTFUNC<int> fstdistfunc_;
+    DISTBATCHFUNC<int> fstdistbatchfunc_;
+    DISTBOUNDEDBATCHFUNC<int> fstdistboundedbatchfunc_;
     size_t data_size_;
     size_t dim_;
 
  public:
     L2SpaceI(size_t dim) {
         if (dim % 4 == 0) {
-            fstdistfunc_ = L2SqrI4x;
+            kernel_ = {L2SqrI4x, SimdLevel::Scalar, "L2SqrI4x"};
         } else {
-            fstdistfunc_ = L2SqrI;
+            kernel_ = {L2SqrI, SimdLevel::Scalar, "L2SqrI"};
+        }
+        kernel_ = SelectInt8Kernel<false, true>(CpuSimdLevel(), kernel_);
+        fstdistfunc_ = kernel_.func;
+        fstdistbatchfunc_ = nullptr;
+        fstdistboundedbatchfunc_ = nullptr;
+        if (kernel_.level <= BuildSimdLevel()) {
+            fstdistbatchfunc_ = SelectInt8BatchKernel<false, true>();
+            fstdistboundedbatchfunc_ = SelectInt8BoundedBatchKernel<false>();
         }
         dim_ = dim;
         data_size_ = dim * sizeof(unsigned char);
@@ -315,10 +390,80 @@ class L2SpaceI : public SpaceInterface<int> {
         return fstdistfunc_;
     }
 
+    DISTBATCHFUNC<int> get_dist_batch_func() {
+        return fstdistbatchfunc_;
+    }
+
+    DISTBOUNDEDBATCHFUNC<int> get_dist_bounded_batch_func() {
+        return fstdistboundedbatchfunc_;
+    }
+
     void *get_dist_func_param() {
         return &dim_;
     }
 
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
     ~L2SpaceI() {}
 };
+
+// Squared L2 between vectors of int8_t
+class L2SpaceI8 : public SpaceInterface<int> {
+    DistanceKernel<int> kernel_;
+    DISTFUNC<int> fstdistfunc_;
+    DISTBATCHFUNC<int> fstdistbatchfunc_;
+    DISTBOUNDEDBATCHFUNC<int> fstdistboundedbatchfunc_;
+    size_t data_size_;
+    size_t dim_;
+
+ public:
+    L2SpaceI8(size_t dim) {
+        kernel_ = SelectInt8Kernel<true, true>();
+        fstdistfunc_ = kernel_.func;
+        fstdistbatchfunc_ = nullptr;
+        fstdistboundedbatchfunc_ = nullptr;
+        if (kernel_.level <= BuildSimdLevel()) {
+            fstdistbatchfunc_ = SelectInt8BatchKernel<true, true>();
+            fstdistboundedbatchfunc_ = SelectInt8BoundedBatchKernel<true>();
+        }
+        dim_ = dim;
+        data_size_ = dim * sizeof(int8_t);
+    }
+
+    size_t get_data_size() {
+        return data_size_;
+    }
+
+    DISTFUNC<int> get_dist_func() {
+        return fstdistfunc_;
+    }
+
+    DISTBATCHFUNC<int> get_dist_batch_func() {
+        return fstdistbatchfunc_;
+    }
+
+    DISTBOUNDEDBATCHFUNC<int> get_dist_bounded_batch_func() {
+        return fstdistboundedbatchfunc_;
+    }
+
+    void *get_dist_func_param() {
+        return &dim_;
+    }
+
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
+    ~L2SpaceI8() {}
+};
 }  // namespace hnswlib
@@ -0,0 +1,293 @@
+#pragma once
+#include "hnswlib.h"
+#include <vector>
+#include <random>
+#include <limits>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+
+namespace hnswlib {
+
+static const size_t PQ_KSUB = 256;  // centroids per subspace, codes are one byte per subspace
+
+struct PQDistParams {
+    size_t m;
+    const float *sdc_table;  // m x PQ_KSUB x PQ_KSUB distances between centroids of each subspace
+};
+
+/*
+* Asymmetric distance: the query is a lookup table of m x PQ_KSUB distances
+* from the query subvectors to the centroids (see ProductQuantizer::computeLookupTable).
+*/
+static float
+PQAdcDistance(const void *pLut, const void *pCode, const void *param_ptr) {
+    const float *lut = (const float *) pLut;
+    const unsigned char *code = (const unsigned char *) pCode;
+    size_t m = ((const PQDistParams *) param_ptr)->m;
+
+    float res0 = 0, res1 = 0, res2 = 0, res3 = 0;
+    size_t j = 0;
+    for (; j + 4 <= m; j += 4) {
+        res0 += lut[(j + 0) * PQ_KSUB + code[j + 0]];
+        res1 += lut[(j + 1) * PQ_KSUB + code[j + 1]];
+        res2 += lut[(j + 2) * PQ_KSUB + code[j + 2]];
+        res3 += lut[(j + 3) * PQ_KSUB + code[j + 3]];
+    }
+    for (; j < m; j++) {
+        res0 += lut[j * PQ_KSUB + code[j]];
+    }
+    return (res0 + res1) + (res2 + res3);
+}
+
+// Symmetric distance between two codes, used while building the graph
+static float
+PQSdcDistance(const void *pCode1, const void *pCode2, const void *param_ptr) {
+    const unsigned char *code1 = (const unsigned char *) pCode1;
+    const unsigned char *code2 = (const unsigned char *) pCode2;
+    const PQDistParams *param = (const PQDistParams *) param_ptr;
+    const float *table = param->sdc_table;
+
+    float res = 0;
+    for (size_t j = 0; j < param->m; j++) {
+        res += table[(j * PQ_KSUB + code1[j]) * PQ_KSUB + code2[j]];
+    }
+    return res;
+}
+
+
+/*
+* Product quantizer for the L2 distance.
+* A vector is split into m subvectors, each one is replaced by the id of its nearest of PQ_KSUB centroids.
+*/
+class ProductQuantizer {
+ public:
+    size_t dim_{0};
+    size_t m_{0};
+    size_t dsub_{0};
+    std::vector<float> centroids_;  // m x PQ_KSUB x dsub
+    std::vector<float> sdc_table_;
+
+    ProductQuantizer() {}
+
+    ProductQuantizer(size_t dim, size_t m) : dim_(dim), m_(m) {
+        if (m == 0 || dim % m != 0)
+            throw std::runtime_error("The dimension must be a multiple of the number of subquantizers");
+        dsub_ = dim / m;
+    }
+
+    explicit ProductQuantizer(const std::string &location) {
+        loadQuantizer(location);
+    }
+
+    bool isTrained() const {
+        return !centroids_.empty();
+    }
+
+    size_t getCodeSize() const {
+        return m_;
+    }
+
+    // number of floats in a query lookup table
+    size_t getLookupTableSize() const {
+        return m_ * PQ_KSUB;
+    }
+
+    const float *getCentroid(size_t sub, size_t id) const {
+        return centroids_.data() + (sub * PQ_KSUB + id) * dsub_;
+    }
+
+    /*
+    * k-means over each subspace. The training set must contain at least PQ_KSUB vectors,
+    * a sample of the data is usually enough.
+    */
+    void train(const float *data, size_t n, size_t n_iter = 25, size_t random_seed = 100) {
+        if (n < PQ_KSUB)
+            throw std::runtime_error("Product quantizer needs at least 256 training vectors");
+
+        std::mt19937 rng(random_seed);
+        centroids_.assign(m_ * PQ_KSUB * dsub_, 0);
+        std::vector<float> sub_data(n * dsub_);
+        std::vector<size_t> assign(n);
+        std::vector<size_t> counts(PQ_KSUB);
+        std::vector<size_t> perm(n);
+
+        for (size_t sub = 0; sub < m_; sub++) {
+            for (size_t i = 0; i < n; i++) {
+                memcpy(sub_data.data() + i * dsub_, data + i * dim_ + sub * dsub_, dsub_ * sizeof(float));
+            }
+            float *cent = centroids_.data() + sub * PQ_KSUB * dsub_;
+
+            // initialize with distinct random training points
+            std::iota(perm.begin(), perm.end(), 0);
+            std::shuffle(perm.begin(), perm.end(), rng);
+            for (size_t c = 0; c < PQ_KSUB; c++) {
+                memcpy(cent + c * dsub_, sub_data.data() + perm[c] * dsub_, dsub_ * sizeof(float));
+            }
+
+            for (size_t iter = 0; iter < n_iter; iter++) {
+                for (size_t i = 0; i < n; i++) {
+                    assign[i] = nearestCentroid(cent, sub_data.data() + i * dsub_);
+                }
+
+                std::fill(counts.begin(), counts.end(), 0);
+                std::fill(cent, cent + PQ_KSUB * dsub_, 0.0f);
+                for (size_t i = 0; i < n; i++) {
+                    counts[assign[i]]++;
+                    for (size_t d = 0; d < dsub_; d++)
+                        cent[assign[i] * dsub_ + d] += sub_data[i * dsub_ + d];
+                }
+                for (size_t c = 0; c < PQ_KSUB; c++) {
+                    if (counts[c] == 0)
+                        continue;
+                    for (size_t d = 0; d < dsub_; d++)
+                        cent[c * dsub_ + d] /= counts[c];
+                }
+
+                // split the largest cluster to fill every empty one
+                for (size_t c = 0; c < PQ_KSUB; c++) {
+                    if (counts[c] != 0)
+                        continue;
+                    size_t largest = std::max_element(counts.begin(), counts.end()) - counts.begin();
+                    for (size_t d = 0; d < dsub_; d++) {
+                        float value = cent[largest * dsub_ + d];
+                        float eps = (d % 2 == 0 ? 1 : -1) * (std::fabs(value) + 1e-6f) * 1e-3f;
+                        cent[c * dsub_ + d] = value + eps;
+                        cent[largest * dsub_ + d] = value - eps;
+                    }
+                    counts[c] = counts[largest] / 2;
+                    counts[largest] -= counts[c];
+                }
+            }
+        }
+        computeSdcTable();
+    }
+
+    void encode(const float *vec, unsigned char *code) const {
+        for (size_t sub = 0; sub < m_; sub++) {
+            code[sub] = (unsigned char) nearestCentroid(getCentroid(sub, 0), vec + sub * dsub_);
+        }
+    }
+
+    void decode(const unsigned char *code, float *vec) const {
+        for (size_t sub = 0; sub < m_; sub++) {
+            memcpy(vec + sub * dsub_, getCentroid(sub, code[sub]), dsub_ * sizeof(float));
+        }
+    }
+
+    // fills getLookupTableSize() floats, the table is the query passed to the search
+    void computeLookupTable(const float *query, float *lut) const {
+        for (size_t sub = 0; sub < m_; sub++) {
+            for (size_t c = 0; c < PQ_KSUB; c++) {
+                lut[sub * PQ_KSUB + c] = subDistance(query + sub * dsub_, getCentroid(sub, c));
+            }
+        }
+    }
+
+    void saveQuantizer(const std::string &location) const {
+        if (!isTrained())
+            throw std::runtime_error("Product quantizer is not trained");
+        std::ofstream output(location, std::ios::binary);
+        writeBinaryPOD(output, dim_);
+        writeBinaryPOD(output, m_);
+        output.write((const char *) centroids_.data(), centroids_.size() * sizeof(float));
+        output.close();
+    }
+
+    void loadQuantizer(const std::string &location) {
+        std::ifstream input(location, std::ios::binary);
+        if (!input.is_open())
+            throw std::runtime_error("Cannot open file");
+
+        readBinaryPOD(input, dim_);
+        readBinaryPOD(input, m_);
+        if (m_ == 0 || dim_ % m_ != 0)
+            throw std::runtime_error("Product quantizer seems to be corrupted or unsupported");
+        dsub_ = dim_ / m_;
+        centroids_.resize(m_ * PQ_KSUB * dsub_);
+        input.read((char *) centroids_.data(), centroids_.size() * sizeof(float));
+        if (!input)
+            throw std::runtime_error("Product quantizer seems to be corrupted or unsupported");
+        input.close();
+        computeSdcTable();
+    }
+
+ private:
+    float subDistance(const float *a, const float *b) const {
+        float res = 0;
+        for (size_t d = 0; d < dsub_; d++) {
+            float t = a[d] - b[d];
+            res += t * t;
+        }
+        return res;
+    }
+
+    size_t nearestCentroid(const float *cent, const float *x) const {
+        size_t best = 0;
+        float best_dist = std::numeric_limits<float>::max();
+        for (size_t c = 0; c < PQ_KSUB; c++) {
+            float dist = subDistance(x, cent + c * dsub_);
+            if (dist < best_dist) {
+                best_dist = dist;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    void computeSdcTable() {
+        sdc_table_.resize(m_ * PQ_KSUB * PQ_KSUB);
+        for (size_t sub = 0; sub < m_; sub++) {
+            for (size_t i = 0; i < PQ_KSUB; i++) {
+                for (size_t j = 0; j < PQ_KSUB; j++) {
+                    sdc_table_[(sub * PQ_KSUB + i) * PQ_KSUB + j] = subDistance(getCentroid(sub, i), getCentroid(sub, j));
+                }
+            }
+        }
+    }
+};
+
+
+/*
+* Space of PQ codes. Stored elements are codes of getCodeSize() bytes,
+* search queries are lookup tables built with computeLookupTable.
+* The quantizer must be trained and must outlive the space.
+*/
+class PQSpace : public SpaceInterface<float> {
+    PQDistParams param_;
+    size_t data_size_;
+
+ public:
+    explicit PQSpace(const ProductQuantizer &pq) {
+        if (!pq.isTrained())
+            throw std::runtime_error("Product quantizer is not trained");
+        param_.m = pq.getCodeSize();
+        param_.sdc_table = pq.sdc_table_.data();
+        data_size_ = pq.getCodeSize();
+    }
+
+    size_t get_data_size() {
+        return data_size_;
+    }
+
+    DISTFUNC<float> get_dist_func() {
+        return PQSdcDistance;
+    }
+
+    // queries are the lookup tables built by ProductQuantizer::computeLookupTable
+    size_t get_query_data_size() {
+        return param_.m * PQ_KSUB * sizeof(float);
+    }
+
+    DISTFUNC<float> get_query_dist_func() {
+        return PQAdcDistance;
+    }
+
+    void *get_dist_func_param() {
+        return &param_;
+    }
+
+    ~PQSpace() {}
+};
+}  // namespace hnswlib
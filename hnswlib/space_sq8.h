@@ -0,0 +1,433 @@
+#pragma once
+#include "hnswlib.h"
+#include <stdint.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace hnswlib {
+
+struct SQ8Params {
+    size_t dim;
+    const float *vmin;  // per dimension: x = vmin + code * step
+    const float *step;
+};
+
+/*
+* 8-bit scalar quantizer with a separate range for each dimension.
+* The range is learned from a sample of the data with train() or set explicitly with setRange().
+*/
+class ScalarQuantizer8 {
+ public:
+    size_t dim_{0};
+    std::vector<float> vmin_;
+    std::vector<float> step_;
+
+    ScalarQuantizer8(size_t dim) : dim_(dim), vmin_(dim, 0.0f), step_(dim, 0.0f) {}
+
+    void train(const float *data, size_t n) {
+        if (n == 0)
+            throw std::runtime_error("Scalar quantizer needs at least one training vector");
+        std::vector<float> vmax(dim_, std::numeric_limits<float>::lowest());
+        std::fill(vmin_.begin(), vmin_.end(), std::numeric_limits<float>::max());
+        for (size_t i = 0; i < n; i++) {
+            for (size_t d = 0; d < dim_; d++) {
+                vmin_[d] = std::min(vmin_[d], data[i * dim_ + d]);
+                vmax[d] = std::max(vmax[d], data[i * dim_ + d]);
+            }
+        }
+        setRange(vmin_.data(), vmax.data());
+    }
+
+    void setRange(const float *vmin, const float *vmax) {
+        for (size_t d = 0; d < dim_; d++) {
+            vmin_[d] = vmin[d];
+            step_[d] = (vmax[d] - vmin[d]) / 255.0f;
+        }
+    }
+
+    // values outside of the range are clamped
+    void encode(const float *vec, uint8_t *code) const {
+        for (size_t d = 0; d < dim_; d++) {
+            float c = step_[d] > 0 ? std::round((vec[d] - vmin_[d]) / step_[d]) : 0.0f;
+            code[d] = (uint8_t) std::min(std::max(c, 0.0f), 255.0f);
+        }
+    }
+
+    void decode(const uint8_t *code, float *vec) const {
+        for (size_t d = 0; d < dim_; d++)
+            vec[d] = vmin_[d] + code[d] * step_[d];
+    }
+};
+
+static float
+L2SqrSQ8Ref(const uint8_t *a, const uint8_t *b, const SQ8Params *param, size_t begin) {
+    float res = 0;
+    for (size_t d = begin; d < param->dim; d++) {
+        float t = ((int) a[d] - (int) b[d]) * param->step[d];
+        res += t * t;
+    }
+    return res;
+}
+
+static float
+L2SqrSQ8QueryRef(const float *q, const uint8_t *c, const SQ8Params *param, size_t begin) {
+    float res = 0;
+    for (size_t d = begin; d < param->dim; d++) {
+        float t = q[d] - (param->vmin[d] + c[d] * param->step[d]);
+        res += t * t;
+    }
+    return res;
+}
+
+static float
+InnerProductSQ8Ref(const uint8_t *a, const uint8_t *b, const SQ8Params *param, size_t begin) {
+    float res = 0;
+    for (size_t d = begin; d < param->dim; d++) {
+        res += (param->vmin[d] + a[d] * param->step[d]) * (param->vmin[d] + b[d] * param->step[d]);
+    }
+    return res;
+}
+
+static float
+InnerProductSQ8QueryRef(const float *q, const uint8_t *c, const SQ8Params *param, size_t begin) {
+    float res = 0;
+    for (size_t d = begin; d < param->dim; d++) {
+        res += q[d] * (param->vmin[d] + c[d] * param->step[d]);
+    }
+    return res;
+}
+
+// Distance between two stored codes
+static float
+L2SqrSQ8(const void *pVect1, const void *pVect2, const void *param_ptr) {
+    return L2SqrSQ8Ref((const uint8_t *) pVect1, (const uint8_t *) pVect2, (const SQ8Params *) param_ptr, 0);
+}
+
+// Distance from a float query to a stored code
+static float
+L2SqrSQ8Query(const void *pVect1, const void *pVect2, const void *param_ptr) {
+    return L2SqrSQ8QueryRef((const float *) pVect1, (const uint8_t *) pVect2, (const SQ8Params *) param_ptr, 0);
+}
+
+static float
+InnerProductSQ8Distance(const void *pVect1, const void *pVect2, const void *param_ptr) {
+    return 1.0f - InnerProductSQ8Ref((const uint8_t *) pVect1, (const uint8_t *) pVect2, (const SQ8Params *) param_ptr, 0);
+}
+
+static float
+InnerProductSQ8QueryDistance(const void *pVect1, const void *pVect2, const void *param_ptr) {
+    return 1.0f - InnerProductSQ8QueryRef((const float *) pVect1, (const uint8_t *) pVect2, (const SQ8Params *) param_ptr, 0);
+}
+
+#if defined(HNSWLIB_AVX512_KERNELS)
+
+HNSWLIB_TARGET("avx512f") static inline __m512
+LoadSQ8AVX512(const uint8_t *p) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) p)));
+}
+
+HNSWLIB_TARGET("avx512f") static float
+L2SqrSQ8AVX512(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const uint8_t *pVect1 = (const uint8_t *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty16 = param->dim >> 4 << 4;
+
+    __m512 sum = _mm512_set1_ps(0);
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m512 diff = _mm512_sub_ps(LoadSQ8AVX512(pVect1 + i), LoadSQ8AVX512(pVect2 + i));
+        diff = _mm512_mul_ps(diff, _mm512_loadu_ps(param->step + i));
+        sum = _mm512_fmadd_ps(diff, diff, sum);
+    }
+    return _mm512_reduce_add_ps(sum) + L2SqrSQ8Ref(pVect1, pVect2, param, qty16);
+}
+
+HNSWLIB_TARGET("avx512f") static float
+L2SqrSQ8QueryAVX512(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty16 = param->dim >> 4 << 4;
+
+    __m512 sum = _mm512_set1_ps(0);
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m512 v2 = _mm512_fmadd_ps(LoadSQ8AVX512(pVect2 + i), _mm512_loadu_ps(param->step + i),
+                                    _mm512_loadu_ps(param->vmin + i));
+        __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(pVect1 + i), v2);
+        sum = _mm512_fmadd_ps(diff, diff, sum);
+    }
+    return _mm512_reduce_add_ps(sum) + L2SqrSQ8QueryRef(pVect1, pVect2, param, qty16);
+}
+
+HNSWLIB_TARGET("avx512f") static float
+InnerProductSQ8DistanceAVX512(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const uint8_t *pVect1 = (const uint8_t *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty16 = param->dim >> 4 << 4;
+
+    __m512 sum = _mm512_set1_ps(0);
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m512 step = _mm512_loadu_ps(param->step + i);
+        __m512 vmin = _mm512_loadu_ps(param->vmin + i);
+        __m512 v1 = _mm512_fmadd_ps(LoadSQ8AVX512(pVect1 + i), step, vmin);
+        __m512 v2 = _mm512_fmadd_ps(LoadSQ8AVX512(pVect2 + i), step, vmin);
+        sum = _mm512_fmadd_ps(v1, v2, sum);
+    }
+    return 1.0f - (_mm512_reduce_add_ps(sum) + InnerProductSQ8Ref(pVect1, pVect2, param, qty16));
+}
+
+HNSWLIB_TARGET("avx512f") static float
+InnerProductSQ8QueryDistanceAVX512(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty16 = param->dim >> 4 << 4;
+
+    __m512 sum = _mm512_set1_ps(0);
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m512 v2 = _mm512_fmadd_ps(LoadSQ8AVX512(pVect2 + i), _mm512_loadu_ps(param->step + i),
+                                    _mm512_loadu_ps(param->vmin + i));
+        sum = _mm512_fmadd_ps(_mm512_loadu_ps(pVect1 + i), v2, sum);
+    }
+    return 1.0f - (_mm512_reduce_add_ps(sum) + InnerProductSQ8QueryRef(pVect1, pVect2, param, qty16));
+}
+#endif
+
+#if defined(HNSWLIB_AVX2_KERNELS)
+
+HNSWLIB_TARGET("avx2") static inline __m256
+LoadSQ8AVX2(const uint8_t *p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) p)));
+}
+
+HNSWLIB_TARGET("avx") static inline float
+HorizontalSumAVX(__m256 sum) {
+    float PORTABLE_ALIGN32 TmpRes[8];
+    _mm256_store_ps(TmpRes, sum);
+    return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+}
+
+HNSWLIB_TARGET("avx2") static float
+L2SqrSQ8AVX2(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const uint8_t *pVect1 = (const uint8_t *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty8 = param->dim >> 3 << 3;
+
+    __m256 sum = _mm256_set1_ps(0);
+    for (size_t i = 0; i < qty8; i += 8) {
+        __m256 diff = _mm256_sub_ps(LoadSQ8AVX2(pVect1 + i), LoadSQ8AVX2(pVect2 + i));
+        diff = _mm256_mul_ps(diff, _mm256_loadu_ps(param->step + i));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+    }
+    return HorizontalSumAVX(sum) + L2SqrSQ8Ref(pVect1, pVect2, param, qty8);
+}
+
+HNSWLIB_TARGET("avx2") static float
+L2SqrSQ8QueryAVX2(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty8 = param->dim >> 3 << 3;
+
+    __m256 sum = _mm256_set1_ps(0);
+    for (size_t i = 0; i < qty8; i += 8) {
+        __m256 v2 = _mm256_add_ps(_mm256_mul_ps(LoadSQ8AVX2(pVect2 + i), _mm256_loadu_ps(param->step + i)),
+                                  _mm256_loadu_ps(param->vmin + i));
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(pVect1 + i), v2);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+    }
+    return HorizontalSumAVX(sum) + L2SqrSQ8QueryRef(pVect1, pVect2, param, qty8);
+}
+
+HNSWLIB_TARGET("avx2") static float
+InnerProductSQ8DistanceAVX2(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const uint8_t *pVect1 = (const uint8_t *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty8 = param->dim >> 3 << 3;
+
+    __m256 sum = _mm256_set1_ps(0);
+    for (size_t i = 0; i < qty8; i += 8) {
+        __m256 step = _mm256_loadu_ps(param->step + i);
+        __m256 vmin = _mm256_loadu_ps(param->vmin + i);
+        __m256 v1 = _mm256_add_ps(_mm256_mul_ps(LoadSQ8AVX2(pVect1 + i), step), vmin);
+        __m256 v2 = _mm256_add_ps(_mm256_mul_ps(LoadSQ8AVX2(pVect2 + i), step), vmin);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(v1, v2));
+    }
+    return 1.0f - (HorizontalSumAVX(sum) + InnerProductSQ8Ref(pVect1, pVect2, param, qty8));
+}
+
+HNSWLIB_TARGET("avx2") static float
+InnerProductSQ8QueryDistanceAVX2(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+    const float *pVect1 = (const float *) pVect1v;
+    const uint8_t *pVect2 = (const uint8_t *) pVect2v;
+    const SQ8Params *param = (const SQ8Params *) param_ptr;
+    size_t qty8 = param->dim >> 3 << 3;
+
+    __m256 sum = _mm256_set1_ps(0);
+    for (size_t i = 0; i < qty8; i += 8) {
+        __m256 v2 = _mm256_add_ps(_mm256_mul_ps(LoadSQ8AVX2(pVect2 + i), _mm256_loadu_ps(param->step + i)),
+                                  _mm256_loadu_ps(param->vmin + i));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(pVect1 + i), v2));
+    }
+    return 1.0f - (HorizontalSumAVX(sum) + InnerProductSQ8QueryRef(pVect1, pVect2, param, qty8));
+}
+#endif
+
+// Picks the widest L2 kernel up to level, see CpuSimdLevel, between stored codes or from a float query if is_query
+template<bool is_query>
+static DistanceKernel<float>
+SelectL2SQ8Kernel(SimdLevel level = CpuSimdLevel()) {
+    DistanceKernel<float> kernel = is_query ? DistanceKernel<float>{L2SqrSQ8Query, SimdLevel::Scalar, "L2SqrSQ8Query"}
+                                            : DistanceKernel<float>{L2SqrSQ8, SimdLevel::Scalar, "L2SqrSQ8"};
+#if defined(HNSWLIB_AVX2_KERNELS)
+    if (level >= SimdLevel::AVX2) {
+        kernel = is_query ? DistanceKernel<float>{L2SqrSQ8QueryAVX2, SimdLevel::AVX2, "L2SqrSQ8QueryAVX2"}
+                          : DistanceKernel<float>{L2SqrSQ8AVX2, SimdLevel::AVX2, "L2SqrSQ8AVX2"};
+    }
+#endif
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (level >= SimdLevel::AVX512) {
+        kernel = is_query ? DistanceKernel<float>{L2SqrSQ8QueryAVX512, SimdLevel::AVX512, "L2SqrSQ8QueryAVX512"}
+                          : DistanceKernel<float>{L2SqrSQ8AVX512, SimdLevel::AVX512, "L2SqrSQ8AVX512"};
+    }
+#endif
+    return kernel;
+}
+
+// Same for the inner product
+template<bool is_query>
+static DistanceKernel<float>
+SelectInnerProductSQ8Kernel(SimdLevel level = CpuSimdLevel()) {
+    DistanceKernel<float> kernel = is_query
+        ? DistanceKernel<float>{InnerProductSQ8QueryDistance, SimdLevel::Scalar, "InnerProductSQ8QueryDistance"}
+        : DistanceKernel<float>{InnerProductSQ8Distance, SimdLevel::Scalar, "InnerProductSQ8Distance"};
+#if defined(HNSWLIB_AVX2_KERNELS)
+    if (level >= SimdLevel::AVX2) {
+        kernel = is_query
+            ? DistanceKernel<float>{InnerProductSQ8QueryDistanceAVX2, SimdLevel::AVX2, "InnerProductSQ8QueryDistanceAVX2"}
+            : DistanceKernel<float>{InnerProductSQ8DistanceAVX2, SimdLevel::AVX2, "InnerProductSQ8DistanceAVX2"};
+    }
+#endif
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (level >= SimdLevel::AVX512) {
+        kernel = is_query
+            ? DistanceKernel<float>{InnerProductSQ8QueryDistanceAVX512, SimdLevel::AVX512,
+                                    "InnerProductSQ8QueryDistanceAVX512"}
+            : DistanceKernel<float>{InnerProductSQ8DistanceAVX512, SimdLevel::AVX512, "InnerProductSQ8DistanceAVX512"};
+    }
+#endif
+    return kernel;
+}
+
+/*
+* Vectors are stored as one byte per dimension, use ScalarQuantizer8::encode() to convert them before addPoint.
+* Search queries stay in float.
+*/
+class L2SpaceSQ8 : public SpaceInterface<float> {
+    DistanceKernel<float> kernel_;
+    DISTFUNC<float> fstdistfunc_;
+    DISTFUNC<float> fstquerydistfunc_;
+    ScalarQuantizer8 sq_;
+    SQ8Params param_;
+
+ public:
+    L2SpaceSQ8(const ScalarQuantizer8 &sq) : sq_(sq) {
+        kernel_ = SelectL2SQ8Kernel<false>();
+        fstdistfunc_ = kernel_.func;
+        fstquerydistfunc_ = SelectL2SQ8Kernel<true>().func;
+        param_.dim = sq_.dim_;
+        param_.vmin = sq_.vmin_.data();
+        param_.step = sq_.step_.data();
+    }
+
+    L2SpaceSQ8(const L2SpaceSQ8 &) = delete;
+    L2SpaceSQ8 &operator=(const L2SpaceSQ8 &) = delete;
+
+    size_t get_data_size() {
+        return param_.dim * sizeof(uint8_t);
+    }
+
+    DISTFUNC<float> get_dist_func() {
+        return fstdistfunc_;
+    }
+
+    // queries are not encoded
+    size_t get_query_data_size() {
+        return param_.dim * sizeof(float);
+    }
+
+    DISTFUNC<float> get_query_dist_func() {
+        return fstquerydistfunc_;
+    }
+
+    void *get_dist_func_param() {
+        return &param_;
+    }
+
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
+    ~L2SpaceSQ8() {}
+};
+
+class InnerProductSpaceSQ8 : public SpaceInterface<float> {
+    DistanceKernel<float> kernel_;
+    DISTFUNC<float> fstdistfunc_;
+    DISTFUNC<float> fstquerydistfunc_;
+    ScalarQuantizer8 sq_;
+    SQ8Params param_;
+
+ public:
+    InnerProductSpaceSQ8(const ScalarQuantizer8 &sq) : sq_(sq) {
+        kernel_ = SelectInnerProductSQ8Kernel<false>();
+        fstdistfunc_ = kernel_.func;
+        fstquerydistfunc_ = SelectInnerProductSQ8Kernel<true>().func;
+        param_.dim = sq_.dim_;
+        param_.vmin = sq_.vmin_.data();
+        param_.step = sq_.step_.data();
+    }
+
+    InnerProductSpaceSQ8(const InnerProductSpaceSQ8 &) = delete;
+    InnerProductSpaceSQ8 &operator=(const InnerProductSpaceSQ8 &) = delete;
+
+    size_t get_data_size() {
+        return param_.dim * sizeof(uint8_t);
+    }
+
+    DISTFUNC<float> get_dist_func() {
+        return fstdistfunc_;
+    }
+
+    // queries are not encoded
+    size_t get_query_data_size() {
+        return param_.dim * sizeof(float);
+    }
+
+    DISTFUNC<float> get_query_dist_func() {
+        return fstquerydistfunc_;
+    }
+
+    void *get_dist_func_param() {
+        return &param_;
+    }
+
+    const char *get_dist_func_name() {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() {
+        return kernel_.level;
+    }
+
+    ~InnerProductSpaceSQ8() {}
+};
+}  // namespace hnswlib
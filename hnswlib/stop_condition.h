@@ -17,6 +17,7 @@ class BaseMultiVectorSpace : public SpaceInterface<float> {
 
 template<typename DOCIDTYPE>
 class MultiVectorL2Space : public BaseMultiVectorSpace<DOCIDTYPE> {
+    DistanceKernel<float> kernel_;
     DISTFUNC<float> fstdistfunc_;
     size_t data_size_;
     size_t vector_size_;
@@ -24,27 +25,8 @@ class MultiVectorL2Space : public BaseMultiVectorSpace<DOCIDTYPE> {
 
  public:
     MultiVectorL2Space(size_t dim) {
-        fstdistfunc_ = L2Sqr;
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-    #if defined(USE_AVX512)
-        if (AVX512Capable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX512;
-        else if (AVXCapable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX;
-    #elif defined(USE_AVX)
-        if (AVXCapable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX;
-    #endif
-
-        if (dim % 16 == 0)
-            fstdistfunc_ = L2SqrSIMD16Ext;
-        else if (dim % 4 == 0)
-            fstdistfunc_ = L2SqrSIMD4Ext;
-        else if (dim > 16)
-            fstdistfunc_ = L2SqrSIMD16ExtResiduals;
-        else if (dim > 4)
-            fstdistfunc_ = L2SqrSIMD4ExtResiduals;
-#endif
+        kernel_ = SelectL2Kernel(dim, CpuSimdLevel());
+        fstdistfunc_ = kernel_.func;
         dim_ = dim;
         vector_size_ = dim * sizeof(float);
         data_size_ = vector_size_ + sizeof(DOCIDTYPE);
@@ -62,6 +44,14 @@ class MultiVectorL2Space : public BaseMultiVectorSpace<DOCIDTYPE> {
         return &dim_;
     }
 
+    const char *get_dist_func_name() override {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() override {
+        return kernel_.level;
+    }
+
     DOCIDTYPE get_doc_id(const void *datapoint) override {
         return *(DOCIDTYPE *)((char *)datapoint + vector_size_);
     }
@@ -76,6 +66,7 @@ class MultiVectorL2Space : public BaseMultiVectorSpace<DOCIDTYPE> {
 
 template<typename DOCIDTYPE>
 class MultiVectorInnerProductSpace : public BaseMultiVectorSpace<DOCIDTYPE> {
+    DistanceKernel<float> kernel_;
     DISTFUNC<float> fstdistfunc_;
     size_t data_size_;
     size_t vector_size_;
@@ -83,38 +74,9 @@ class MultiVectorInnerProductSpace : public BaseMultiVectorSpace<DOCIDTYPE> {
 
  public:
     MultiVectorInnerProductSpace(size_t dim) {
-        fstdistfunc_ = InnerProductDistance;
-#if defined(USE_AVX) || defined(USE_SSE) || defined(USE_AVX512)
-    #if defined(USE_AVX512)
-        if (AVX512Capable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX512;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX512;
-        } else if (AVXCapable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
-        }
-    #elif defined(USE_AVX)
-        if (AVXCapable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
-        }
-    #endif
-    #if defined(USE_AVX)
-        if (AVXCapable()) {
-            InnerProductSIMD4Ext = InnerProductSIMD4ExtAVX;
-            InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtAVX;
-        }
-    #endif
-
-        if (dim % 16 == 0)
-            fstdistfunc_ = InnerProductDistanceSIMD16Ext;
-        else if (dim % 4 == 0)
-            fstdistfunc_ = InnerProductDistanceSIMD4Ext;
-        else if (dim > 16)
-            fstdistfunc_ = InnerProductDistanceSIMD16ExtResiduals;
-        else if (dim > 4)
-            fstdistfunc_ = InnerProductDistanceSIMD4ExtResiduals;
-#endif
+        kernel_ = SelectInnerProductKernel(dim, CpuSimdLevel());
+        fstdistfunc_ = kernel_.func;
+        dim_ = dim;
         vector_size_ = dim * sizeof(float);
         data_size_ = vector_size_ + sizeof(DOCIDTYPE);
     }
@@ -131,6 +93,14 @@ class MultiVectorInnerProductSpace : public BaseMultiVectorSpace<DOCIDTYPE> {
         return &dim_;
     }
 
+    const char *get_dist_func_name() override {
+        return kernel_.name;
+    }
+
+    SimdLevel get_dist_func_simd_level() override {
+        return kernel_.level;
+    }
+
     DOCIDTYPE get_doc_id(const void *datapoint) override {
         return *(DOCIDTYPE *)((char *)datapoint + vector_size_);
     }
@@ -3,6 +3,10 @@
 #include <mutex>
 #include <string.h>
 #include <deque>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
 
 namespace hnswlib {
 typedef unsigned short int vl_type;
@@ -27,52 +31,168 @@ class VisitedList {
         }
     }
 
+    // marks the element, returns false if it was already visited
+    inline bool visit(unsigned int id) {
+        if (mass[id] == curV)
+            return false;
+        mass[id] = curV;
+        return true;
+    }
+
+    inline const void *address(unsigned int id) const {
+        return mass + id;
+    }
+
     ~VisitedList() { delete[] mass; }
 };
+
+
+/*
+* Visited set whose size depends on the number of visited elements rather than on the size of the index.
+* Open addressing table of (epoch, id) entries: entries of older epochs count as empty, so reset is O(1).
+*/
+class VisitedHashSet {
+    std::vector<uint64_t> table_;
+    uint64_t epoch_{1};  // the zeroed entries of a new table are empty before the first reset
+    size_t size_{0};
+    int shift_{0};
+
+    inline size_t slotOf(unsigned int id) const {
+        return (size_t) (((uint64_t) id * 0x9E3779B97F4A7C15ULL) >> shift_);
+    }
+
+    void rehash(size_t log2_capacity) {
+        std::vector<uint64_t> old_table;
+        old_table.swap(table_);
+        table_.assign((size_t) 1 << log2_capacity, 0);
+        shift_ = 64 - (int) log2_capacity;
+        size_ = 0;
+        for (uint64_t entry : old_table) {
+            if ((entry >> 32) == epoch_)
+                visit((unsigned int) entry);
+        }
+    }
+
+ public:
+    // the table holds expected_visits elements before it grows, and at least 512
+    explicit VisitedHashSet(int expected_visits = 0) {
+        size_t log2_capacity = 10;
+        while (((size_t) 1 << log2_capacity) < 2 * (size_t) std::max(expected_visits, 0))
+            log2_capacity++;
+        rehash(log2_capacity);
+    }
+
+    void reset() {
+        epoch_++;
+        size_ = 0;
+        if (epoch_ > 0xffffffffULL) {
+            std::fill(table_.begin(), table_.end(), 0);
+            epoch_ = 1;
+        }
+    }
+
+    // marks the element, returns false if it was already visited
+    inline bool visit(unsigned int id) {
+        size_t mask = table_.size() - 1;
+        for (size_t slot = slotOf(id);; slot = (slot + 1) & mask) {
+            uint64_t entry = table_[slot];
+            if ((entry >> 32) != epoch_) {
+                table_[slot] = (epoch_ << 32) | id;
+                if (++size_ * 2 > table_.size()) {
+                    int log2_capacity = 64 - shift_;
+                    rehash(log2_capacity + 1);
+                }
+                return true;
+            }
+            if ((unsigned int) entry == id)
+                return false;
+        }
+    }
+
+    inline const void *address(unsigned int id) const {
+        return table_.data() + slotOf(id);
+    }
+
+    size_t capacity() const {
+        return table_.size();
+    }
+};
+
+
+// Index of the calling thread, used to pick its slot in the pools
+static unsigned int getThreadIndex() {
+    static std::atomic<unsigned int> next_index{0};
+    static thread_local unsigned int index = next_index++;
+    return index;
+}
+
 ///////////////////////////////////////////////////////////
 //
-// Class for multi-threaded pool-management of VisitedLists
+// Class for multi-threaded pool-management of visited sets
 //
 /////////////////////////////////////////////////////////
 
-class VisitedListPool {
-    std::deque<VisitedList *> pool;
+/*
+* Each thread gets and releases its set through a slot of its own with atomic exchanges,
+* the mutex-protected deque is only used when a slot is empty or already taken.
+*/
+template<typename visited_t>
+class VisitedSetPool {
+    static const size_t NUM_SLOTS = 64;
+
+    struct Slot {
+        std::atomic<visited_t *> item{nullptr};
+        char padding[64 - sizeof(std::atomic<visited_t *>)];  // one slot per cache line
+    };
+
+    Slot slots_[NUM_SLOTS];
+    std::deque<visited_t *> pool;
     std::mutex poolguard;
     int numelements;
 
  public:
-    VisitedListPool(int initmaxpools, int numelements1) {
+    VisitedSetPool(int initmaxpools, int numelements1) {
         numelements = numelements1;
         for (int i = 0; i < initmaxpools; i++)
-            pool.push_front(new VisitedList(numelements));
+            pool.push_front(new visited_t(numelements));
     }
 
-    VisitedList *getFreeVisitedList() {
-        VisitedList *rez;
-        {
+    visited_t *getFreeVisitedList() {
+        Slot &slot = slots_[getThreadIndex() % NUM_SLOTS];
+        visited_t *rez = slot.item.exchange(nullptr, std::memory_order_acquire);
+        if (rez == nullptr) {
             std::unique_lock <std::mutex> lock(poolguard);
             if (pool.size() > 0) {
                 rez = pool.front();
                 pool.pop_front();
             } else {
-                rez = new VisitedList(numelements);
+                rez = new visited_t(numelements);
             }
         }
         rez->reset();
         return rez;
     }
 
-    void releaseVisitedList(VisitedList *vl) {
+    void releaseVisitedList(visited_t *vl) {
+        Slot &slot = slots_[getThreadIndex() % NUM_SLOTS];
+        visited_t *expected = nullptr;
+        if (slot.item.compare_exchange_strong(expected, vl, std::memory_order_release))
+            return;
         std::unique_lock <std::mutex> lock(poolguard);
         pool.push_front(vl);
     }
 
-    ~VisitedListPool() {
+    ~VisitedSetPool() {
+        for (size_t i = 0; i < NUM_SLOTS; i++)
+            delete slots_[i].item.load();
         while (pool.size()) {
-            VisitedList *rez = pool.front();
+            visited_t *rez = pool.front();
             pool.pop_front();
             delete rez;
         }
     }
 };
+
+typedef VisitedSetPool<VisitedList> VisitedListPool;
+typedef VisitedSetPool<VisitedHashSet> VisitedHashSetPool;
 }  // namespace hnswlib
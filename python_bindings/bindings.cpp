@@ -283,7 +283,12 @@ class Index {
             }
 
             py::gil_scoped_release l;
-            if (normalize == false) {
+            if (normalize == false && replace_deleted == false) {
+                std::vector<hnswlib::labeltype> labels(rows - start);
+                for (size_t row = start; row < rows; row++)
+                    labels[row - start] = ids.size() ? ids.at(row) : (cur_l + row);
+                appr_alg->addPoints(items.data(start), labels.data(), labels.size(), num_threads);
+            } else if (normalize == false) {
                 ParallelFor(start, rows, num_threads, [&](size_t row, size_t threadId) {
                     size_t id = ids.size() ? ids.at(row) : (cur_l + row);
                     appr_alg->addPoint((void*)items.data(row), (size_t)id, replace_deleted);
@@ -341,9 +346,9 @@ class Index {
     std::vector<hnswlib::labeltype> getIdsList() {
         std::vector<hnswlib::labeltype> ids;
 
-        for (auto kv : appr_alg->label_lookup_) {
-            ids.push_back(kv.first);
-        }
+        appr_alg->label_lookup_.forEach([&](hnswlib::labeltype label, hnswlib::tableint internal_id) {
+            ids.push_back(label);
+        });
         return ids;
     }
 
@@ -373,15 +378,25 @@ class Index {
         memset(label_lookup_val_npy, -1, appr_alg->label_lookup_.size() * sizeof(hnswlib::tableint));
 
         size_t idx = 0;
-        for (auto it = appr_alg->label_lookup_.begin(); it != appr_alg->label_lookup_.end(); ++it) {
-            label_lookup_key_npy[idx] = it->first;
-            label_lookup_val_npy[idx] = it->second;
+        appr_alg->label_lookup_.forEach([&](hnswlib::labeltype label, hnswlib::tableint internal_id) {
+            label_lookup_key_npy[idx] = label;
+            label_lookup_val_npy[idx] = internal_id;
             idx++;
-        }
+        });
 
         memset(link_list_npy, 0, link_npy_size);
 
-        memcpy(data_level0_npy, appr_alg->data_level0_memory_, level0_npy_size);
+        if (appr_alg->level0_layout_ == hnswlib::Level0Layout::INTERLEAVED) {
+            memcpy(data_level0_npy, appr_alg->data_level0_memory_, level0_npy_size);
+        } else {
+            // the pickled base layer is always made of interleaved rows
+            for (size_t i = 0; i < appr_alg->cur_element_count; i++) {
+                char* row = data_level0_npy + i * appr_alg->size_data_per_element_;
+                memcpy(row + appr_alg->offsetLevel0_, appr_alg->get_linklist0(i), appr_alg->size_links_level0_);
+                memcpy(row + appr_alg->offsetData_, appr_alg->getDataByInternalId(i), appr_alg->data_size_);
+                memcpy(row + appr_alg->label_offset_, appr_alg->getExternalLabeLp(i), sizeof(hnswlib::labeltype));
+            }
+        }
         memcpy(element_levels_npy, appr_alg->element_levels_.data(), appr_alg->element_levels_.size() * sizeof(int));
 
         for (size_t i = 0; i < appr_alg->cur_element_count; i++) {
@@ -417,8 +432,8 @@ class Index {
             "size_data_per_element"_a = appr_alg->size_data_per_element_,
             "label_offset"_a = appr_alg->label_offset_,
             "offset_data"_a = appr_alg->offsetData_,
-            "max_level"_a = appr_alg->maxlevel_,
-            "enterpoint_node"_a = appr_alg->enterpoint_node_,
+            "max_level"_a = appr_alg->getEntryPoint().level,
+            "enterpoint_node"_a = appr_alg->getEntryPoint().node,
             "max_M"_a = appr_alg->maxM_,
             "max_M0"_a = appr_alg->maxM0_,
             "M"_a = appr_alg->M_,
@@ -535,8 +550,7 @@ class Index {
         assert_true(appr_alg->label_offset_ == d["label_offset"].cast<size_t>(), "Invalid value of label_offset_ ");
         assert_true(appr_alg->offsetData_ == d["offset_data"].cast<size_t>(), "Invalid value of offsetData_ ");
 
-        appr_alg->maxlevel_ = d["max_level"].cast<int>();
-        appr_alg->enterpoint_node_ = d["enterpoint_node"].cast<hnswlib::tableint>();
+        appr_alg->setEntryPoint(d["enterpoint_node"].cast<hnswlib::tableint>(), d["max_level"].cast<int>());
 
         assert_true(appr_alg->maxM_ == d["max_M"].cast<size_t>(), "Invalid value of maxM_ ");
         assert_true(appr_alg->maxM0_ == d["max_M0"].cast<size_t>(), "Invalid value of maxM0_ ");
@@ -558,7 +572,7 @@ class Index {
             if (label_lookup_val_npy.data()[i] < 0) {
                 throw std::runtime_error("Internal id cannot be negative!");
             } else {
-                appr_alg->label_lookup_.insert(std::make_pair(label_lookup_key_npy.data()[i], label_lookup_val_npy.data()[i]));
+                appr_alg->label_lookup_.set(label_lookup_key_npy.data()[i], label_lookup_val_npy.data()[i]);
             }
         }
 
@@ -613,9 +627,11 @@ class Index {
         py::object input,
         size_t k = 1,
         int num_threads = -1,
-        const std::function<bool(hnswlib::labeltype)>& filter = nullptr) {
+        const std::function<bool(hnswlib::labeltype)>& filter = nullptr,
+        bool return_stats = false) {
         py::array_t < dist_t, py::array::c_style | py::array::forcecast > items(input);
         auto buffer = items.request();
+        std::vector<hnswlib::SearchStats> stats;
         hnswlib::labeltype* data_numpy_l;
         dist_t* data_numpy_d;
         size_t rows, features;
@@ -639,39 +655,60 @@ class Index {
             CustomFilterFunctor idFilter(filter);
             CustomFilterFunctor* p_idFilter = filter ? &idFilter : nullptr;
 
-            if (normalize == false) {
-                ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
-                    std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = appr_alg->searchKnn(
-                        (void*)items.data(row), k, p_idFilter);
-                    if (result.size() != k)
+            // queries are searched by batches that interleave their graph walks,
+            // batches are kept small enough to give every thread some work
+            size_t batch_size = std::min((size_t) 64, (rows + num_threads - 1) / num_threads);
+            batch_size = std::max(batch_size, (size_t) 1);
+            size_t num_batches = (rows + batch_size - 1) / batch_size;
+            auto check_batch_result = [&](size_t start, size_t batch_rows) {
+                for (size_t i = start * k; i < (start + batch_rows) * k; i++) {
+                    if (data_numpy_l[i] == std::numeric_limits<hnswlib::labeltype>::max())
                         throw std::runtime_error(
                             "Cannot return the results in a contiguous 2D array. Probably ef or M is too small");
-                    for (int i = k - 1; i >= 0; i--) {
-                        auto& result_tuple = result.top();
-                        data_numpy_d[row * k + i] = result_tuple.first;
-                        data_numpy_l[row * k + i] = result_tuple.second;
-                        result.pop();
+                }
+            };
+
+            if (return_stats) {
+                // the stats are counted per query, so the queries are searched one by one
+                stats.resize(rows);
+                std::vector<float> norm_array(normalize ? num_threads * features : 0);
+                ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
+                    void* query = (void*)items.data(row);
+                    if (normalize) {
+                        float* norm_data = norm_array.data() + threadId * features;
+                        normalize_vector((float*)items.data(row), norm_data);
+                        query = norm_data;
                     }
+                    std::vector<std::pair<dist_t, hnswlib::labeltype>> result =
+                        appr_alg->searchKnnCloserFirst(query, k, p_idFilter, &stats[row]);
+                    for (size_t i = 0; i < k; i++) {
+                        data_numpy_l[row * k + i] = i < result.size() ? result[i].second : std::numeric_limits<hnswlib::labeltype>::max();
+                        data_numpy_d[row * k + i] = i < result.size() ? result[i].first : std::numeric_limits<dist_t>::max();
+                    }
+                    check_batch_result(row, 1);
+                });
+            } else if (normalize == false) {
+                ParallelFor(0, num_batches, num_threads, [&](size_t batch, size_t threadId) {
+                    size_t start = batch * batch_size;
+                    size_t batch_rows = std::min(batch_size, rows - start);
+                    appr_alg->searchKnnBatch(
+                        (void*)items.data(start), batch_rows, k, data_numpy_l + start * k, data_numpy_d + start * k, p_idFilter);
+                    check_batch_result(start, batch_rows);
                 });
             } else {
-                std::vector<float> norm_array(num_threads * features);
-                ParallelFor(0, rows, num_threads, [&](size_t row, size_t threadId) {
-                    float* data = (float*)items.data(row);
-
-                    size_t start_idx = threadId * dim;
-                    normalize_vector((float*)items.data(row), (norm_array.data() + start_idx));
-
-                    std::priority_queue<std::pair<dist_t, hnswlib::labeltype >> result = appr_alg->searchKnn(
-                        (void*)(norm_array.data() + start_idx), k, p_idFilter);
-                    if (result.size() != k)
-                        throw std::runtime_error(
-                            "Cannot return the results in a contiguous 2D array. Probably ef or M is too small");
-                    for (int i = k - 1; i >= 0; i--) {
-                        auto& result_tuple = result.top();
-                        data_numpy_d[row * k + i] = result_tuple.first;
-                        data_numpy_l[row * k + i] = result_tuple.second;
-                        result.pop();
+                std::vector<float> norm_array(num_threads * batch_size * features);
+                ParallelFor(0, num_batches, num_threads, [&](size_t batch, size_t threadId) {
+                    size_t start = batch * batch_size;
+                    size_t batch_rows = std::min(batch_size, rows - start);
+
+                    float* batch_data = norm_array.data() + threadId * batch_size * features;
+                    for (size_t row = 0; row < batch_rows; row++) {
+                        normalize_vector((float*)items.data(start + row), batch_data + row * features);
                     }
+
+                    appr_alg->searchKnnBatch(
+                        (void*)batch_data, batch_rows, k, data_numpy_l + start * k, data_numpy_d + start * k, p_idFilter);
+                    check_batch_result(start, batch_rows);
                 });
             }
         }
@@ -682,18 +719,49 @@ class Index {
             delete[] f;
             });
 
-        return py::make_tuple(
-            py::array_t<hnswlib::labeltype>(
-                { rows, k },  // shape
-                { k * sizeof(hnswlib::labeltype),
-                  sizeof(hnswlib::labeltype) },  // C-style contiguous strides for each index
-                data_numpy_l,  // the data pointer
-                free_when_done_l),
-            py::array_t<dist_t>(
-                { rows, k },  // shape
-                { k * sizeof(dist_t), sizeof(dist_t) },  // C-style contiguous strides for each index
-                data_numpy_d,  // the data pointer
-                free_when_done_d));
+        py::array_t<hnswlib::labeltype> labels(
+            { rows, k },  // shape
+            { k * sizeof(hnswlib::labeltype),
+              sizeof(hnswlib::labeltype) },  // C-style contiguous strides for each index
+            data_numpy_l,  // the data pointer
+            free_when_done_l);
+        py::array_t<dist_t> distances(
+            { rows, k },  // shape
+            { k * sizeof(dist_t), sizeof(dist_t) },  // C-style contiguous strides for each index
+            data_numpy_d,  // the data pointer
+            free_when_done_d);
+        if (!return_stats)
+            return py::make_tuple(labels, distances);
+        return py::make_tuple(labels, distances, getStatsDict(stats));
+    }
+
+
+    // One row per query, hops_per_level has a column per level of the index
+    static py::dict getStatsDict(const std::vector<hnswlib::SearchStats>& stats) {
+        size_t rows = stats.size();
+        size_t num_levels = 1;
+        for (const hnswlib::SearchStats& query_stats : stats)
+            num_levels = std::max(num_levels, query_stats.hops_per_level.size());
+
+        py::array_t<size_t> hops_per_level({ rows, num_levels });
+        py::array_t<size_t> hops(rows), distance_computations(rows), visited_nodes(rows), heap_operations(rows);
+        for (size_t row = 0; row < rows; row++) {
+            const hnswlib::SearchStats& query_stats = stats[row];
+            for (size_t level = 0; level < num_levels; level++) {
+                hops_per_level.mutable_data()[row * num_levels + level] =
+                    level < query_stats.hops_per_level.size() ? query_stats.hops_per_level[level] : 0;
+            }
+            hops.mutable_data()[row] = query_stats.hops();
+            distance_computations.mutable_data()[row] = query_stats.distance_computations;
+            visited_nodes.mutable_data()[row] = query_stats.visited_nodes;
+            heap_operations.mutable_data()[row] = query_stats.heap_operations;
+        }
+        return py::dict(
+            "hops"_a = hops,
+            "hops_per_level"_a = hops_per_level,
+            "distance_computations"_a = distance_computations,
+            "visited_nodes"_a = visited_nodes,
+            "heap_operations"_a = heap_operations);
     }
 
 
@@ -712,6 +780,16 @@ class Index {
     }
 
 
+    void reorderGraph(const std::string &order) {
+        if (order == "bfs")
+            appr_alg->reorderGraph(hnswlib::GraphOrder::BFS);
+        else if (order == "rcm")
+            appr_alg->reorderGraph(hnswlib::GraphOrder::RCM);
+        else
+            throw std::runtime_error("Unknown graph order, expected \"bfs\" or \"rcm\"");
+    }
+
+
     size_t getMaxElements() const {
         return appr_alg->max_elements_;
     }
@@ -927,7 +1005,8 @@ PYBIND11_PLUGIN(hnswlib) {
             py::arg("data"),
             py::arg("k") = 1,
             py::arg("num_threads") = -1,
-            py::arg("filter") = py::none())
+            py::arg("filter") = py::none(),
+            py::arg("return_stats") = false)
         .def("add_items",
             &Index<float>::addItems,
             py::arg("data"),
@@ -948,6 +1027,7 @@ PYBIND11_PLUGIN(hnswlib) {
         .def("mark_deleted", &Index<float>::markDeleted, py::arg("label"))
         .def("unmark_deleted", &Index<float>::unmarkDeleted, py::arg("label"))
         .def("resize_index", &Index<float>::resizeIndex, py::arg("new_size"))
+        .def("reorder_graph", &Index<float>::reorderGraph, py::arg("order") = "bfs")
         .def("get_max_elements", &Index<float>::getMaxElements)
         .def("get_current_count", &Index<float>::getCurrentCount)
         .def_readonly("space", &Index<float>::space_name)
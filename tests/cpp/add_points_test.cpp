@@ -0,0 +1,149 @@
+// This is a test file for the parallel bulk insertion with addPoints
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class RecordingProgress : public hnswlib::BaseProgressCallback {
+ public:
+    std::vector<size_t> added;
+
+    void operator()(size_t count, size_t total, double points_per_second) {
+        assert(added.empty() || count > added.back());
+        assert(count <= total);
+        assert(points_per_second > 0);
+        added.push_back(count);
+    }
+};
+
+void test_parallel_for() {
+    for (size_t n : {0, 1, 7, 1000, 12345}) {
+        std::vector<std::atomic<int>> calls(n);
+        hnswlib::parallelFor(n, 8, 16, [&](size_t i, size_t thread_id) {
+            assert(thread_id < 8);
+            calls[i]++;
+        });
+        for (size_t i = 0; i < n; i++) {
+            assert(calls[i] == 1);
+        }
+    }
+
+    // the first exception stops the work and reaches the caller
+    std::atomic<size_t> calls{0};
+    bool thrown = false;
+    try {
+        hnswlib::parallelFor(100000, 8, 16, [&](size_t i, size_t thread_id) {
+            calls++;
+            if (i == 500)
+                throw std::runtime_error("stop");
+        });
+    } catch (std::runtime_error &e) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(calls < 100000);
+}
+
+void test_add_points() {
+    int d = 16;
+    idx_t n = 10000;
+    idx_t nq = 100;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::vector<idx_t> labels(n);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+    for (idx_t i = 0; i < n; i++)
+        labels[i] = 3 * i + 1;
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute.addPoint(data.data() + d * i, labels[i]);
+    }
+
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    RecordingProgress progress;
+    alg_hnsw.addPoints(data.data(), labels.data(), n, 8, &progress);
+    assert(alg_hnsw.cur_element_count == n);
+    assert(progress.added.size() == 100);
+    assert(progress.added.back() == n);
+    alg_hnsw.checkIntegrity();
+
+    // the entry point is an element of the top level
+    int max_level = *std::max_element(alg_hnsw.element_levels_.begin(), alg_hnsw.element_levels_.end());
+    assert(alg_hnsw.getEntryPoint().level == max_level);
+    assert(alg_hnsw.element_levels_[alg_hnsw.getEntryPoint().node] == max_level);
+    for (idx_t i = 0; i < n; i += 101) {
+        assert(alg_hnsw.getDataByLabel<float>(labels[i]) == std::vector<float>(data.data() + d * i, data.data() + d * (i + 1)));
+    }
+
+    alg_hnsw.setEf(100);
+    float correct = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        auto expected = alg_brute.searchKnnCloserFirst(query.data() + j * d, k);
+        auto res = alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k);
+        for (auto &item : res) {
+            for (auto &expected_item : expected) {
+                if (item.second == expected_item.second)
+                    correct++;
+            }
+        }
+    }
+    float recall = correct / (nq * k);
+    std::cout << "Recall: " << recall << std::endl;
+    assert(recall > 0.95);
+
+    // one thread builds the same graph every time
+    hnswlib::HierarchicalNSW<float> alg_first(&space, n);
+    hnswlib::HierarchicalNSW<float> alg_second(&space, n);
+    alg_first.addPoints(data.data(), labels.data(), n, 1);
+    alg_second.addPoints(data.data(), labels.data(), n, 1);
+    for (size_t j = 0; j < nq; ++j) {
+        assert(alg_first.searchKnnCloserFirst(query.data() + j * d, k) == alg_second.searchKnnCloserFirst(query.data() + j * d, k));
+    }
+
+    // points already in the index are updated, points beyond the capacity are rejected
+    alg_first.addPoints(query.data(), labels.data(), nq, 4);
+    assert(alg_first.cur_element_count == n);
+    assert(alg_first.searchKnn(query.data() + d, 1).top().second == labels[1]);
+    std::vector<idx_t> new_labels = {0, 3};
+    bool rejected = false;
+    try {
+        alg_first.addPoints(query.data(), new_labels.data(), new_labels.size(), 2);
+    } catch (std::runtime_error &e) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // addPoint draws the level when it is given 0, like addPoints
+    hnswlib::HierarchicalNSW<float> alg_single(&space, n);
+    for (idx_t i = 0; i < n; i++)
+        alg_single.addPoint(data.data() + d * i, labels[i], 0);
+    assert(alg_single.getEntryPoint().level > 0);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_parallel_for();
+    test_add_points();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
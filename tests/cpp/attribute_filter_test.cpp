@@ -0,0 +1,189 @@
+// This is a test file for the searches filtered by a predicate on attribute columns
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+enum Column { TENANT, CATEGORIES, TIMESTAMP };
+
+// attributes of the element labeled i
+uint64_t tenant_of(idx_t i) { return i % 50; }
+uint64_t categories_of(idx_t i) { return (uint64_t) 1 << (i % 40); }
+uint64_t timestamp_of(idx_t i) { return 1000000 + i; }
+
+// The same predicates on labels
+class PickTenant : public hnswlib::BaseFilterFunctor {
+    uint64_t tenant;
+ public:
+    explicit PickTenant(uint64_t tenant) : tenant(tenant) {}
+
+    bool operator()(idx_t label) {
+        return tenant_of(label) == tenant;
+    }
+};
+
+class PickCategoriesInRange : public hnswlib::BaseFilterFunctor {
+    uint64_t mask, from, to;
+ public:
+    PickCategoriesInRange(uint64_t mask, uint64_t from, uint64_t to) : mask(mask), from(from), to(to) {}
+
+    bool operator()(idx_t label) {
+        return (categories_of(label) & mask) && timestamp_of(label) >= from && timestamp_of(label) <= to;
+    }
+};
+
+std::vector<std::pair<float, idx_t>> sorted(std::priority_queue<std::pair<float, idx_t>> result) {
+    std::vector<std::pair<float, idx_t>> items;
+    for (; !result.empty(); result.pop())
+        items.push_back(result.top());
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+template <typename function_t>
+bool throws(function_t function) {
+    try {
+        function();
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+void test() {
+    int d = 32;
+    idx_t n = 20000;
+    idx_t nq = 20;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    size_t tenant_column = alg_hnsw.addAttributeColumn(2);
+    assert(tenant_column == TENANT);
+    for (idx_t i = 0; i < n; i++) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+        alg_hnsw.setAttribute(i, TENANT, tenant_of(i));
+    }
+    // columns added later keep the values of the others
+    size_t categories_column = alg_hnsw.addAttributeColumn(8);
+    size_t timestamp_column = alg_hnsw.addAttributeColumn(4);
+    assert(categories_column == CATEGORIES && timestamp_column == TIMESTAMP);
+    assert(alg_hnsw.getNumAttributeColumns() == 3);
+    for (idx_t i = 0; i < n; i++) {
+        alg_hnsw.setAttribute(i, CATEGORIES, categories_of(i));
+        alg_hnsw.setAttribute(i, TIMESTAMP, timestamp_of(i));
+    }
+    for (idx_t i = 0; i < n; i += 7) {
+        assert(alg_hnsw.getAttribute(i, TENANT) == tenant_of(i));
+        assert(alg_hnsw.getAttribute(i, CATEGORIES) == categories_of(i));
+        assert(alg_hnsw.getAttribute(i, TIMESTAMP) == timestamp_of(i));
+    }
+    alg_hnsw.setEf(50);
+
+    assert(throws([&]() { alg_hnsw.addAttributeColumn(3); }));
+    assert(throws([&]() { alg_hnsw.setAttribute(n, TENANT, 1); }));
+    assert(throws([&]() { alg_hnsw.setAttribute(0, TENANT, 1 << 16); }));
+    assert(throws([&]() { alg_hnsw.getAttribute(0, 3); }));
+    assert(throws([&]() { alg_hnsw.searchKnn(query.data(), k, hnswlib::AttributePredicate().equal(3, 0)); }));
+
+    // the predicates take the same walks as the filters on labels, with or without planning
+    hnswlib::AttributePredicate one_tenant = hnswlib::AttributePredicate().equal(TENANT, 7);
+    PickTenant one_tenant_filter(7);
+    hnswlib::AttributePredicate categories_in_range = hnswlib::AttributePredicate()
+        .anyBits(CATEGORIES, 0xf0f).range(TIMESTAMP, 1005000, 1014999);
+    PickCategoriesInRange categories_in_range_filter(0xf0f, 1005000, 1014999);
+    assert(std::abs(alg_hnsw.estimateSelectivity(one_tenant) - 0.02) < 0.03);
+    assert(alg_hnsw.estimateSelectivity(categories_in_range) == alg_hnsw.estimateSelectivity(&categories_in_range_filter));
+    for (bool planning : {false, true}) {
+        alg_hnsw.setFilterPlanning(planning);
+        for (idx_t j = 0; j < nq; j++) {
+            const float *p = query.data() + j * d;
+            auto res = sorted(alg_hnsw.searchKnn(p, k, one_tenant));
+            assert(res.size() == k);
+            assert(res == sorted(alg_hnsw.searchKnn(p, k, &one_tenant_filter)));
+            for (auto &item : res)
+                assert(tenant_of(item.second) == 7);
+
+            res = sorted(alg_hnsw.searchKnn(p, k, categories_in_range));
+            assert(res.size() == k);
+            assert(res == sorted(alg_hnsw.searchKnn(p, k, &categories_in_range_filter)));
+            for (auto &item : res)
+                assert(categories_in_range_filter(item.second));
+
+            assert(sorted(alg_hnsw.searchKnn(p, k, hnswlib::AttributePredicate())) == sorted(alg_hnsw.searchKnn(p, k)));
+        }
+    }
+
+    // saved with the index
+    alg_hnsw.saveIndex("attributes.bin");
+    hnswlib::HierarchicalNSW<float> alg_loaded(&space, "attributes.bin");
+    hnswlib::HierarchicalNSW<float> alg_mapped(&space);
+    alg_mapped.loadIndexMapped("attributes.bin", &space);
+    for (hnswlib::HierarchicalNSW<float> *alg : {&alg_loaded, &alg_mapped}) {
+        assert(alg->getNumAttributeColumns() == 3);
+        alg->setEf(50);
+        for (idx_t i = 0; i < n; i += 7)
+            assert(alg->getAttribute(i, CATEGORIES) == categories_of(i));
+        for (idx_t j = 0; j < nq; j++) {
+            const float *p = query.data() + j * d;
+            assert(sorted(alg->searchKnn(p, k, one_tenant)) == sorted(alg_hnsw.searchKnn(p, k, &one_tenant_filter)));
+        }
+    }
+    assert(throws([&]() { alg_mapped.setAttribute(0, TENANT, 1); }));
+    std::remove("attributes.bin");
+
+    // and follow the elements when they are renumbered, resized or deleted
+    alg_loaded.reorderGraph();
+    alg_loaded.resizeIndex(n + 1);
+    alg_loaded.addPoint(data.data(), n);
+    assert(alg_loaded.getAttribute(n, TENANT) == 0);
+    for (idx_t i = 0; i < n; i += 2)
+        alg_loaded.markDelete(i);
+    for (idx_t i = 0; i < n; i += 7)
+        assert(alg_loaded.getAttribute(i, TIMESTAMP) == timestamp_of(i));
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        auto res = sorted(alg_loaded.searchKnn(p, k, categories_in_range));
+        assert(res.size() == k);
+        for (auto &item : res)
+            assert(item.second % 2 == 1 && categories_in_range_filter(item.second));
+    }
+
+    // a replaced element gets 0 values
+    hnswlib::HierarchicalNSW<float> alg_replace(&space, 2, 16, 200, 100, true);
+    alg_replace.addAttributeColumn(1);
+    alg_replace.addPoint(data.data(), 0);
+    alg_replace.setAttribute(0, 0, 255);
+    alg_replace.markDelete(0);
+    alg_replace.addPoint(data.data() + d, 1, true);
+    assert(alg_replace.getAttribute(1, 0) == 0);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
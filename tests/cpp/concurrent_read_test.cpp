@@ -0,0 +1,110 @@
+// This is a test file for the searches and link list reads running during concurrent insertions
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <thread>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+void test() {
+    int d = 16;
+    idx_t n = 6000;
+    size_t k = 10;
+    int num_threads = 4;
+    int num_readers = 2;
+
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    alg_hnsw.setEf(50);
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < num_readers; t++) {
+        readers.push_back(std::thread([&, t]() {
+            std::vector<hnswlib::tableint> links;
+            for (idx_t i = t; !done; i = (i + 13) % n) {
+                // searches only return inserted labels
+                auto res = alg_hnsw.searchKnn(data.data() + d * i, k);
+                assert(res.size() <= k);
+                while (!res.empty()) {
+                    assert(res.top().second < n);
+                    res.pop();
+                }
+
+                // a copied list is never torn: it fits in the list and only holds valid elements,
+                // checked on the elements reachable from the entry point, whose lists are initialized
+                hnswlib::HierarchicalNSW<float>::EntryPoint entry_point = alg_hnsw.getEntryPoint();
+                for (int level = entry_point.level; level >= 0; level--) {
+                    size_t size = alg_hnsw.readLinkList(entry_point.node, level, links);
+                    assert(size <= (level == 0 ? alg_hnsw.maxM0_ : alg_hnsw.maxM_));
+                    std::vector<hnswlib::tableint> neighbors(links.begin(), links.begin() + size);
+                    for (hnswlib::tableint neighbor : neighbors) {
+                        assert(neighbor < alg_hnsw.cur_element_count);
+                        assert(neighbor != entry_point.node);
+                        size_t neighbor_size = alg_hnsw.readLinkList(neighbor, 0, links);
+                        assert(neighbor_size <= alg_hnsw.maxM0_);
+                        for (size_t j = 0; j < neighbor_size; j++) {
+                            assert(links[j] < alg_hnsw.cur_element_count);
+                            assert(links[j] != neighbor);
+                        }
+                    }
+                }
+            }
+        }));
+    }
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < num_threads; t++) {
+        writers.push_back(std::thread([&, t]() {
+            for (idx_t i = t; i < n; i += num_threads) {
+                alg_hnsw.addPoint(data.data() + d * i, i);
+            }
+        }));
+    }
+    for (auto &thread : writers) {
+        thread.join();
+    }
+    done = true;
+    for (auto &thread : readers) {
+        thread.join();
+    }
+
+    assert(alg_hnsw.cur_element_count == n);
+    std::vector<hnswlib::tableint> links;
+    for (hnswlib::tableint id = 0; id < n; id += 11) {
+        // once the writers are done the copy matches the list
+        size_t size = alg_hnsw.readLinkList(id, 0, links);
+        hnswlib::linklistsizeint *ll = alg_hnsw.get_linklist0(id);
+        assert(size == alg_hnsw.getListCount(ll));
+        assert(std::equal(links.begin(), links.begin() + size, (hnswlib::tableint *) (ll + 1)));
+    }
+    size_t found = 0;
+    for (idx_t i = 0; i < n; i += 7) {
+        if (alg_hnsw.searchKnn(data.data() + d * i, 1).top().second == i)
+            found++;
+    }
+    assert(found > 0.95 * (n / 7));
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
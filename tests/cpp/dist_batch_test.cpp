@@ -0,0 +1,236 @@
+// This is a test file for the one-to-many distance kernels scoring neighbor lists
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+bool close(float a, float b) {
+    return std::abs(a - b) <= 1e-4f * std::max(1.0f, std::abs(b));
+}
+
+bool close(int a, int b) {
+    return a == b;
+}
+
+// The batch kernel of a space matches its distance function, for every length of the list
+template<typename dist_t, typename elem_t>
+void check_space(hnswlib::SpaceInterface<dist_t> &space, size_t dim, std::mt19937 &rng) {
+    hnswlib::DISTBATCHFUNC<dist_t> batch_func = space.get_dist_batch_func();
+    // a portable build running a kernel wider than its flags has no batch kernel
+    if (space.get_dist_func_simd_level() > hnswlib::BuildSimdLevel()) {
+        assert(batch_func == nullptr);
+        return;
+    }
+    assert(batch_func != nullptr);
+    assert(space.get_query_dist_batch_func() == batch_func);
+    hnswlib::DISTFUNC<dist_t> dist_func = space.get_dist_func();
+    void *param = space.get_dist_func_param();
+
+    // rows holding a vector after a header, like the level 0 rows of the index
+    size_t num_rows = 50;
+    size_t header = 12;
+    size_t stride = header + dim * sizeof(elem_t) + 4;
+    std::vector<char> rows(num_rows * stride);
+    std::uniform_int_distribution<> distrib(-100, 100);
+    for (size_t i = 0; i < num_rows; i++) {
+        elem_t *v = (elem_t *) (rows.data() + i * stride + header);
+        for (size_t j = 0; j < dim; j++)
+            v[j] = (elem_t) distrib(rng) / (sizeof(elem_t) == 1 ? 1 : 100);
+    }
+    const elem_t *query = (const elem_t *) (rows.data() + 7 * stride + header);
+
+    std::uniform_int_distribution<hnswlib::tableint> ids_distrib(0, num_rows - 1);
+    for (size_t n = 0; n <= 33; n++) {
+        std::vector<hnswlib::tableint> ids(n);
+        for (auto &id : ids)
+            id = ids_distrib(rng);
+        std::vector<dist_t> out(n);
+        batch_func(query, rows.data() + header, stride, ids.data(), n, param, out.data());
+        for (size_t j = 0; j < n; j++) {
+            assert(close(out[j], dist_func(query, rows.data() + ids[j] * stride + header, param)));
+        }
+
+        // the bounded kernel of L2 spaces is exact below the bound and does not go under it above
+        hnswlib::DISTBOUNDEDBATCHFUNC<dist_t> bounded_func = space.get_dist_bounded_batch_func();
+        if (bounded_func == nullptr || n == 0)
+            continue;
+        assert(space.get_query_dist_bounded_batch_func() == bounded_func);
+        std::vector<dist_t> sorted(out);
+        std::sort(sorted.begin(), sorted.end());
+        for (dist_t bound : {sorted[0], sorted[n / 2], sorted[n - 1]}) {
+            std::vector<dist_t> bounded_out(n);
+            bounded_func(query, rows.data() + header, stride, ids.data(), n, param, bound, bounded_out.data());
+            for (size_t j = 0; j < n; j++) {
+                if (out[j] < bound)
+                    assert(close(bounded_out[j], out[j]));
+                else
+                    assert(bounded_out[j] >= bound || close(bounded_out[j], out[j]));
+            }
+        }
+    }
+}
+
+void test_kernels() {
+    std::mt19937 rng;
+    rng.seed(47);
+    for (size_t dim : {1, 3, 4, 7, 15, 16, 17, 31, 32, 33, 64, 100, 128, 300}) {
+        hnswlib::L2Space l2(dim);
+        hnswlib::InnerProductSpace ip(dim);
+        hnswlib::L2SpaceI l2_uint8(dim);
+        hnswlib::L2SpaceI8 l2_int8(dim);
+        hnswlib::InnerProductSpaceI ip_uint8(dim);
+        hnswlib::InnerProductSpaceI8 ip_int8(dim);
+        check_space<float, float>(l2, dim, rng);
+        check_space<float, float>(ip, dim, rng);
+        check_space<int, uint8_t>(l2_uint8, dim, rng);
+        check_space<int, int8_t>(l2_int8, dim, rng);
+        check_space<int, uint8_t>(ip_uint8, dim, rng);
+        check_space<int, int8_t>(ip_int8, dim, rng);
+        // inner products can decrease while summing, so they are never bounded
+        assert(ip.get_dist_bounded_batch_func() == nullptr);
+        assert(ip_int8.get_dist_bounded_batch_func() == nullptr);
+    }
+
+    // spaces whose queries are encoded differently have no batch kernel
+    hnswlib::L2SpaceFP16 fp16(16);
+    assert(fp16.get_dist_batch_func() == nullptr);
+    assert(fp16.get_query_dist_batch_func() == nullptr);
+}
+
+// The distance function of L2Space without its batch kernel
+class NoBatchL2Space : public hnswlib::SpaceInterface<float> {
+    hnswlib::L2Space space_;
+
+ public:
+    explicit NoBatchL2Space(size_t dim) : space_(dim) {}
+    size_t get_data_size() { return space_.get_data_size(); }
+    hnswlib::DISTFUNC<float> get_dist_func() { return space_.get_dist_func(); }
+    void *get_dist_func_param() { return space_.get_dist_func_param(); }
+};
+
+// The L2Space batch kernel, counting the neighbor lists it scores
+size_t num_batch_calls = 0;
+hnswlib::DISTBATCHFUNC<float> l2_batch_func = nullptr;
+
+void CountingL2Batch(const void *query, const char *data, size_t stride, const hnswlib::tableint *ids, size_t n,
+                     const void *param, float *out) {
+    num_batch_calls++;
+    l2_batch_func(query, data, stride, ids, n, param, out);
+}
+
+class CountingL2Space : public hnswlib::SpaceInterface<float> {
+    hnswlib::L2Space space_;
+
+ public:
+    explicit CountingL2Space(size_t dim) : space_(dim) { l2_batch_func = space_.get_dist_batch_func(); }
+    size_t get_data_size() { return space_.get_data_size(); }
+    hnswlib::DISTFUNC<float> get_dist_func() { return space_.get_dist_func(); }
+    hnswlib::DISTBATCHFUNC<float> get_dist_batch_func() { return l2_batch_func ? CountingL2Batch : nullptr; }
+    void *get_dist_func_param() { return space_.get_dist_func_param(); }
+};
+
+// Batched searches score the neighbor lists with the batch kernel, like searchKnn
+void test_batch_search() {
+    int d = 16;
+    size_t n = 1000;
+    size_t nq = 20;
+    size_t k = 10;
+
+    CountingL2Space space(d);
+    if (l2_batch_func == nullptr)
+        return;
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (size_t i = 0; i < n; i++)
+        alg_hnsw.addPoint(data.data() + d * i, i);
+
+    std::vector<hnswlib::labeltype> labels(nq * k);
+    std::vector<float> distances(nq * k);
+    num_batch_calls = 0;
+    alg_hnsw.searchKnnBatch(data.data(), nq, k, labels.data(), distances.data());
+    size_t batch_calls = num_batch_calls;
+    assert(batch_calls > 0);
+
+    num_batch_calls = 0;
+    for (size_t j = 0; j < nq; j++)
+        alg_hnsw.searchKnn(data.data() + d * j, k);
+    assert(num_batch_calls == batch_calls);
+}
+
+// Indexes built and searched with and without the batch kernel find the same neighbors
+void test_index() {
+    int d = 24;
+    idx_t n = 5000;
+    idx_t nq = 100;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    NoBatchL2Space no_batch_space(d);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    hnswlib::HierarchicalNSW<float> alg_batch(&space, n);
+    hnswlib::HierarchicalNSW<float> alg_no_batch(&no_batch_space, n);
+    assert(alg_batch.fstdistbatchfunc_ != nullptr);
+    assert(alg_no_batch.fstdistbatchfunc_ == nullptr);
+    assert(alg_batch.fstquerydistboundedbatchfunc_ != nullptr);
+    assert(alg_no_batch.fstquerydistboundedbatchfunc_ == nullptr);
+    for (idx_t i = 0; i < n; i++) {
+        alg_brute.addPoint(data.data() + d * i, i);
+        alg_batch.addPoint(data.data() + d * i, i);
+        alg_no_batch.addPoint(data.data() + d * i, i);
+    }
+    alg_batch.checkIntegrity();
+    alg_no_batch.checkIntegrity();
+
+    for (auto *alg : {&alg_batch, &alg_no_batch}) {
+        alg->setEf(100);
+        float correct = 0;
+        for (idx_t j = 0; j < nq; j++) {
+            auto expected = alg_brute.searchKnnCloserFirst(query.data() + j * d, k);
+            auto res = alg->searchKnnCloserFirst(query.data() + j * d, k);
+            for (auto &item : res) {
+                for (auto &expected_item : expected) {
+                    if (item.second == expected_item.second)
+                        correct++;
+                }
+            }
+        }
+        float recall = correct / (nq * k);
+        std::cout << "Recall: " << recall << std::endl;
+        assert(recall > 0.95);
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_kernels();
+    test_index();
+    test_batch_search();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
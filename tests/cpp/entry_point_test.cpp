@@ -0,0 +1,98 @@
+// This is a test file for the entry point published during concurrent insertions
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <thread>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+void test() {
+    int d = 16;
+    idx_t n = 5000;
+    int num_threads = 4;
+    int num_readers = 2;
+
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+
+    // levels rising along the insertions, so the entry point keeps changing
+    std::vector<int> levels(n);
+    for (idx_t i = 0; i < n; i++)
+        levels[i] = i % 97 == 0 ? (int) (i / 500) : 0;
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    assert(alg_hnsw.getEntryPoint().level == -1);
+    assert(alg_hnsw.searchKnn(data.data(), 1).empty());
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < num_readers; t++) {
+        readers.push_back(std::thread([&]() {
+            int last_level = -1;
+            while (!done) {
+                // the entry point is published with its level, which only grows
+                hnswlib::HierarchicalNSW<float>::EntryPoint entry_point = alg_hnsw.getEntryPoint();
+                assert(entry_point.level >= last_level);
+                if (entry_point.level >= 0) {
+                    assert(alg_hnsw.element_levels_[entry_point.node] == entry_point.level);
+                }
+                last_level = entry_point.level;
+                // searches never see an entry point without its element, even from an empty index
+                auto res = alg_hnsw.searchKnn(data.data(), 1);
+                assert(res.size() <= 1);
+            }
+        }));
+    }
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < num_threads; t++) {
+        writers.push_back(std::thread([&, t]() {
+            for (idx_t i = t; i < n; i += num_threads) {
+                alg_hnsw.addPoint(data.data() + d * i, i, levels[i]);
+            }
+        }));
+    }
+    for (auto &thread : writers) {
+        thread.join();
+    }
+    done = true;
+    for (auto &thread : readers) {
+        thread.join();
+    }
+
+    int max_level = *std::max_element(levels.begin(), levels.end());
+    hnswlib::HierarchicalNSW<float>::EntryPoint entry_point = alg_hnsw.getEntryPoint();
+    assert(entry_point.level == max_level);
+    assert(levels[alg_hnsw.getExternalLabel(entry_point.node)] == max_level);
+    size_t found = 0;
+    for (idx_t i = 0; i < n; i += 7) {
+        if (alg_hnsw.searchKnn(data.data() + d * i, 1).top().second == i)
+            found++;
+    }
+    assert(found > 0.95 * (n / 7));
+
+    // clearing empties the entry point
+    alg_hnsw.clear();
+    assert(alg_hnsw.getEntryPoint().level == -1);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
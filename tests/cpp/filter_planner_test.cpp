@@ -0,0 +1,197 @@
+// This is a test file for the planned filtered searches and the exact scan of the allowed elements
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class PickDivisibleIds : public hnswlib::BaseFilterFunctor {
+    size_t divisor;
+ public:
+    explicit PickDivisibleIds(size_t divisor) : divisor(divisor) {}
+
+    bool operator()(idx_t label) {
+        return label % divisor == 0;
+    }
+};
+
+// Same, with the count known by the caller
+class CountedDivisibleIds : public PickDivisibleIds {
+    size_t allowed_count;
+ public:
+    CountedDivisibleIds(size_t divisor, size_t num_labels)
+        : PickDivisibleIds(divisor), allowed_count((num_labels + divisor - 1) / divisor) {}
+
+    size_t get_allowed_count() {
+        return allowed_count;
+    }
+};
+
+std::vector<std::pair<float, idx_t>> sorted(std::priority_queue<std::pair<float, idx_t>> result) {
+    std::vector<std::pair<float, idx_t>> items;
+    for (; !result.empty(); result.pop())
+        items.push_back(result.top());
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+// the batch kernels may round differently from the kernel of BruteforceSearch, the labels are compared
+std::vector<idx_t> labels_of(const std::vector<std::pair<float, idx_t>> &items) {
+    std::vector<idx_t> labels;
+    for (auto &item : items)
+        labels.push_back(item.second);
+    std::sort(labels.begin(), labels.end());
+    return labels;
+}
+
+void test() {
+    int d = 32;
+    idx_t n = 20000;
+    idx_t nq = 20;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (idx_t i = 0; i < n; i++) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw.setEf(50);
+
+    // the scan is exact whatever the selectivity
+    for (size_t divisor : {1000, 100, 2}) {
+        PickDivisibleIds filter(divisor);
+        hnswlib::IdBitset allowed_ids = alg_hnsw.getAllowedIds(&filter);
+        for (idx_t j = 0; j < nq; j++) {
+            const float *p = query.data() + j * d;
+            auto expected = sorted(alg_brute.searchKnn(p, k, &filter));
+            hnswlib::SearchStats stats;
+            auto res = sorted(alg_hnsw.searchKnnExact(p, k, &filter, &stats));
+            assert(res.size() == k);
+            assert(labels_of(res) == labels_of(expected));
+            assert(stats.distance_computations == allowed_ids.count());
+            assert(labels_of(sorted(alg_hnsw.searchKnnExact(p, k, allowed_ids))) == labels_of(expected));
+        }
+    }
+
+    // caller supplied counts replace the sample
+    CountedDivisibleIds counted(400, n);
+    assert(alg_hnsw.estimateSelectivity(&counted) == 50.0 / n);
+
+    // filters allowing few elements are scanned, the others searched through the graph
+    assert(alg_hnsw.preferExactSearch(k, 0.001, 1) && alg_hnsw.preferExactSearch(k, 0.01, 0));
+    assert(!alg_hnsw.preferExactSearch(k, 0.5, 1) && !alg_hnsw.preferExactSearch(k, 1, 0));
+    alg_hnsw.setFilterPlanning(true);
+    PickDivisibleIds rare(200);
+    hnswlib::IdBitset rare_ids = alg_hnsw.getAllowedIds(&rare);
+    PickDivisibleIds half(2);
+    hnswlib::IdBitset half_ids = alg_hnsw.getAllowedIds(&half);
+    std::vector<idx_t> labels(nq * k);
+    std::vector<float> distances(nq * k);
+    alg_hnsw.searchKnnBatch(query.data(), nq, k, labels.data(), distances.data(), &rare);
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        auto expected = sorted(alg_brute.searchKnn(p, k, &rare));
+        hnswlib::SearchStats stats;
+        assert(labels_of(sorted(alg_hnsw.searchKnn(p, k, &rare, &stats))) == labels_of(expected));
+        assert(labels_of(sorted(alg_hnsw.searchKnn(p, k, rare_ids, &stats))) == labels_of(expected));
+        assert(stats.distance_computations == 2 * rare_ids.count() && stats.hops() == 0);
+        std::vector<idx_t> batch_labels(labels.begin() + j * k, labels.begin() + (j + 1) * k);
+        std::sort(batch_labels.begin(), batch_labels.end());
+        assert(batch_labels == labels_of(expected));
+
+        hnswlib::SearchStats graph_stats;
+        alg_hnsw.searchKnn(p, k, half_ids, &graph_stats);
+        assert(graph_stats.hops() > 0 && graph_stats.distance_computations < half_ids.count());
+    }
+
+    // deleted elements are not scanned
+    for (idx_t i = 0; i < n; i += 400)
+        alg_hnsw.markDelete(i);
+    for (idx_t j = 0; j < nq; j++) {
+        for (auto &item : sorted(alg_hnsw.searchKnn(query.data() + j * d, k, rare_ids)))
+            assert(item.second % 200 == 0 && item.second % 400 != 0);
+        for (auto &item : sorted(alg_hnsw.searchKnnExact(query.data() + j * d, k, &rare)))
+            assert(item.second % 200 == 0 && item.second % 400 != 0);
+    }
+}
+
+// Allows even labels, and checks that every label it is called with was inserted
+class PickEvenInsertedIds : public hnswlib::BaseFilterFunctor {
+    idx_t num_labels;
+ public:
+    explicit PickEvenInsertedIds(idx_t num_labels) : num_labels(num_labels) {}
+
+    bool operator()(idx_t label) {
+        assert(label < num_labels);
+        return label % 2 == 0;
+    }
+};
+
+// the scans over all elements running with the insertions only read rows that are fully written
+void test_concurrent_scans() {
+    int d = 16;
+    idx_t n = 20000;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = 1 + distrib(rng);
+
+    hnswlib::L2Space space(d);
+    size_t dim = d;
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n, 16, 20);
+    PickEvenInsertedIds filter(n);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (idx_t i = t; i < n; i += 4)
+                alg_hnsw.addPoint(data.data() + d * i, i);
+        }));
+    }
+    for (size_t j = 0; alg_hnsw.getCurrentElementCount() < n; j = (j + 1) % n) {
+        const float *p = data.data() + j * d;
+        for (auto &item : sorted(alg_hnsw.searchKnnExact(p, k, &filter)))
+            assert(item.first == space.get_dist_func()(p, data.data() + item.second * d, &dim));
+        hnswlib::IdBitset allowed_ids = alg_hnsw.getAllowedIds(&filter);
+        alg_hnsw.estimateSelectivity(&filter);
+        for (auto &item : sorted(alg_hnsw.searchKnnExact(p, k, allowed_ids)))
+            assert(item.second % 2 == 0);
+    }
+    for (auto &thread : threads)
+        thread.join();
+    assert(alg_hnsw.getAllowedIds(&filter).count() == n / 2);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    test_concurrent_scans();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+// This is a test file for the distance kernels specialized for fixed dimensions
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+
+namespace {
+
+bool close(float a, float b) {
+    return std::abs(a - b) <= 1e-4f * std::max(1.0f, std::abs(b));
+}
+
+template<bool is_l2>
+void check_dim(hnswlib::SpaceInterface<float> &space, size_t dim, std::mt19937 &rng) {
+    hnswlib::DISTFUNC<float> reference = is_l2 ? hnswlib::L2Sqr : hnswlib::InnerProductDistance;
+    hnswlib::FixedDimKernels fixed = hnswlib::SelectFixedDimKernels<is_l2>(dim);
+    hnswlib::DISTFUNC<float> dist_func = space.get_dist_func();
+    hnswlib::DISTBATCHFUNC<float> batch_func = space.get_dist_batch_func();
+    void *param = space.get_dist_func_param();
+    if (space.get_dist_func_simd_level() <= hnswlib::BuildSimdLevel()) {
+        // the space uses the specialized kernels when there are some
+        assert(fixed.dist_func == nullptr || dist_func == fixed.dist_func);
+        assert(fixed.dist_func == nullptr || batch_func == fixed.dist_batch_func);
+    } else {
+        // a portable build runs the generic kernel of a wider instruction set, without batch kernel
+        assert(batch_func == nullptr);
+        batch_func = fixed.dist_batch_func != nullptr ? fixed.dist_batch_func : hnswlib::SelectFloatBatchKernel<is_l2>();
+    }
+
+    size_t n = 9;
+    std::uniform_real_distribution<float> distrib(-1, 1);
+    std::vector<float> data(n * dim);
+    for (float &x : data)
+        x = distrib(rng);
+    std::vector<hnswlib::tableint> ids = {8, 0, 3, 3, 5, 1, 7};
+    std::vector<float> out(ids.size());
+    batch_func(data.data(), (const char *) data.data(), dim * sizeof(float), ids.data(), ids.size(), param, out.data());
+    for (size_t j = 0; j < ids.size(); j++) {
+        float expected = reference(data.data(), data.data() + ids[j] * dim, &dim);
+        assert(close(dist_func(data.data(), data.data() + ids[j] * dim, param), expected));
+        assert(close(out[j], expected));
+    }
+}
+
+void test() {
+    std::mt19937 rng;
+    rng.seed(47);
+
+#if defined(USE_SSE)
+    for (size_t dim : {96, 100, 128, 256, 384, 512, 768, 960, 1024, 1536}) {
+        assert(hnswlib::SelectFixedDimKernels<true>(dim).dist_func != nullptr);
+        assert(hnswlib::SelectFixedDimKernels<false>(dim).dist_batch_func != nullptr);
+    }
+#endif
+    // other dimensions keep the generic kernels
+    for (size_t dim : {1, 16, 97, 129, 200}) {
+        assert(hnswlib::SelectFixedDimKernels<true>(dim).dist_func == nullptr);
+        assert(hnswlib::SelectFixedDimKernels<false>(dim).dist_batch_func == nullptr);
+    }
+
+    for (size_t dim : {16, 96, 100, 127, 128, 256, 384, 512, 768, 960, 1024, 1536}) {
+        hnswlib::L2Space l2(dim);
+        hnswlib::InnerProductSpace ip(dim);
+        check_dim<true>(l2, dim, rng);
+        check_dim<false>(ip, dim, rng);
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+// This is a test file for the searches filtered by a set of internal ids
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class PickOddIds : public hnswlib::BaseFilterFunctor {
+ public:
+    bool operator()(idx_t label) {
+        return label % 2 == 1;
+    }
+};
+
+std::vector<std::pair<float, idx_t>> sorted(std::priority_queue<std::pair<float, idx_t>> result) {
+    std::vector<std::pair<float, idx_t>> items;
+    for (; !result.empty(); result.pop())
+        items.push_back(result.top());
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+void test_bitset() {
+    hnswlib::IdBitset ids(130);
+    assert(ids.size() == 130 && ids.count() == 0);
+    ids.set(0);
+    ids.set(63);
+    ids.set(64);
+    ids.set(129);
+    assert(ids.count() == 4);
+    assert(ids.test(0) && ids.test(63) && ids.test(64) && ids.test(129));
+    assert(!ids.test(1) && !ids.test(65) && !ids.test(130) && !ids.test(1000));
+    ids.reset(63);
+    assert(!ids.test(63) && ids.test(64) && ids.count() == 3);
+}
+
+void test_search() {
+    int d = 16;
+    idx_t n = 5000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    for (idx_t i = 0; i < n; i++)
+        alg_hnsw.addPoint(data.data() + d * i, i);
+    alg_hnsw.setEf(50);
+
+    // the bitset search keeps the same elements as the functor search
+    PickOddIds filter;
+    hnswlib::IdBitset odd_ids = alg_hnsw.getAllowedIds(&filter);
+    assert(odd_ids.count() == n / 2);
+    std::vector<idx_t> odd_labels;
+    for (idx_t i = 1; i < n; i += 2)
+        odd_labels.push_back(i);
+    odd_labels.push_back(n + 1);  // not in the index
+    hnswlib::IdBitset odd_ids_from_labels = alg_hnsw.getAllowedIds(odd_labels);
+    assert(odd_ids_from_labels.count() == n / 2);
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        auto expected = sorted(alg_hnsw.searchKnn(p, k, &filter));
+        assert(expected.size() == k);
+        assert(sorted(alg_hnsw.searchKnn(p, k, odd_ids)) == expected);
+        assert(sorted(alg_hnsw.searchKnn(p, k, odd_ids_from_labels)) == expected);
+    }
+    assert(alg_hnsw.getAllowedIds().count() == n);
+
+    // deletions made after the set was built are still left out
+    for (idx_t i = 1; i < n; i += 10)
+        alg_hnsw.markDelete(i);
+    hnswlib::IdBitset live_odd_ids = alg_hnsw.getAllowedIds(&filter);
+    assert(live_odd_ids.count() == n / 2 - n / 10);
+    hnswlib::IdBitset manual_odd_ids(n);
+    for (idx_t i = 1; i < n; i += 2)
+        manual_odd_ids.set(i);
+    hnswlib::SearchStats stats;
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        auto expected = sorted(alg_hnsw.searchKnn(p, k, &filter));
+        for (auto &item : expected)
+            assert(item.second % 10 != 1);
+        assert(sorted(alg_hnsw.searchKnn(p, k, odd_ids)) == expected);
+        assert(sorted(alg_hnsw.searchKnn(p, k, live_odd_ids, &stats)) == expected);
+        assert(sorted(alg_hnsw.searchKnn(p, k, manual_odd_ids)) == expected);
+    }
+    assert(stats.distance_computations > 0);
+
+    // the live elements of an index with deletions
+    hnswlib::IdBitset live_ids = alg_hnsw.getAllowedIds();
+    assert(live_ids.count() == n - n / 10);
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        assert(sorted(alg_hnsw.searchKnn(p, k, live_ids)) == sorted(alg_hnsw.searchKnn(p, k)));
+    }
+
+    // restored elements come back in the sets built afterwards
+    alg_hnsw.unmarkDelete(1);
+    assert(!live_odd_ids.test(1));
+    assert(alg_hnsw.getAllowedIds(&filter).count() == live_odd_ids.count() + 1);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_bitset();
+    test_search();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
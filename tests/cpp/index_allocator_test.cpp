@@ -0,0 +1,115 @@
+// This is a test file for allocating the base layer through an IndexAllocator
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+#include <set>
+#include <cstdio>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class CountingAllocator : public hnswlib::IndexAllocator {
+ public:
+    std::set<void *> live;
+    size_t allocations = 0;
+
+    void *allocate(size_t size) {
+        void *ptr = malloc(size);
+        live.insert(ptr);
+        allocations++;
+        return ptr;
+    }
+
+    void deallocate(void *ptr) {
+        assert(live.erase(ptr) == 1);
+        free(ptr);
+    }
+};
+
+void test() {
+    int d = 16;
+    idx_t n = 2000;
+    idx_t nq = 20;
+    size_t k = 10;
+    std::string path = "index_allocator_test.bin";
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_default(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_default.addPoint(data.data() + d * i, i);
+    }
+    std::vector<std::vector<std::pair<float, idx_t>>> expected;
+    for (size_t j = 0; j < nq; ++j) {
+        expected.push_back(alg_default.searchKnnCloserFirst(query.data() + j * d, k));
+    }
+    alg_default.saveIndex(path);
+
+    std::vector<hnswlib::PageAllocator *> page_allocators = {
+        new hnswlib::PageAllocator(hnswlib::HugePages::NONE),
+        new hnswlib::PageAllocator(hnswlib::HugePages::TRANSPARENT, hnswlib::NumaPolicy::INTERLEAVE),
+        new hnswlib::PageAllocator(hnswlib::HugePages::EXPLICIT, hnswlib::NumaPolicy::BIND, 0),
+    };
+    CountingAllocator counting_allocator;
+    std::vector<hnswlib::IndexAllocator *> allocators(page_allocators.begin(), page_allocators.end());
+    allocators.push_back(&counting_allocator);
+
+    for (hnswlib::IndexAllocator *allocator : allocators) {
+        for (auto layout : {hnswlib::Level0Layout::INTERLEAVED, hnswlib::Level0Layout::SPLIT}) {
+            {
+                // same graph whatever the allocator, through resizing and reordering
+                hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n / 2, 16, 200, 100, false, layout, allocator);
+                for (size_t i = 0; i < n; ++i) {
+                    if (i == n / 2)
+                        alg_hnsw.resizeIndex(n);
+                    alg_hnsw.addPoint(data.data() + d * i, i);
+                }
+                for (size_t j = 0; j < nq; ++j) {
+                    assert(alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+                }
+                alg_hnsw.reorderGraph();
+                for (size_t j = 0; j < nq; ++j) {
+                    assert(alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+                }
+
+                hnswlib::HierarchicalNSW<float> alg_loaded(&space, path, false, n, false, allocator);
+                for (size_t j = 0; j < nq; ++j) {
+                    assert(alg_loaded.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+                }
+            }
+            // everything allocated was given back
+            assert(counting_allocator.live.empty());
+        }
+    }
+    assert(counting_allocator.allocations > 0);
+    std::cout << "Online NUMA nodes: " << hnswlib::PageAllocator::getOnlineNumaNodes().size() << std::endl;
+
+    for (hnswlib::PageAllocator *allocator : page_allocators) {
+        delete allocator;
+    }
+    std::remove(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+// This is a test file for the uint8/int8 L2 and inner product kernels
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+
+namespace {
+
+template<bool is_signed, bool is_l2>
+void check_kernels(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, size_t dim) {
+    int expected = hnswlib::DistanceInt8<is_signed, is_l2>(a.data(), b.data(), &dim);
+
+    std::vector<hnswlib::DISTFUNC<int>> kernels = {hnswlib::SelectInt8Kernel<is_signed, is_l2>().func};
+#if defined(HNSWLIB_SSE41_KERNELS)
+    if (SSE41Capable())
+        kernels.push_back(hnswlib::DistanceInt8SSE41<is_signed, is_l2>);
+#endif
+#if defined(HNSWLIB_AVX2_KERNELS)
+    if (AVX2Capable())
+        kernels.push_back(hnswlib::DistanceInt8AVX2<is_signed, is_l2>);
+#endif
+#if defined(HNSWLIB_AVX512BW_KERNELS)
+    if (AVX512BWCapable())
+        kernels.push_back(hnswlib::DistanceInt8AVX512BW<is_signed, is_l2>);
+#endif
+#if defined(HNSWLIB_AVX512VNNI_KERNELS)
+    if (AVX512VNNICapable())
+        kernels.push_back(hnswlib::DistanceInt8AVX512VNNI<is_signed, is_l2>);
+#endif
+    for (auto kernel : kernels) {
+        assert(kernel(a.data(), b.data(), &dim) == expected);
+    }
+}
+
+void test_kernels() {
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_int_distribution<> distrib(0, 255);
+
+    for (size_t dim : {1, 3, 4, 15, 16, 17, 31, 32, 33, 64, 100, 128, 1000}) {
+        std::vector<uint8_t> a(dim), b(dim);
+        for (int rep = 0; rep < 20; rep++) {
+            for (size_t i = 0; i < dim; i++) {
+                a[i] = distrib(rng);
+                b[i] = distrib(rng);
+            }
+            if (rep == 0) {
+                // extreme values of both types
+                std::fill(a.begin(), a.end(), 0xff);
+                std::fill(b.begin(), b.end(), 0x80);
+            }
+            check_kernels<false, true>(a, b, dim);
+            check_kernels<true, true>(a, b, dim);
+            check_kernels<false, false>(a, b, dim);
+            check_kernels<true, false>(a, b, dim);
+
+            hnswlib::L2SpaceI space(dim);
+            int expected = hnswlib::L2SqrI(a.data(), b.data(), &dim);
+            assert(space.get_dist_func()(a.data(), b.data(), space.get_dist_func_param()) == expected);
+        }
+    }
+
+    // spot checks of the distance definitions
+    std::vector<int8_t> x = {-128, 127, 3};
+    std::vector<int8_t> y = {127, -128, -2};
+    size_t dim = 3;
+    hnswlib::L2SpaceI8 space_l2_i8(dim);
+    hnswlib::InnerProductSpaceI8 space_ip_i8(dim);
+    hnswlib::InnerProductSpaceI space_ip_u8(dim);
+    assert(space_l2_i8.get_dist_func()(x.data(), y.data(), &dim) == 255 * 255 * 2 + 25);
+    assert(space_ip_i8.get_dist_func()(x.data(), y.data(), &dim) == 128 * 127 * 2 + 6);
+    assert(space_ip_u8.get_dist_func()(x.data(), y.data(), &dim) == -(128 * 127 * 2 + 3 * 254));
+    assert(space_l2_i8.get_data_size() == 3);
+}
+
+void test_search() {
+    size_t d = 64;
+    size_t n = 2000;
+    size_t nq = 20;
+    size_t k = 10;
+
+    std::vector<int8_t> data(n * d);
+    std::vector<int8_t> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_int_distribution<> distrib(-128, 127);
+    for (auto& x : data)
+        x = distrib(rng);
+    for (auto& x : query)
+        x = distrib(rng);
+
+    hnswlib::L2SpaceI8 space(d);
+    hnswlib::HierarchicalNSW<int> alg_hnsw(&space, n);
+    hnswlib::BruteforceSearch<int> alg_brute(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw.setEf(200);
+
+    size_t correct = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        auto gt = alg_brute.searchKnnCloserFirst(query.data() + j * d, k);
+        auto res = alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k);
+        assert(res.size() == k);
+        for (size_t i = 0; i < k; i++) {
+            correct += res[i].first <= gt[k - 1].first;
+        }
+    }
+    std::cout << "Recall@10: " << (float) correct / (nq * k) << std::endl;
+    assert(correct >= 0.9 * nq * k);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_kernels();
+    test_search();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+// This is a test file for the sharded and the dense label lookups
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+typedef hnswlib::LabelLookup<hnswlib::labeltype, hnswlib::tableint> LabelLookup;
+
+// same contents as an unordered_map through random insertions, updates and erasures
+void test_single_thread(bool dense) {
+    const size_t num_labels = 20000;
+    LabelLookup lookup;
+    lookup.setDense(dense);
+    lookup.resize(num_labels);
+    std::unordered_map<hnswlib::labeltype, hnswlib::tableint> expected;
+
+    std::mt19937 rng;
+    rng.seed(47);
+    for (int i = 0; i < 200000; i++) {
+        // consecutive labels in the dense mode, sparse ones otherwise
+        hnswlib::labeltype label = rng() % num_labels;
+        if (!dense)
+            label *= 1000003;
+        hnswlib::tableint id = rng() % 1000000;
+        switch (rng() % 4) {
+            case 0:
+                lookup.set(label, id);
+                expected[label] = id;
+                break;
+            case 1:
+                assert(lookup.erase(label) == (expected.erase(label) == 1));
+                break;
+            case 2: {
+                hnswlib::tableint found;
+                bool inserted = lookup.findOrInsert(label, found, [id]() { return id; });
+                assert(inserted == expected.insert(std::make_pair(label, id)).second);
+                assert(found == expected[label]);
+                break;
+            }
+            default: {
+                hnswlib::tableint found;
+                auto search = expected.find(label);
+                assert(lookup.find(label, found) == (search != expected.end()));
+                if (search != expected.end())
+                    assert(found == search->second);
+            }
+        }
+        assert(lookup.size() == expected.size());
+    }
+    size_t count = 0;
+    lookup.forEach([&](hnswlib::labeltype label, hnswlib::tableint id) {
+        assert(expected.at(label) == id);
+        count++;
+    });
+    assert(count == expected.size());
+
+    // an id that fails to be made is not stored
+    hnswlib::tableint id;
+    try {
+        lookup.findOrInsert(num_labels + 1, id, []() -> hnswlib::tableint { throw std::runtime_error("full"); });
+        assert(false);
+    } catch (std::runtime_error &e) {
+    }
+    assert(!lookup.find(num_labels + 1, id));
+    assert(lookup.size() == expected.size());
+
+    lookup.clear();
+    assert(lookup.size() == 0);
+    assert(!lookup.find(expected.begin()->first, id));
+}
+
+// concurrent insertions of overlapping labels insert every label once
+void test_concurrent() {
+    const int num_threads = 8;
+    const hnswlib::labeltype num_labels = 100000;
+    LabelLookup lookup;
+    std::atomic<hnswlib::tableint> next_id{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (hnswlib::labeltype i = 0; i < num_labels; i++) {
+                hnswlib::labeltype label = (i * 7 + t * (num_labels / num_threads)) % num_labels;
+                hnswlib::tableint id;
+                lookup.findOrInsert(label, id, [&]() { return next_id++; });
+            }
+        }));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    assert(lookup.size() == num_labels);
+    assert(next_id == num_labels);
+
+    // fewer bytes per label than the nodes and buckets of an unordered_map
+    std::cout << "Bytes per label: " << (double) lookup.memoryUsage() / num_labels << std::endl;
+    assert(lookup.memoryUsage() < 40 * num_labels);
+}
+
+void test_index() {
+    int d = 16;
+    idx_t n = 4000;
+    int num_threads = 8;
+
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hashed(&space, n);
+    hnswlib::HierarchicalNSW<float> alg_dense(&space, n / 2);
+    alg_dense.setDenseLabels(true);
+    assert(alg_dense.label_lookup_.isDense());
+
+    for (hnswlib::HierarchicalNSW<float> *alg_hnsw : {&alg_hashed, &alg_dense}) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; t++) {
+            threads.push_back(std::thread([&, t]() {
+                for (idx_t i = t; i < n; i += num_threads) {
+                    alg_hnsw->addPoint(data.data() + d * i, i % (n / 2));
+                }
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        // every label went to a single element, updated by the second insertion
+        assert(alg_hnsw->cur_element_count == n / 2);
+        assert(alg_hnsw->label_lookup_.size() == n / 2);
+        for (idx_t label = 0; label < n / 2; label++) {
+            hnswlib::tableint internal_id = alg_hnsw->label_lookup_.at(label);
+            assert(alg_hnsw->getExternalLabel(internal_id) == label);
+        }
+    }
+
+    // dense labels must fit the capacity
+    bool rejected = false;
+    try {
+        alg_dense.addPoint(data.data(), n);
+    } catch (std::runtime_error &e) {
+        rejected = true;
+    }
+    assert(rejected);
+    alg_dense.resizeIndex(n + 1);
+    alg_dense.addPoint(data.data(), n);
+    assert(alg_dense.label_lookup_.at(n) == n / 2);
+
+    // switching mode keeps the labels
+    alg_dense.setDenseLabels(false);
+    assert(!alg_dense.label_lookup_.isDense());
+    assert(alg_dense.label_lookup_.size() == n / 2 + 1);
+    alg_dense.markDelete(n);
+    alg_dense.unmarkDelete(n);
+    assert(alg_dense.getDataByLabel<float>(n)[0] == data[0]);
+    alg_dense.addPoint(data.data(), 10 * n);
+    rejected = false;
+    try {
+        alg_dense.setDenseLabels(true);
+    } catch (std::runtime_error &e) {
+        rejected = true;
+    }
+    assert(rejected);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_single_thread(false);
+    test_single_thread(true);
+    test_concurrent();
+    test_index();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
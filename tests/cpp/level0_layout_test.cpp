@@ -0,0 +1,136 @@
+// This is a test file for the interleaved and split layouts of the base layer
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+size_t file_size(const std::string &path) {
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    return (size_t) input.tellg();
+}
+
+void test() {
+    int d = 16;
+    idx_t n = 2000;
+    idx_t nq = 50;
+    size_t k = 10;
+    std::string path = "level0_layout_test.bin";
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_interleaved(&space, n);
+    hnswlib::HierarchicalNSW<float> alg_split(&space, n, 16, 200, 100, false, hnswlib::Level0Layout::SPLIT);
+    assert(alg_split.level0_layout_ == hnswlib::Level0Layout::SPLIT);
+    assert((uintptr_t) alg_split.vectors_level0_memory_ % hnswlib::HUGE_PAGE_SIZE == 0);
+    assert((uintptr_t) alg_split.getDataByInternalId(1) - (uintptr_t) alg_split.getDataByInternalId(0) == d * sizeof(float));
+
+    // same graph in both layouts
+    for (size_t i = 0; i < n / 2; ++i) {
+        alg_interleaved.addPoint(data.data() + d * i, i);
+        alg_split.addPoint(data.data() + d * i, i);
+    }
+    alg_interleaved.resizeIndex(n + 1);
+    alg_split.resizeIndex(n + 1);
+    for (size_t i = n / 2; i < n; ++i) {
+        alg_interleaved.addPoint(data.data() + d * i, i);
+        alg_split.addPoint(data.data() + d * i, i);
+    }
+    for (size_t i = 0; i < n; i += 13) {
+        alg_interleaved.markDelete(i);
+        alg_split.markDelete(i);
+    }
+    alg_split.checkIntegrity();
+
+    std::vector<std::vector<std::pair<float, idx_t>>> expected;
+    for (size_t j = 0; j < nq; ++j) {
+        expected.push_back(alg_interleaved.searchKnnCloserFirst(query.data() + j * d, k));
+        assert(alg_split.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+    }
+
+    // an interleaved index is saved as before, a split one records its layout after the link lists
+    alg_interleaved.saveIndex(path);
+    size_t interleaved_size = file_size(path);
+    assert(interleaved_size == alg_interleaved.indexFileSize());
+    alg_split.saveIndex(path);
+    assert(file_size(path) == alg_split.indexFileSize());
+    assert(file_size(path) > interleaved_size);
+
+    hnswlib::HierarchicalNSW<float> alg_loaded(&space, path, false, n + 10);
+    assert(alg_loaded.level0_layout_ == hnswlib::Level0Layout::SPLIT);
+    assert(alg_loaded.getDeletedCount() == alg_split.getDeletedCount());
+    hnswlib::HierarchicalNSW<float> alg_mapped(&space);
+    alg_mapped.loadIndexMapped(path, &space);
+    assert(alg_mapped.level0_layout_ == hnswlib::Level0Layout::SPLIT);
+    for (size_t j = 0; j < nq; ++j) {
+        assert(alg_loaded.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+        assert(alg_mapped.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        hnswlib::tableint internal_id = alg_mapped.label_lookup_.at(i);
+        assert(memcmp(alg_mapped.getDataByInternalId(internal_id), data.data() + d * i, d * sizeof(float)) == 0);
+    }
+
+    // the loaded split index stays writable
+    alg_loaded.reorderGraph();
+    alg_loaded.addPoint(query.data(), n);
+    assert(alg_loaded.searchKnn(query.data(), 1).top().second == n);
+    alg_loaded.checkIntegrity();
+
+    // sections unknown to this version are skipped
+    alg_interleaved.saveIndex(path);
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::app);
+        uint64_t magic = hnswlib::HierarchicalNSW<float>::EXTENSIONS_MAGIC;
+        uint32_t section_id = 1000;
+        uint64_t section_size = 3;
+        output.write((char *) &magic, sizeof(magic));
+        output.write((char *) &section_id, sizeof(section_id));
+        output.write((char *) &section_size, sizeof(section_size));
+        output.write("abc", 3);
+    }
+    hnswlib::HierarchicalNSW<float> alg_extended(&space, path);
+    assert(alg_extended.level0_layout_ == hnswlib::Level0Layout::INTERLEAVED);
+    assert(alg_extended.searchKnnCloserFirst(query.data(), k) == expected[0]);
+
+    // a truncated section is rejected
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::app);
+        output.write("x", 1);
+    }
+    bool rejected = false;
+    try {
+        hnswlib::HierarchicalNSW<float> alg_broken(&space, path);
+    } catch (std::runtime_error &e) {
+        rejected = true;
+    }
+    assert(rejected);
+    std::remove(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+// This is a test file for the link list locks kept in a striped table of sequence numbers
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <cstdio>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+void assert_unlocked(hnswlib::HierarchicalNSW<float> &alg_hnsw) {
+    for (size_t i = 0; i < alg_hnsw.cur_element_count; i++) {
+        // an even sequence number means that no writer holds the lock
+        assert(alg_hnsw.getLinkListSeq(i)->load() % 2 == 0);
+    }
+}
+
+void test() {
+    int d = 16;
+    idx_t n = 4000;
+    int num_threads = 8;
+    std::string path = "link_list_lock_test.bin";
+
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    for (auto layout : {hnswlib::Level0Layout::INTERLEAVED, hnswlib::Level0Layout::SPLIT}) {
+        hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n / 2, 16, 200, 100, false, layout);
+
+        // concurrent insertions, growing the index in between
+        for (idx_t begin : {(idx_t) 0, n / 2}) {
+            if (begin > 0)
+                alg_hnsw.resizeIndex(n);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; t++) {
+                threads.push_back(std::thread([&, t]() {
+                    for (idx_t i = begin + t; i < begin + n / 2; i += num_threads) {
+                        alg_hnsw.addPoint(data.data() + d * i, i);
+                    }
+                }));
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+        }
+        assert(alg_hnsw.cur_element_count == n);
+        alg_hnsw.checkIntegrity();
+        assert_unlocked(alg_hnsw);
+
+        // concurrent updates lock the neighbors of the updated elements too
+        {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; t++) {
+                threads.push_back(std::thread([&, t]() {
+                    for (idx_t label = t; label < n; label += 3 * num_threads) {
+                        alg_hnsw.addPoint(data.data() + d * ((label * 7) % n), label);
+                    }
+                }));
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+        }
+        assert(alg_hnsw.cur_element_count == n);
+        assert_unlocked(alg_hnsw);
+
+        // a lock is released when it goes out of scope, and can be taken again
+        {
+            uint32_t seq = alg_hnsw.getLinkListSeq(1)->load();
+            hnswlib::HierarchicalNSW<float>::LinkListLock lock(&alg_hnsw, 1);
+            assert(alg_hnsw.getLinkListSeq(1)->load() == seq + 1);
+            lock.unlock();
+            assert(alg_hnsw.getLinkListSeq(1)->load() == seq + 2);
+            lock.lock();
+        }
+        assert_unlocked(alg_hnsw);
+
+        // the sequence number does not wrap after a few hundred writes
+        {
+            uint32_t seq = alg_hnsw.getLinkListSeq(1)->load();
+            for (int i = 0; i < 300; i++) {
+                hnswlib::HierarchicalNSW<float>::LinkListLock lock(&alg_hnsw, 1);
+            }
+            assert(alg_hnsw.getLinkListSeq(1)->load() == seq + 600);
+        }
+
+        // the elements of a stripe share their sequence number
+        assert(alg_hnsw.getLinkListSeq(1) == alg_hnsw.getLinkListSeq(1 + hnswlib::HierarchicalNSW<float>::LINK_LIST_SEQ_STRIPES));
+        assert(alg_hnsw.getLinkListSeq(1) != alg_hnsw.getLinkListSeq(2));
+
+        // a read-only index reads its links without writing to the mapping
+        alg_hnsw.saveIndex(path);
+        hnswlib::HierarchicalNSW<float> alg_mapped(&space);
+        alg_mapped.loadIndexMapped(path, &space);
+        hnswlib::HierarchicalNSW<float> alg_loaded(&space, path);
+        assert(alg_mapped.getLinkListSeq(0) == nullptr);
+        assert_unlocked(alg_loaded);
+        for (size_t i = 0; i < n; i += 97) {
+            assert(alg_mapped.getConnectionsWithLock(i, 0) == alg_hnsw.getConnectionsWithLock(i, 0));
+            assert(alg_loaded.getConnectionsWithLock(i, 0) == alg_hnsw.getConnectionsWithLock(i, 0));
+        }
+    }
+    std::remove(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+// This is a test file for opening a saved index with loadIndexMapped
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+#include <cstdio>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+template<typename Fn>
+bool throws(Fn fn) {
+    try {
+        fn();
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+void test() {
+    int d = 16;
+    idx_t n = 1000;
+    idx_t nq = 50;
+    size_t k = 10;
+    std::string path = "mmap_load_test.bin";
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float>* alg_hnsw = new hnswlib::HierarchicalNSW<float>(&space, 2 * n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw->addPoint(data.data() + d * i, 7 + i);
+    }
+    for (size_t i = 0; i < n; i += 10) {
+        alg_hnsw->markDelete(7 + i);
+    }
+    alg_hnsw->saveIndex(path);
+    delete alg_hnsw;
+
+    hnswlib::HierarchicalNSW<float>* alg_loaded = new hnswlib::HierarchicalNSW<float>(&space, path);
+    hnswlib::HierarchicalNSW<float>* alg_mapped = new hnswlib::HierarchicalNSW<float>(&space);
+    alg_mapped->loadIndexMapped(path, &space);
+
+    assert(alg_mapped->isReadOnly());
+    assert(!alg_loaded->isReadOnly());
+    assert(alg_mapped->getCurrentElementCount() == n);
+    assert(alg_mapped->getDeletedCount() == alg_loaded->getDeletedCount());
+    assert(alg_mapped->getEntryPoint().level == alg_loaded->getEntryPoint().level);
+    assert(alg_mapped->getEntryPoint().node == alg_loaded->getEntryPoint().node);
+
+    // the mapped index must behave exactly as the copied one
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto res_loaded = alg_loaded->searchKnnCloserFirst(p, k);
+        auto res_mapped = alg_mapped->searchKnnCloserFirst(p, k);
+        assert(res_loaded == res_mapped);
+        assert(res_mapped.size() == k);
+        for (auto& res : res_mapped) {
+            assert((res.second - 7) % 10 != 0);
+        }
+    }
+
+    std::vector<float> stored = alg_mapped->getDataByLabel<float>(7 + 1);
+    for (int i = 0; i < d; i++) {
+        assert(stored[i] == data[d + i]);
+    }
+
+    // any modification of a read-only index is rejected
+    assert(throws([&] { alg_mapped->addPoint(query.data(), n + 100); }));
+    assert(throws([&] { alg_mapped->addPoint(query.data(), 7 + 1); }));
+    assert(throws([&] { alg_mapped->markDelete(7 + 1); }));
+    assert(throws([&] { alg_mapped->unmarkDelete(7); }));
+    assert(throws([&] { alg_mapped->resizeIndex(4 * n); }));
+    assert(throws([&] { alg_mapped->saveIndex(path); }));
+
+    // a mapped index can be saved elsewhere and loaded back normally
+    std::string path_copy = "mmap_load_test_copy.bin";
+    alg_mapped->saveIndex(path_copy);
+    hnswlib::HierarchicalNSW<float>* alg_copy = new hnswlib::HierarchicalNSW<float>(&space, path_copy);
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        assert(alg_copy->searchKnnCloserFirst(p, k) == alg_mapped->searchKnnCloserFirst(p, k));
+    }
+
+    // reloading through loadIndex turns the index writable again
+    alg_mapped->loadIndex(path, &space, 2 * n);
+    assert(!alg_mapped->isReadOnly());
+    alg_mapped->addPoint(query.data(), n + 100);
+    assert(alg_mapped->getCurrentElementCount() == n + 1);
+
+    delete alg_loaded;
+    delete alg_mapped;
+    delete alg_copy;
+    std::remove(path.c_str());
+    std::remove(path_copy.c_str());
+}
+
+void test_corrupted() {
+    std::string path = "mmap_load_test_corrupted.bin";
+    {
+        std::ofstream output(path, std::ios::binary);
+        size_t junk[3] = {0, 100, 100};
+        output.write((char *) junk, sizeof(junk));
+    }
+    hnswlib::L2Space space(4);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space);
+    assert(throws([&] { alg_hnsw.loadIndexMapped(path, &space); }));
+    assert(throws([&] { alg_hnsw.loadIndexMapped("does_not_exist.bin", &space); }));
+    std::remove(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    test_corrupted();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -56,8 +56,8 @@ int main() {
 
     // insert remaining elements if needed
     for (hnswlib::labeltype label = 0; label < max_elements; label++) {
-        auto search = alg_hnsw->label_lookup_.find(label);
-        if (search == alg_hnsw->label_lookup_.end()) {
+        hnswlib::tableint internal_id;
+        if (!alg_hnsw->label_lookup_.find(label, internal_id)) {
             std::cout << "Adding " << label << std::endl;
             std::vector<float> data(d);
             for (int i = 0; i < d; i++) {
@@ -0,0 +1,231 @@
+// This is a test file for the HNSW index over product-quantized vectors with reranking
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <unordered_set>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+template<typename Fn>
+bool throws(Fn fn) {
+    try {
+        fn();
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+float recall(
+    const hnswlib::AlgorithmInterface<float>& alg,
+    const hnswlib::AlgorithmInterface<float>& alg_brute,
+    const std::vector<float>& query,
+    size_t nq,
+    size_t d,
+    size_t k) {
+    size_t correct = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto gt = alg_brute.searchKnn(p, k);
+        std::unordered_set<idx_t> expected;
+        while (!gt.empty()) {
+            expected.insert(gt.top().second);
+            gt.pop();
+        }
+        auto res = alg.searchKnn(p, k);
+        assert(res.size() == k);
+        while (!res.empty()) {
+            correct += expected.count(res.top().second);
+            res.pop();
+        }
+    }
+    return (float) correct / (nq * k);
+}
+
+void test_quantizer() {
+    int d = 8;
+    size_t n = 1000;
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+
+    assert(throws([&] { hnswlib::ProductQuantizer(10, 4); }));
+    hnswlib::ProductQuantizer pq(d, 4);
+    assert(!pq.isTrained());
+    assert(throws([&] { hnswlib::PQSpace space(pq); }));
+    assert(throws([&] { pq.train(data.data(), 100); }));
+    pq.train(data.data(), n);
+    assert(pq.isTrained());
+
+    hnswlib::PQSpace space(pq);
+    assert(space.get_data_size() == 4);
+
+    // the lookup table distance equals the distance to the decoded vector
+    std::vector<unsigned char> code(4);
+    std::vector<unsigned char> code2(4);
+    std::vector<float> decoded(d);
+    std::vector<float> decoded2(d);
+    std::vector<float> lut(pq.getLookupTableSize());
+    for (size_t i = 0; i + 1 < n; i += 50) {
+        const float* x = data.data() + i * d;
+        pq.encode(x, code.data());
+        pq.encode(x + d, code2.data());
+        pq.decode(code.data(), decoded.data());
+        pq.decode(code2.data(), decoded2.data());
+        pq.computeLookupTable(x + d, lut.data());
+
+        size_t dim = d;
+        float adc = space.get_query_dist_func()(lut.data(), code.data(), space.get_dist_func_param());
+        float sdc = space.get_dist_func()(code.data(), code2.data(), space.get_dist_func_param());
+        assert(std::abs(adc - hnswlib::L2Sqr(x + d, decoded.data(), &dim)) < 1e-4);
+        assert(std::abs(sdc - hnswlib::L2Sqr(decoded2.data(), decoded.data(), &dim)) < 1e-4);
+    }
+}
+
+void test_index() {
+    int d = 32;
+    idx_t n = 5000;
+    idx_t nq = 100;
+    size_t k = 10;
+    std::string path = "pq_index_test.bin";
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    hnswlib::HierarchicalNSW<float> alg_full(&space, n);
+
+    hnswlib::ProductQuantizer pq(d, 8);
+    pq.train(data.data(), 2000);
+    hnswlib::HierarchicalNSWPQ alg_pq(pq, n);
+
+    for (size_t i = 0; i < n; ++i) {
+        alg_brute.addPoint(data.data() + d * i, i);
+        alg_full.addPoint(data.data() + d * i, i);
+        alg_pq.addPoint(data.data() + d * i, i);
+    }
+
+    // 8 bytes of codes instead of 128 bytes of vector in the level-0 block
+    assert(alg_pq.graph_->size_data_per_element_ + 120 == alg_full.size_data_per_element_);
+
+    alg_pq.setEf(100);
+    float recall_pq = recall(alg_pq, alg_brute, query, nq, d, k);
+    std::cout << "Recall@10 with reranking: " << recall_pq << "\n";
+    assert(recall_pq > 0.9);
+
+    // reranked distances are exact
+    auto res = alg_pq.searchKnnCloserFirst(query.data(), k);
+    for (auto& item : res) {
+        size_t dim = d;
+        assert(item.first == space.get_dist_func()(query.data(), data.data() + item.second * d, &dim));
+    }
+
+    // without reranking more candidates the recall drops
+    alg_pq.setRerankK(k);
+    assert(recall(alg_pq, alg_brute, query, nq, d, k) < recall_pq);
+    alg_pq.setRerankK(0);
+
+    alg_pq.saveIndex(path);
+    hnswlib::HierarchicalNSWPQ alg_loaded(path);
+    hnswlib::HierarchicalNSWPQ alg_mapped(path, true);
+    assert(!alg_loaded.isReadOnly());
+    assert(alg_mapped.isReadOnly());
+    alg_loaded.setEf(100);
+    alg_mapped.setEf(100);
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto res_pq = alg_pq.searchKnnCloserFirst(p, k);
+        assert(alg_loaded.searchKnnCloserFirst(p, k) == res_pq);
+        assert(alg_mapped.searchKnnCloserFirst(p, k) == res_pq);
+    }
+    assert(throws([&] { alg_mapped.addPoint(query.data(), n); }));
+    assert(throws([&] { alg_mapped.saveIndex(path); }));
+
+    std::remove(path.c_str());
+    std::remove((path + ".pq").c_str());
+    std::remove((path + ".vectors").c_str());
+}
+
+// the searches running with the insertions only return elements whose full vector is stored
+void test_concurrent_adds() {
+    int d = 16;
+    idx_t n = 4000;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+
+    hnswlib::ProductQuantizer pq(d, 4);
+    pq.train(data.data(), 1000);
+    hnswlib::HierarchicalNSWPQ alg_pq(pq, n, 16, 200, 100, true);
+    hnswlib::L2Space space(d);
+    size_t dim = d;
+    alg_pq.addPoint(data.data(), 0);
+
+    std::atomic<bool> done{false};
+    std::thread searcher([&]() {
+        for (size_t j = 0; !done; j = (j + 1) % n) {
+            for (auto &item : alg_pq.searchKnnCloserFirst(data.data() + j * d, k)) {
+                idx_t i = item.second < n ? item.second : item.second - n + 1;
+                assert(item.first == space.get_dist_func()(data.data() + j * d, data.data() + i * d, &dim));
+            }
+        }
+    });
+    for (idx_t i = 1; i < n; i++)
+        alg_pq.addPoint(data.data() + d * i, i);
+    // replaced elements get the vectors of their new labels
+    for (idx_t i = 0; i < n; i += 10)
+        alg_pq.markDelete(i);
+    for (idx_t i = 0; i < n; i += 10)
+        alg_pq.addPoint(data.data() + d * (i + 1), n + i, true);
+    done = true;
+    searcher.join();
+
+    for (idx_t i = 0; i < n; i += 10) {
+        auto res = alg_pq.searchKnnCloserFirst(data.data() + d * (i + 1), 2);
+        for (auto &item : res)
+            assert(item.second == i + 1 || item.second == n + i);
+        assert(res[0].first == 0 && res[1].first == 0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_quantizer();
+    test_index();
+    test_concurrent_adds();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
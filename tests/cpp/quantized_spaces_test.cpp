@@ -0,0 +1,188 @@
+// This is a test file for the half precision and 8-bit scalar quantized spaces
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+#include <unordered_set>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+bool close(float a, float b) {
+    return std::abs(a - b) <= 1e-4f * std::max(1.0f, std::abs(b));
+}
+
+void test_fp16_conversion() {
+    assert(hnswlib::FloatToHalf(1.0f) == 0x3c00);
+    assert(hnswlib::FloatToHalf(-2.0f) == 0xc000);
+    assert(hnswlib::FloatToHalf(0.1f) == 0x2e66);
+    assert(hnswlib::FloatToHalf(65504.0f) == 0x7bff);
+    assert(hnswlib::FloatToHalf(65520.0f) == 0x7c00);
+    assert(hnswlib::FloatToHalf(std::pow(2.0f, -24.0f)) == 0x0001);
+    assert(hnswlib::FloatToHalf(std::pow(2.0f, -26.0f)) == 0x0000);
+    assert(hnswlib::FloatToHalf(1.0f + std::pow(2.0f, -11.0f)) == 0x3c00);  // tie rounds to even
+    assert(hnswlib::FloatToHalf(1.0f + 3 * std::pow(2.0f, -11.0f)) == 0x3c02);
+
+    // every finite half converts to float and back unchanged
+    for (uint32_t h = 0; h < 0x10000; h++) {
+        if ((h & 0x7c00) == 0x7c00)
+            continue;
+        assert(hnswlib::FloatToHalf(hnswlib::HalfToFloat((hnswlib::fp16_t) h)) == h);
+    }
+}
+
+// SIMD kernels must agree with the distance between decoded vectors, tails included
+void test_kernels() {
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib(-1, 1);
+
+    for (size_t dim : {1, 7, 8, 15, 16, 17, 33, 64, 100}) {
+        std::vector<float> data(100 * dim);
+        for (float& x : data)
+            x = distrib(rng);
+        std::vector<float> decoded1(dim), decoded2(dim);
+
+        hnswlib::L2SpaceFP16 space_fp16(dim);
+        std::vector<hnswlib::fp16_t> half1(dim), half2(dim);
+
+        hnswlib::ScalarQuantizer8 sq(dim);
+        sq.train(data.data(), 100);
+        hnswlib::L2SpaceSQ8 space_l2_sq8(sq);
+        hnswlib::InnerProductSpaceSQ8 space_ip_sq8(sq);
+        assert(space_l2_sq8.get_data_size() == dim);
+        std::vector<uint8_t> code1(dim), code2(dim);
+
+        for (size_t i = 0; i + 1 < 100; i++) {
+            const float* x1 = data.data() + i * dim;
+            const float* x2 = x1 + dim;
+
+            space_fp16.encode(x1, half1.data());
+            space_fp16.encode(x2, half2.data());
+            space_fp16.decode(half1.data(), decoded1.data());
+            space_fp16.decode(half2.data(), decoded2.data());
+            for (size_t d = 0; d < dim; d++)
+                assert(std::abs(decoded1[d] - x1[d]) < 1e-3);
+            void* param = space_fp16.get_dist_func_param();
+            assert(close(space_fp16.get_dist_func()(half1.data(), half2.data(), param),
+                         hnswlib::L2Sqr(decoded1.data(), decoded2.data(), &dim)));
+            assert(close(space_fp16.get_query_dist_func()(x1, half2.data(), param),
+                         hnswlib::L2Sqr(x1, decoded2.data(), &dim)));
+
+            sq.encode(x1, code1.data());
+            sq.encode(x2, code2.data());
+            sq.decode(code1.data(), decoded1.data());
+            sq.decode(code2.data(), decoded2.data());
+            for (size_t d = 0; d < dim; d++)
+                assert(std::abs(decoded1[d] - x1[d]) <= sq.step_[d] / 2 + 1e-6);
+            param = space_l2_sq8.get_dist_func_param();
+            assert(close(space_l2_sq8.get_dist_func()(code1.data(), code2.data(), param),
+                         hnswlib::L2Sqr(decoded1.data(), decoded2.data(), &dim)));
+            assert(close(space_l2_sq8.get_query_dist_func()(x1, code2.data(), param),
+                         hnswlib::L2Sqr(x1, decoded2.data(), &dim)));
+            param = space_ip_sq8.get_dist_func_param();
+            assert(close(space_ip_sq8.get_dist_func()(code1.data(), code2.data(), param),
+                         hnswlib::InnerProductDistance(decoded1.data(), decoded2.data(), &dim)));
+            assert(close(space_ip_sq8.get_query_dist_func()(x1, code2.data(), param),
+                         hnswlib::InnerProductDistance(x1, decoded2.data(), &dim)));
+        }
+    }
+}
+
+template<typename Encoder>
+float recall(
+    hnswlib::SpaceInterface<float>& space,
+    hnswlib::SpaceInterface<float>& full_space,
+    Encoder encode,
+    const std::vector<float>& data,
+    const std::vector<float>& query,
+    size_t n,
+    size_t nq,
+    size_t d,
+    size_t k) {
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    alg_hnsw.setEf(100);
+    hnswlib::BruteforceSearch<float> alg_brute(&full_space, n);
+    std::vector<char> code(space.get_data_size());
+    for (size_t i = 0; i < n; ++i) {
+        encode(data.data() + d * i, code.data());
+        alg_hnsw.addPoint(code.data(), i);
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+
+    size_t correct = 0;
+    for (size_t j = 0; j < nq; ++j) {
+        const void* p = query.data() + j * d;
+        auto gt = alg_brute.searchKnn(p, k);
+        std::unordered_set<idx_t> expected;
+        while (!gt.empty()) {
+            expected.insert(gt.top().second);
+            gt.pop();
+        }
+        auto res = alg_hnsw.searchKnn(p, k);
+        assert(res.size() == k);
+        while (!res.empty()) {
+            correct += expected.count(res.top().second);
+            res.pop();
+        }
+    }
+    return (float) correct / (nq * k);
+}
+
+void test_search() {
+    size_t d = 32;
+    size_t n = 2000;
+    size_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float& x : data)
+        x = distrib(rng);
+    for (float& x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space_l2(d);
+    hnswlib::InnerProductSpace space_ip(d);
+
+    hnswlib::L2SpaceFP16 space_fp16(d);
+    float recall_fp16 = recall(space_fp16, space_l2, [&](const float* x, char* code) {
+        space_fp16.encode(x, code);
+    }, data, query, n, nq, d, k);
+
+    hnswlib::ScalarQuantizer8 sq(d);
+    sq.train(data.data(), n);
+    hnswlib::L2SpaceSQ8 space_l2_sq8(sq);
+    float recall_l2_sq8 = recall(space_l2_sq8, space_l2, [&](const float* x, char* code) {
+        sq.encode(x, (uint8_t*) code);
+    }, data, query, n, nq, d, k);
+    hnswlib::InnerProductSpaceSQ8 space_ip_sq8(sq);
+    float recall_ip_sq8 = recall(space_ip_sq8, space_ip, [&](const float* x, char* code) {
+        sq.encode(x, (uint8_t*) code);
+    }, data, query, n, nq, d, k);
+
+    std::cout << "Recall@10 fp16: " << recall_fp16 << ", l2 sq8: " << recall_l2_sq8
+              << ", ip sq8: " << recall_ip_sq8 << std::endl;
+    assert(recall_fp16 > 0.95);
+    assert(recall_l2_sq8 > 0.9);
+    assert(recall_ip_sq8 > 0.9);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_fp16_conversion();
+    test_kernels();
+    test_search();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// This is a test file for renumbering the internal ids with reorderGraph
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+#include <cstdio>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+// share of base layer links between elements whose ids differ by at most 64
+double local_link_share(const hnswlib::HierarchicalNSW<float>& alg_hnsw) {
+    size_t local = 0;
+    size_t links = 0;
+    for (hnswlib::tableint i = 0; i < alg_hnsw.cur_element_count; i++) {
+        hnswlib::linklistsizeint* ll = alg_hnsw.get_linklist0(i);
+        hnswlib::tableint* data = (hnswlib::tableint*) (ll + 1);
+        for (size_t j = 0; j < alg_hnsw.getListCount(ll); j++) {
+            local += std::abs((double) data[j] - (double) i) <= 64;
+            links++;
+        }
+    }
+    return (double) local / links;
+}
+
+void test(hnswlib::GraphOrder order) {
+    int d = 16;
+    idx_t n = 3000;
+    idx_t nq = 50;
+    size_t k = 10;
+    std::string path = "reorder_graph_test.bin";
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, 2 * n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw.addPoint(data.data() + d * i, 5 + i);
+    }
+    for (size_t i = 0; i < n; i += 7) {
+        alg_hnsw.markDelete(5 + i);
+    }
+    alg_hnsw.setEf(50);
+
+    std::vector<std::vector<std::pair<float, idx_t>>> expected;
+    for (size_t j = 0; j < nq; ++j) {
+        expected.push_back(alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k));
+    }
+    double local_before = local_link_share(alg_hnsw);
+
+    alg_hnsw.reorderGraph(order);
+    alg_hnsw.checkIntegrity();
+
+    double local_after = local_link_share(alg_hnsw);
+    std::cout << "Local links: " << local_before << " -> " << local_after << std::endl;
+    assert(local_after > 1.2 * local_before);
+
+    // same graph under new ids: same results, data and deletions follow the labels
+    for (size_t j = 0; j < nq; ++j) {
+        assert(alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        hnswlib::tableint internal_id = alg_hnsw.label_lookup_.at(5 + i);
+        assert(alg_hnsw.isMarkedDeleted(internal_id) == (i % 7 == 0));
+        assert(memcmp(alg_hnsw.getDataByInternalId(internal_id), data.data() + d * i, d * sizeof(float)) == 0);
+    }
+    assert(alg_hnsw.getDeletedCount() == (n + 6) / 7);
+
+    // the order is saved with the index
+    alg_hnsw.saveIndex(path);
+    hnswlib::HierarchicalNSW<float> alg_loaded(&space, path, false, 2 * n);
+    alg_loaded.setEf(50);
+    assert(alg_loaded.getEntryPoint().node == alg_hnsw.getEntryPoint().node);
+    for (size_t j = 0; j < nq; ++j) {
+        assert(alg_loaded.searchKnnCloserFirst(query.data() + j * d, k) == expected[j]);
+    }
+    std::remove(path.c_str());
+
+    // the index stays writable
+    alg_hnsw.unmarkDelete(5);
+    alg_hnsw.addPoint(query.data(), 5 + n);
+    auto res = alg_hnsw.searchKnn(query.data(), 1);
+    assert(res.top().second == 5 + n);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test(hnswlib::GraphOrder::BFS);
+    test(hnswlib::GraphOrder::RCM);
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
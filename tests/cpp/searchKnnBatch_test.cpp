@@ -0,0 +1,184 @@
+// This is a test file for testing the batched search
+//  >>> void searchKnnBatch(const void *queries, size_t nq, size_t k, labeltype *labels, dist_t *distances,
+//  >>>                     BaseFilterFunctor* isIdAllowed = nullptr, SearchStats* stats = nullptr) const;
+// of class HierarchicalNSW
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class PickDivisibleIds: public hnswlib::BaseFilterFunctor {
+unsigned int divisor = 1;
+ public:
+    PickDivisibleIds(unsigned int divisor): divisor(divisor) {
+        assert(divisor != 0);
+    }
+    bool operator()(idx_t label_id) {
+        return label_id % divisor == 0;
+    }
+};
+
+// batched results and work must match searchKnnCloserFirst query by query
+void check_batch(
+    hnswlib::HierarchicalNSW<float>& alg_hnsw,
+    const std::vector<float>& query,
+    size_t nq,
+    size_t d,
+    size_t k,
+    hnswlib::BaseFilterFunctor* filter = nullptr) {
+    std::vector<idx_t> labels(nq * k);
+    std::vector<float> distances(nq * k);
+    std::vector<hnswlib::SearchStats> stats(nq);
+    alg_hnsw.searchKnnBatch(query.data(), nq, k, labels.data(), distances.data(), filter, stats.data());
+
+    for (size_t j = 0; j < nq; ++j) {
+        hnswlib::SearchStats expected_stats;
+        auto res = alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k, filter, &expected_stats);
+        assert(stats[j].hops_per_level == expected_stats.hops_per_level);
+        assert(stats[j].distance_computations == expected_stats.distance_computations);
+        assert(stats[j].visited_nodes == expected_stats.visited_nodes);
+        // elements at equal distances may come in any order
+        std::vector<idx_t> expected_labels;
+        std::vector<idx_t> batch_labels;
+        for (size_t i = 0; i < k; i++) {
+            if (i < res.size()) {
+                assert(distances[j * k + i] == res[i].first);
+                expected_labels.push_back(res[i].second);
+                batch_labels.push_back(labels[j * k + i]);
+            } else {
+                assert(labels[j * k + i] == std::numeric_limits<idx_t>::max());
+            }
+        }
+        std::sort(expected_labels.begin(), expected_labels.end());
+        std::sort(batch_labels.begin(), batch_labels.end());
+        assert(expected_labels == batch_labels);
+    }
+}
+
+void test() {
+    int d = 16;
+    idx_t n = 2000;
+    idx_t nq = 101;  // not a multiple of the interleave factor
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+
+    for (idx_t i = 0; i < n * d; ++i) {
+        data[i] = distrib(rng);
+    }
+    for (idx_t i = 0; i < nq * d; ++i) {
+        query[i] = distrib(rng);
+    }
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n, 16, 100);
+
+    // empty index
+    std::vector<idx_t> labels(nq * k, 0);
+    std::vector<float> distances(nq * k, 0);
+    alg_hnsw.searchKnnBatch(query.data(), nq, k, labels.data(), distances.data());
+    for (idx_t label : labels) {
+        assert(label == std::numeric_limits<idx_t>::max());
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw.addPoint(data.data() + d * i, 13 + i);
+    }
+
+    for (size_t ef : {10, 50, 200}) {
+        alg_hnsw.setEf(ef);
+        check_batch(alg_hnsw, query, nq, d, k);
+        check_batch(alg_hnsw, query, 1, d, k);
+        check_batch(alg_hnsw, query, 3, d, k);
+    }
+
+    // filtered search and search with deleted elements
+    PickDivisibleIds pickIdsDivisibleByThree(3);
+    check_batch(alg_hnsw, query, nq, d, k, &pickIdsDivisibleByThree);
+
+    // with the compact visited sets, the walk through allowed elements and the planned exact scan
+    alg_hnsw.setCompactVisitedMaxEf(200);
+    check_batch(alg_hnsw, query, nq, d, k);
+    alg_hnsw.setTwoHopMaxSelectivity(0.5);
+    check_batch(alg_hnsw, query, nq, d, k, &pickIdsDivisibleByThree);
+    alg_hnsw.setCompactVisitedMaxEf(0);
+    check_batch(alg_hnsw, query, nq, d, k, &pickIdsDivisibleByThree);
+    alg_hnsw.setTwoHopMaxSelectivity(0);
+    alg_hnsw.setFilterPlanning(true);
+    PickDivisibleIds pickIdsDivisibleByHundred(100);
+    check_batch(alg_hnsw, query, nq, d, k, &pickIdsDivisibleByHundred);
+    alg_hnsw.setFilterPlanning(false);
+
+    for (size_t i = 0; i < n; i += 2) {
+        alg_hnsw.markDelete(13 + i);
+    }
+    check_batch(alg_hnsw, query, nq, d, k);
+    check_batch(alg_hnsw, query, nq, d, k, &pickIdsDivisibleByThree);
+
+    // k larger than the number of elements
+    check_batch(alg_hnsw, query, nq, d, n);
+}
+
+// spaces storing encoded vectors still take float queries
+void test_encoded_spaces() {
+    int d = 16;
+    idx_t n = 2000;
+    idx_t nq = 101;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2SpaceFP16 fp16_space(d);
+    hnswlib::HierarchicalNSW<float> alg_fp16(&fp16_space, n, 16, 100);
+    hnswlib::ScalarQuantizer8 sq(d);
+    sq.train(data.data(), n);
+    hnswlib::L2SpaceSQ8 sq8_space(sq);
+    hnswlib::HierarchicalNSW<float> alg_sq8(&sq8_space, n, 16, 100);
+    assert(fp16_space.get_query_data_size() == d * sizeof(float));
+    assert(sq8_space.get_query_data_size() == d * sizeof(float));
+
+    std::vector<char> code(fp16_space.get_data_size());
+    std::vector<uint8_t> sq8_code(sq8_space.get_data_size());
+    for (idx_t i = 0; i < n; i++) {
+        fp16_space.encode(data.data() + d * i, code.data());
+        alg_fp16.addPoint(code.data(), i);
+        sq.encode(data.data() + d * i, sq8_code.data());
+        alg_sq8.addPoint(sq8_code.data(), i);
+    }
+    alg_fp16.setEf(50);
+    alg_sq8.setEf(50);
+    check_batch(alg_fp16, query, nq, d, k);
+    check_batch(alg_sq8, query, nq, d, k);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    test_encoded_spaces();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
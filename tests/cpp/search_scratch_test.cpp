@@ -0,0 +1,97 @@
+// This is a test file for searches reusing the per-thread heaps, nested searches included
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+// Filter that runs searches of its own while the search using it is in progress
+class NestedSearchFilter : public hnswlib::BaseFilterFunctor {
+ public:
+    hnswlib::HierarchicalNSW<float> &alg_hnsw;
+    const float *query;
+    std::vector<std::pair<float, idx_t>> expected;
+    size_t calls = 0;
+
+    NestedSearchFilter(hnswlib::HierarchicalNSW<float> &alg_hnsw, const float *query)
+        : alg_hnsw(alg_hnsw), query(query) {
+        expected = alg_hnsw.searchKnnCloserFirst(query, 5);
+    }
+
+    bool operator()(idx_t label_id) {
+        if (calls++ % 50 == 0) {
+            assert(alg_hnsw.searchKnnCloserFirst(query, 5) == expected);
+        }
+        return label_id % 2 == 0;
+    }
+};
+
+void test() {
+    int d = 16;
+    idx_t n = 2000;
+    idx_t nq = 20;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+
+    // results keep the k closest found by a search with a large ef, whatever the ef of the previous search
+    for (size_t ef : {2000, 10, 500, 20}) {
+        alg_hnsw.setEf(ef);
+        for (size_t j = 0; j < nq; ++j) {
+            const float *p = query.data() + j * d;
+            auto res = alg_hnsw.searchKnnCloserFirst(p, k);
+            assert(res.size() == k);
+            for (size_t i = 1; i < k; i++) {
+                assert(res[i - 1].first <= res[i].first);
+            }
+            if (ef == 2000) {
+                assert(res == alg_brute.searchKnnCloserFirst(p, k));
+            }
+        }
+    }
+
+    alg_hnsw.setEf(50);
+    for (size_t j = 0; j < nq; ++j) {
+        const float *p = query.data() + j * d;
+        NestedSearchFilter filter(alg_hnsw, p);
+        auto res = alg_hnsw.searchKnn(p, k, &filter);
+        assert(filter.calls > 0);
+        assert(res.size() == k);
+        while (!res.empty()) {
+            assert(res.top().second % 2 == 0);
+            res.pop();
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+// This is a test file for the search counters returned through SearchStats
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class PickOddIds : public hnswlib::BaseFilterFunctor {
+ public:
+    bool operator()(idx_t label) {
+        return label % 2 == 1;
+    }
+};
+
+bool same_stats(const hnswlib::SearchStats &a, const hnswlib::SearchStats &b) {
+    return a.hops_per_level == b.hops_per_level && a.distance_computations == b.distance_computations &&
+           a.visited_nodes == b.visited_nodes && a.heap_operations == b.heap_operations;
+}
+
+void test() {
+    int d = 16;
+    idx_t n = 5000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n, 8);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (idx_t i = 0; i < n; i++) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw.setEf(50);
+    int max_level = alg_hnsw.getEntryPoint().level;
+    assert(max_level > 0);
+
+    // the counters do not change the results and describe the walk of the query
+    std::vector<hnswlib::SearchStats> query_stats(nq);
+    hnswlib::SearchStats total;
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        auto expected = alg_hnsw.searchKnnCloserFirst(p, k);
+        auto res = alg_hnsw.searchKnnCloserFirst(p, k, nullptr, &query_stats[j]);
+        assert(res == expected);
+
+        const hnswlib::SearchStats &stats = query_stats[j];
+        assert(stats.hops_per_level.size() == (size_t) max_level + 1);
+        for (size_t level = 0; level < stats.hops_per_level.size(); level++)
+            assert(stats.hops_per_level[level] > 0);
+        assert(stats.visited_nodes >= 50);
+        assert(stats.distance_computations >= stats.visited_nodes);
+        assert(stats.heap_operations >= 2 * stats.hops_per_level[0]);
+
+        // a search adds to the counters it is given
+        alg_hnsw.searchKnn(p, k, nullptr, &total);
+        hnswlib::SearchStats sum;
+        for (idx_t i = 0; i <= j; i++)
+            sum += query_stats[i];
+        assert(same_stats(total, sum));
+        assert(total.hops() == sum.hops());
+    }
+    total.reset();
+    assert(total.hops() == 0 && total.distance_computations == 0);
+
+    // concurrent searches count their own work only, and the deprecated shared counters their hops above level 0
+    alg_hnsw.metric_hops = 0;
+    alg_hnsw.metric_distance_computations = 0;
+    std::vector<std::thread> threads;
+    std::vector<hnswlib::SearchStats> thread_stats(nq);
+    for (size_t t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (idx_t j = t; j < nq; j += 4)
+                alg_hnsw.searchKnn(query.data() + j * d, k, nullptr, &thread_stats[j]);
+        }));
+    }
+    for (auto &thread : threads)
+        thread.join();
+    size_t upper_hops = 0;
+    for (idx_t j = 0; j < nq; j++) {
+        assert(same_stats(thread_stats[j], query_stats[j]));
+        upper_hops += query_stats[j].hops() - query_stats[j].hops_per_level[0];
+    }
+    assert(alg_hnsw.metric_hops == (long) upper_hops);
+    assert(alg_hnsw.metric_distance_computations >= alg_hnsw.metric_hops);
+
+    // filtered searches and searches with deletions are counted too
+    PickOddIds filter;
+    hnswlib::SearchStats filtered;
+    alg_hnsw.searchKnn(query.data(), k, &filter, &filtered);
+    assert(filtered.hops_per_level[0] > 0 && filtered.distance_computations > 0);
+    alg_hnsw.markDelete(0);
+    hnswlib::SearchStats with_deletions;
+    alg_hnsw.searchKnn(query.data(), k, nullptr, &with_deletions);
+    assert(with_deletions.hops_per_level[0] > 0 && with_deletions.distance_computations > 0);
+
+    hnswlib::EpsilonSearchStopCondition<float> stop_condition(2.0f, 10, 100);
+    hnswlib::SearchStats epsilon;
+    alg_hnsw.searchStopConditionClosest(query.data(), stop_condition, nullptr, &epsilon);
+    assert(epsilon.hops_per_level[0] > 0 && epsilon.distance_computations > 0);
+
+    // a scan computes every distance
+    hnswlib::SearchStats brute;
+    alg_brute.searchKnn(query.data(), k, nullptr, &brute);
+    assert(brute.distance_computations == n && brute.hops() == 0);
+}
+
+// An algorithm implementing the searchKnn of the interface without counters
+class UncountedBruteforce : public hnswlib::AlgorithmInterface<float> {
+    hnswlib::BruteforceSearch<float> alg_;
+
+ public:
+    UncountedBruteforce(hnswlib::SpaceInterface<float> *s, size_t max_elements) : alg_(s, max_elements) {}
+
+    void addPoint(const void *datapoint, idx_t label, bool replace_deleted = false) {
+        alg_.addPoint(datapoint, label, replace_deleted);
+    }
+
+    std::priority_queue<std::pair<float, idx_t>>
+    searchKnn(const void *query_data, size_t k, hnswlib::BaseFilterFunctor* isIdAllowed = nullptr) const {
+        return alg_.searchKnn(query_data, k, isIdAllowed);
+    }
+
+    void saveIndex(const std::string &location) {
+        alg_.saveIndex(location);
+    }
+};
+
+// Searches given counters on such an algorithm search without counting
+void test_uncounted_algorithm() {
+    int d = 4;
+    idx_t n = 100;
+    std::vector<float> data(n * d);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (float) (i % 7);
+
+    hnswlib::L2Space space(d);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    UncountedBruteforce alg_uncounted(&space, n);
+    hnswlib::AlgorithmInterface<float> *alg = &alg_uncounted;
+    for (idx_t i = 0; i < n; i++) {
+        alg_brute.addPoint(data.data() + d * i, i);
+        alg->addPoint(data.data() + d * i, i);
+    }
+
+    hnswlib::SearchStats stats;
+    auto res = alg->searchKnnCloserFirst(data.data(), 5, nullptr, &stats);
+    assert(res == alg_brute.searchKnnCloserFirst(data.data(), 5));
+    assert(alg->searchKnn(data.data(), 5, nullptr, &stats).size() == 5);
+    assert(stats.distance_computations == 0 && stats.hops() == 0);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    test_uncounted_algorithm();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+// This is a test file for the dispatch of the distance kernels on the instruction sets of the CPU
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+namespace {
+
+bool close(float a, float b) {
+    return std::abs(a - b) <= 1e-4f * std::max(1.0f, std::abs(b));
+}
+
+std::vector<hnswlib::SimdLevel> cpu_levels() {
+    std::vector<hnswlib::SimdLevel> levels;
+    for (int level = 0; level <= (int) hnswlib::CpuSimdLevel(); level++)
+        levels.push_back((hnswlib::SimdLevel) level);
+    return levels;
+}
+
+// Every kernel the CPU can run matches the scalar one and never goes above the requested instruction set
+void test_kernels() {
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<float> distrib(-1, 1);
+    std::uniform_int_distribution<> distrib_int8(0, 255);
+
+    for (size_t dim : {1, 3, 4, 7, 16, 17, 33, 64, 100, 128}) {
+        std::vector<float> a(dim), b(dim);
+        std::vector<uint8_t> a8(dim), b8(dim);
+        for (size_t i = 0; i < dim; i++) {
+            a[i] = distrib(rng);
+            b[i] = distrib(rng);
+            a8[i] = distrib_int8(rng);
+            b8[i] = distrib_int8(rng);
+        }
+        float l2 = hnswlib::L2Sqr(a.data(), b.data(), &dim);
+        float ip = hnswlib::InnerProductDistance(a.data(), b.data(), &dim);
+        int l2_int8 = hnswlib::DistanceInt8<true, true>(a8.data(), b8.data(), &dim);
+        int ip_uint8 = hnswlib::DistanceInt8<false, false>(a8.data(), b8.data(), &dim);
+
+        for (hnswlib::SimdLevel level : cpu_levels()) {
+            hnswlib::DistanceKernel<float> l2_kernel = hnswlib::SelectL2Kernel(dim, level);
+            hnswlib::DistanceKernel<float> ip_kernel = hnswlib::SelectInnerProductKernel(dim, level);
+            hnswlib::DistanceKernel<int> l2_int8_kernel = hnswlib::SelectInt8Kernel<true, true>(level);
+            hnswlib::DistanceKernel<int> ip_uint8_kernel = hnswlib::SelectInt8Kernel<false, false>(level);
+            assert(l2_kernel.level <= level && ip_kernel.level <= level);
+            assert(l2_int8_kernel.level <= level && ip_uint8_kernel.level <= level);
+            assert(close(l2_kernel.func(a.data(), b.data(), &dim), l2));
+            assert(close(ip_kernel.func(a.data(), b.data(), &dim), ip));
+            assert(l2_int8_kernel.func(a8.data(), b8.data(), &dim) == l2_int8);
+            assert(ip_uint8_kernel.func(a8.data(), b8.data(), &dim) == ip_uint8);
+        }
+    }
+
+    // the kernels of the spaces storing encoded vectors, between stored vectors and from float queries
+    for (size_t dim : {1, 7, 8, 16, 17, 33, 100}) {
+        std::vector<float> q(dim), vmin(dim), step(dim);
+        std::vector<hnswlib::fp16_t> a16(dim), b16(dim);
+        std::vector<uint8_t> a8(dim), b8(dim);
+        for (size_t i = 0; i < dim; i++) {
+            q[i] = distrib(rng);
+            a16[i] = hnswlib::FloatToHalf(distrib(rng));
+            b16[i] = hnswlib::FloatToHalf(distrib(rng));
+            a8[i] = distrib_int8(rng);
+            b8[i] = distrib_int8(rng);
+            vmin[i] = distrib(rng);
+            step[i] = (distrib(rng) + 1) / 255;
+        }
+        hnswlib::SQ8Params param = {dim, vmin.data(), step.data()};
+        float fp16 = hnswlib::L2SqrFP16(a16.data(), b16.data(), &dim);
+        float fp16_query = hnswlib::L2SqrFP16Query(q.data(), b16.data(), &dim);
+        float sq8 = hnswlib::L2SqrSQ8(a8.data(), b8.data(), &param);
+        float sq8_query = hnswlib::L2SqrSQ8Query(q.data(), b8.data(), &param);
+        float ip_sq8 = hnswlib::InnerProductSQ8Distance(a8.data(), b8.data(), &param);
+        float ip_sq8_query = hnswlib::InnerProductSQ8QueryDistance(q.data(), b8.data(), &param);
+
+        for (hnswlib::SimdLevel level : cpu_levels()) {
+            std::vector<hnswlib::DistanceKernel<float>> kernels = {
+                hnswlib::SelectFP16Kernel<false>(level), hnswlib::SelectFP16Kernel<true>(level),
+                hnswlib::SelectL2SQ8Kernel<false>(level), hnswlib::SelectL2SQ8Kernel<true>(level),
+                hnswlib::SelectInnerProductSQ8Kernel<false>(level), hnswlib::SelectInnerProductSQ8Kernel<true>(level)};
+            for (auto &kernel : kernels)
+                assert(kernel.level <= level);
+            assert(close(kernels[0].func(a16.data(), b16.data(), &dim), fp16));
+            assert(close(kernels[1].func(q.data(), b16.data(), &dim), fp16_query));
+            assert(close(kernels[2].func(a8.data(), b8.data(), &param), sq8));
+            assert(close(kernels[3].func(q.data(), b8.data(), &param), sq8_query));
+            assert(close(kernels[4].func(a8.data(), b8.data(), &param), ip_sq8));
+            assert(close(kernels[5].func(q.data(), b8.data(), &param), ip_sq8_query));
+        }
+    }
+
+    assert(hnswlib::SelectL2Kernel(64, hnswlib::SimdLevel::Scalar).level == hnswlib::SimdLevel::Scalar);
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (hnswlib::CpuSimdLevel() >= hnswlib::SimdLevel::AVX512) {
+        assert(hnswlib::SelectL2Kernel(64, hnswlib::CpuSimdLevel()).level == hnswlib::SimdLevel::AVX512);
+        assert(hnswlib::SelectL2Kernel(64, hnswlib::SimdLevel::AVX2).level == hnswlib::SimdLevel::AVX);
+    }
+#endif
+}
+
+// The spaces report the kernel they picked for this CPU
+void test_spaces() {
+    std::cout << "CPU: " << hnswlib::SimdLevelName(hnswlib::CpuSimdLevel())
+              << ", build: " << hnswlib::SimdLevelName(hnswlib::BuildSimdLevel()) << std::endl;
+    assert(hnswlib::CpuSimdLevel() == hnswlib::DetectSimdLevel());
+
+    hnswlib::L2Space l2(64);
+    hnswlib::InnerProductSpace ip(20);
+    hnswlib::L2SpaceI8 l2_int8(64);
+    hnswlib::MultiVectorL2Space<int> multivector(64);
+    std::cout << "L2Space(64): " << l2.get_dist_func_name()
+              << " " << hnswlib::SimdLevelName(l2.get_dist_func_simd_level()) << std::endl;
+    std::cout << "L2SpaceI8(64): " << l2_int8.get_dist_func_name()
+              << " " << hnswlib::SimdLevelName(l2_int8.get_dist_func_simd_level()) << std::endl;
+
+    hnswlib::DistanceKernel<float> l2_kernel = hnswlib::SelectL2Kernel(64, hnswlib::CpuSimdLevel());
+    assert(l2.get_dist_func() == l2_kernel.func);
+    assert(l2.get_dist_func_simd_level() == l2_kernel.level);
+    assert(std::string(l2.get_dist_func_name()) == l2_kernel.name);
+    assert(multivector.get_dist_func() == l2_kernel.func);
+    assert(ip.get_dist_func() == hnswlib::SelectInnerProductKernel(20, hnswlib::CpuSimdLevel()).func);
+    hnswlib::DistanceKernel<int> l2_int8_kernel = hnswlib::SelectInt8Kernel<true, true>();
+    assert(l2_int8.get_dist_func() == l2_int8_kernel.func);
+    assert(l2_int8.get_dist_func_simd_level() <= hnswlib::CpuSimdLevel());
+
+    // the spaces storing encoded vectors pick their kernels the same way
+    hnswlib::L2SpaceFP16 fp16(64);
+    hnswlib::ScalarQuantizer8 sq(64);
+    hnswlib::L2SpaceSQ8 l2_sq8(sq);
+    hnswlib::InnerProductSpaceSQ8 ip_sq8(sq);
+    std::cout << "L2SpaceFP16(64): " << fp16.get_dist_func_name()
+              << " " << hnswlib::SimdLevelName(fp16.get_dist_func_simd_level()) << std::endl;
+    hnswlib::DistanceKernel<float> fp16_kernel = hnswlib::SelectFP16Kernel<false>();
+    assert(fp16.get_dist_func() == fp16_kernel.func);
+    assert(fp16.get_query_dist_func() == hnswlib::SelectFP16Kernel<true>().func);
+    assert(fp16.get_dist_func_simd_level() == fp16_kernel.level);
+    assert(std::string(fp16.get_dist_func_name()) == fp16_kernel.name);
+    assert(l2_sq8.get_dist_func() == hnswlib::SelectL2SQ8Kernel<false>().func);
+    assert(l2_sq8.get_query_dist_func() == hnswlib::SelectL2SQ8Kernel<true>().func);
+    assert(std::string(l2_sq8.get_dist_func_name()) == hnswlib::SelectL2SQ8Kernel<false>().name);
+    assert(ip_sq8.get_dist_func() == hnswlib::SelectInnerProductSQ8Kernel<false>().func);
+    assert(ip_sq8.get_query_dist_func() == hnswlib::SelectInnerProductSQ8Kernel<true>().func);
+    assert(ip_sq8.get_dist_func_simd_level() <= hnswlib::CpuSimdLevel());
+#if defined(HNSWLIB_AVX512_KERNELS)
+    if (hnswlib::CpuSimdLevel() >= hnswlib::SimdLevel::AVX512) {
+        assert(fp16.get_dist_func_simd_level() == hnswlib::SimdLevel::AVX512);
+        assert(l2_sq8.get_dist_func_simd_level() == hnswlib::SimdLevel::AVX512);
+    }
+#endif
+}
+
+// Spaces created concurrently all get working kernels
+void test_concurrent_spaces() {
+    size_t num_threads = 8;
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([t, &failures]() {
+            std::vector<float> a(64), b(64);
+            for (size_t i = 0; i < a.size(); i++) {
+                a[i] = (float) ((i * 7 + t) % 13) / 13;
+                b[i] = (float) ((i * 5 + 3 * t) % 11) / 11;
+            }
+            for (size_t rep = 0; rep < 200; rep++) {
+                size_t dim = 1 + (rep * 13 + t) % 64;
+                hnswlib::L2Space l2(dim);
+                hnswlib::InnerProductSpace ip(dim);
+                hnswlib::MultiVectorL2Space<int> multivector(dim);
+                float expected_l2 = hnswlib::L2Sqr(a.data(), b.data(), &dim);
+                float expected_ip = hnswlib::InnerProductDistance(a.data(), b.data(), &dim);
+                if (!close(l2.get_dist_func()(a.data(), b.data(), l2.get_dist_func_param()), expected_l2) ||
+                    !close(ip.get_dist_func()(a.data(), b.data(), ip.get_dist_func_param()), expected_ip) ||
+                    !close(multivector.get_dist_func()(a.data(), b.data(), &dim), expected_l2))
+                    failures++;
+            }
+        }));
+    }
+    for (auto &thread : threads)
+        thread.join();
+    assert(failures == 0);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_kernels();
+    test_spaces();
+    test_concurrent_spaces();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
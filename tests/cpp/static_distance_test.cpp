@@ -0,0 +1,131 @@
+// This is a test file for the indexes computing distances with a static functor of their space
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+template<typename Index>
+float recall(Index &alg, hnswlib::BruteforceSearch<float> &alg_brute, const std::vector<float> &query, int d, size_t k) {
+    size_t nq = query.size() / d;
+    float correct = 0;
+    for (size_t j = 0; j < nq; j++) {
+        auto expected = alg_brute.searchKnnCloserFirst(query.data() + j * d, k);
+        auto res = alg.searchKnnCloserFirst(query.data() + j * d, k);
+        for (auto &item : res) {
+            for (auto &expected_item : expected) {
+                if (item.second == expected_item.second)
+                    correct++;
+            }
+        }
+    }
+    return correct / (nq * k);
+}
+
+template<typename StaticDistance>
+void test(hnswlib::SpaceInterface<float> &space, int d) {
+    idx_t n = 3000;
+    idx_t nq = 100;
+    size_t k = 10;
+    std::string path = "static_distance_test.bin";
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    // the static functor computes the distances of the space
+    size_t dim = d;
+    for (idx_t i = 0; i < 100; i++) {
+        float expected = space.get_dist_func()(query.data(), data.data() + i * d, &dim);
+        float actual = StaticDistance::distance(query.data(), data.data() + i * d, &dim);
+        assert(std::abs(actual - expected) <= 1e-4f * std::max(1.0f, std::abs(expected)));
+    }
+
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    hnswlib::HierarchicalNSW<float, StaticDistance> alg_static(&space, n);
+    for (idx_t i = 0; i < n; i++) {
+        alg_brute.addPoint(data.data() + d * i, i);
+        alg_static.addPoint(data.data() + d * i, i);
+    }
+    alg_static.setEf(100);
+    float recall_static = recall(alg_static, alg_brute, query, d, k);
+    std::cout << "Recall: " << recall_static << std::endl;
+    assert(recall_static > 0.9);
+
+    // both forms read the files of the other
+    alg_static.saveIndex(path);
+    hnswlib::HierarchicalNSW<float> alg_dynamic(&space, path);
+    alg_dynamic.setEf(100);
+    for (idx_t j = 0; j < nq; j++) {
+        auto expected = alg_static.searchKnnCloserFirst(query.data() + j * d, k);
+        auto res = alg_dynamic.searchKnnCloserFirst(query.data() + j * d, k);
+        assert(res.size() == expected.size());
+        for (size_t i = 0; i < res.size(); i++) {
+            assert(res[i].second == expected[i].second);
+        }
+    }
+    alg_dynamic.saveIndex(path);
+    hnswlib::HierarchicalNSW<float, StaticDistance> alg_loaded(&space, path);
+    alg_loaded.setEf(100);
+    assert(recall(alg_loaded, alg_brute, query, d, k) == recall_static);
+    std::remove(path.c_str());
+}
+
+template <typename function_t>
+bool throws(function_t function) {
+    try {
+        function();
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+// an index refuses a space whose dimension or vectors differ from its static functor
+void test_mismatch() {
+    std::string path = "static_distance_mismatch.bin";
+    hnswlib::L2Space l2_20(20);
+    hnswlib::L2SpaceFP16 fp16_20(20);
+    assert(throws([&]() { hnswlib::HierarchicalNSW<float, hnswlib::L2StaticDistance<128>> alg(&l2_20, 10); }));
+    assert(throws([&]() { hnswlib::HierarchicalNSW<float, hnswlib::L2StaticDistance<>> alg(&fp16_20, 10); }));
+
+    std::vector<float> point(20, 1.0f);
+    hnswlib::HierarchicalNSW<float> alg_dynamic(&l2_20, 10);
+    alg_dynamic.addPoint(point.data(), 0);
+    alg_dynamic.saveIndex(path);
+    assert(throws([&]() { hnswlib::HierarchicalNSW<float, hnswlib::L2StaticDistance<128>> alg(&l2_20, path); }));
+    hnswlib::HierarchicalNSW<float, hnswlib::L2StaticDistance<128>> alg_mapped(&l2_20);
+    assert(throws([&]() { alg_mapped.loadIndexMapped(path, &l2_20); }));
+    hnswlib::HierarchicalNSW<float, hnswlib::L2StaticDistance<20>> alg_loaded(&l2_20, path);
+    assert(alg_loaded.searchKnn(point.data(), 1).top().second == 0);
+    std::remove(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    hnswlib::L2Space l2_128(128);
+    test<hnswlib::L2StaticDistance<128>>(l2_128, 128);
+    hnswlib::L2Space l2_20(20);
+    test<hnswlib::L2StaticDistance<>>(l2_20, 20);
+    hnswlib::InnerProductSpace ip(64);
+    test<hnswlib::InnerProductStaticDistance<>>(ip, 64);
+    test_mismatch();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+// This is a test file for the filtered searches walking through allowed elements only
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <iostream>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+class PickDivisibleIds : public hnswlib::BaseFilterFunctor {
+    size_t divisor;
+ public:
+    explicit PickDivisibleIds(size_t divisor) : divisor(divisor) {}
+
+    bool operator()(idx_t label) {
+        return label % divisor == 0;
+    }
+};
+
+std::vector<idx_t> labels_of(std::priority_queue<std::pair<float, idx_t>> result) {
+    std::vector<idx_t> labels;
+    for (; !result.empty(); result.pop())
+        labels.push_back(result.top().second);
+    return labels;
+}
+
+void test() {
+    int d = 64;
+    idx_t n = 20000;
+    idx_t nq = 50;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    hnswlib::BruteforceSearch<float> alg_brute(&space, n);
+    for (idx_t i = 0; i < n; i++) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+        alg_brute.addPoint(data.data() + d * i, i);
+    }
+    alg_hnsw.setEf(200);
+
+    // 2% of the elements are allowed
+    PickDivisibleIds filter(50);
+    hnswlib::IdBitset allowed_ids = alg_hnsw.getAllowedIds(&filter);
+    assert(std::abs(alg_hnsw.estimateSelectivity(&filter) - 0.02) < 0.02);
+    assert(alg_hnsw.estimateSelectivity(nullptr) == 1);
+
+    hnswlib::SearchStats graph_stats;
+    for (idx_t j = 0; j < nq; j++)
+        alg_hnsw.searchKnn(query.data() + j * d, k, allowed_ids, &graph_stats);
+
+    alg_hnsw.setTwoHopMaxSelectivity(0.05);
+    hnswlib::SearchStats two_hop_stats;
+    float correct = 0;
+    for (idx_t j = 0; j < nq; j++) {
+        const float *p = query.data() + j * d;
+        std::vector<idx_t> expected = labels_of(alg_brute.searchKnn(p, k, &filter));
+        std::vector<idx_t> res = labels_of(alg_hnsw.searchKnn(p, k, allowed_ids, &two_hop_stats));
+        assert(res.size() == k);
+        for (idx_t label : res) {
+            assert(label % 50 == 0);
+            for (idx_t expected_label : expected)
+                correct += label == expected_label;
+        }
+        // the functor search estimates the selectivity and takes the same walk
+        assert(labels_of(alg_hnsw.searchKnn(p, k, &filter)) == res);
+    }
+    float recall = correct / (nq * k);
+    std::cout << "Recall: " << recall << ", distances per query: "
+              << graph_stats.distance_computations / nq << " -> " << two_hop_stats.distance_computations / nq
+              << std::endl;
+    assert(recall > 0.8);
+    assert(two_hop_stats.distance_computations * 4 < graph_stats.distance_computations);
+
+    // deleted elements are left out of the walk too
+    for (idx_t i = 0; i < n; i += 100)
+        alg_hnsw.markDelete(i);
+    for (idx_t j = 0; j < nq; j++) {
+        for (idx_t label : labels_of(alg_hnsw.searchKnn(query.data() + j * d, k, &filter)))
+            assert(label % 50 == 0 && label % 100 != 0);
+        for (idx_t label : labels_of(alg_hnsw.searchKnn(query.data() + j * d, k, allowed_ids)))
+            assert(label % 50 == 0 && label % 100 != 0);
+    }
+
+    // filters allowing more elements than the limit keep the usual walk
+    PickDivisibleIds half(2);
+    assert(alg_hnsw.estimateSelectivity(&half) > 0.05);
+    alg_hnsw.searchKnn(query.data(), k, &half);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+// This is a test file for the visited set pools and the compact visited set
+
+#include "../../hnswlib/hnswlib.h"
+
+#include <assert.h>
+
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <unordered_set>
+
+namespace {
+
+using idx_t = hnswlib::labeltype;
+
+void test_hash_set() {
+    hnswlib::VisitedHashSet visited;
+    size_t initial_capacity = visited.capacity();
+
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_int_distribution<unsigned int> distrib;
+    for (int rep = 0; rep < 3; rep++) {
+        visited.reset();
+        std::unordered_set<unsigned int> expected;
+        for (int i = 0; i < 20000; i++) {
+            unsigned int id = i % 3 == 0 ? distrib(rng) % 100 : distrib(rng);
+            assert(visited.visit(id) == expected.insert(id).second);
+        }
+        for (unsigned int id : expected) {
+            assert(!visited.visit(id));
+        }
+    }
+    assert(visited.capacity() > initial_capacity);
+
+    // nothing survives a reset
+    visited.reset();
+    assert(visited.visit(0));
+    assert(visited.visit(1));
+    assert(!visited.visit(0));
+
+    // a set sized for the expected visits does not grow
+    hnswlib::VisitedHashSet sized(20000);
+    size_t sized_capacity = sized.capacity();
+    for (unsigned int id = 0; id < 20000; id++)
+        sized.visit(id * 7919);
+    assert(sized.capacity() == sized_capacity);
+}
+
+// every set is owned by a single thread at a time and comes back reset
+template<typename visited_t>
+void test_pool() {
+    const int num_threads = 8;
+    const unsigned int numelements = 1000;
+    hnswlib::VisitedSetPool<visited_t> pool(1, numelements);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&pool, t]() {
+            for (int rep = 0; rep < 2000; rep++) {
+                visited_t *vl = pool.getFreeVisitedList();
+                for (unsigned int id = t; id < numelements; id += num_threads) {
+                    assert(vl->visit(id));
+                }
+                for (unsigned int id = t; id < numelements; id += num_threads) {
+                    assert(!vl->visit(id));
+                }
+                pool.releaseVisitedList(vl);
+            }
+        }));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // a thread gets back the set it released
+    visited_t *vl = pool.getFreeVisitedList();
+    pool.releaseVisitedList(vl);
+    visited_t *vl_again = pool.getFreeVisitedList();
+    assert(vl_again == vl);
+    pool.releaseVisitedList(vl_again);
+}
+
+void test_search() {
+    int d = 16;
+    idx_t n = 5000;
+    idx_t nq = 100;
+    size_t k = 10;
+
+    std::vector<float> data(n * d);
+    std::vector<float> query(nq * d);
+    std::mt19937 rng;
+    rng.seed(47);
+    std::uniform_real_distribution<> distrib;
+    for (float &x : data)
+        x = distrib(rng);
+    for (float &x : query)
+        x = distrib(rng);
+
+    hnswlib::L2Space space(d);
+    hnswlib::HierarchicalNSW<float> alg_hnsw(&space, n);
+    for (size_t i = 0; i < n; ++i) {
+        alg_hnsw.addPoint(data.data() + d * i, i);
+    }
+    for (size_t i = 0; i < n; i += 11) {
+        alg_hnsw.markDelete(i);
+    }
+
+    // the pooled sets are sized for the neighbors of max_ef expanded elements, at most all the elements
+    for (size_t max_ef : {10, 200}) {
+        alg_hnsw.setCompactVisitedMaxEf(max_ef);
+        size_t expected_visits = std::min(max_ef * alg_hnsw.maxM0_, (size_t) n);
+        hnswlib::VisitedHashSet *vs = alg_hnsw.visited_hash_set_pool_->getFreeVisitedList();
+        assert(vs->capacity() >= 2 * expected_visits);
+        assert(vs->capacity() < 4 * std::max(expected_visits, (size_t) 512));
+        alg_hnsw.visited_hash_set_pool_->releaseVisitedList(vs);
+    }
+
+    // both visited sets follow the same walk
+    for (size_t ef : {10, 50, 200}) {
+        alg_hnsw.setEf(ef);
+        for (size_t j = 0; j < nq; ++j) {
+            alg_hnsw.setCompactVisitedMaxEf(0);
+            auto expected = alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k);
+            alg_hnsw.setCompactVisitedMaxEf(ef);
+            auto res = alg_hnsw.searchKnnCloserFirst(query.data() + j * d, k);
+            assert(res == expected);
+            assert(res.size() == k);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Testing ..." << std::endl;
+    test_hash_set();
+    test_pool<hnswlib::VisitedList>();
+    test_pool<hnswlib::VisitedHashSet>();
+    test_search();
+    std::cout << "Test ok" << std::endl;
+
+    return 0;
+}
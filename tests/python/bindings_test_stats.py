@@ -0,0 +1,41 @@
+import unittest
+
+import numpy as np
+
+import hnswlib
+
+
+class SearchStatsTestCase(unittest.TestCase):
+    def testSearchStats(self):
+        dim = 16
+        num_elements = 5000
+        num_queries = 100
+
+        data = np.float32(np.random.random((num_elements, dim)))
+        queries = np.float32(np.random.random((num_queries, dim)))
+
+        p = hnswlib.Index(space='l2', dim=dim)
+        p.init_index(max_elements=num_elements, ef_construction=100, M=8)
+        p.set_ef(50)
+        p.add_items(data)
+
+        labels, distances = p.knn_query(queries, k=10)
+        labels_stats, distances_stats, stats = p.knn_query(queries, k=10, return_stats=True)
+        # the counters do not change the results
+        self.assertTrue(np.array_equal(labels, labels_stats))
+        self.assertTrue(np.allclose(distances, distances_stats))
+
+        self.assertEqual(stats["hops"].shape, (num_queries,))
+        self.assertEqual(stats["hops_per_level"].shape[0], num_queries)
+        self.assertTrue(np.array_equal(stats["hops"], stats["hops_per_level"].sum(axis=1)))
+        self.assertTrue(np.all(stats["hops_per_level"][:, 0] > 0))
+        self.assertTrue(np.all(stats["distance_computations"] >= stats["visited_nodes"]))
+        self.assertTrue(np.all(stats["visited_nodes"] >= 50))
+        self.assertTrue(np.all(stats["heap_operations"] > 0))
+
+        # filtered searches are counted too
+        filter_function = lambda id: id % 2 == 0
+        labels, distances, stats = p.knn_query(queries, k=1, num_threads=1, filter=filter_function,
+                                               return_stats=True)
+        self.assertTrue(np.max(np.mod(labels, 2)) == 0)
+        self.assertTrue(np.all(stats["distance_computations"] > 0))